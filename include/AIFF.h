@@ -1,37 +1,31 @@
 #pragma once
 
-#include <fstream>
+#include "PcmWriter.h"
+#include <cstdint>
 #include <string>
 
 namespace mk {
 
-enum class BitDepth {
-	BitDepth16 = 16,
-	BitDepth24 = 24,
-};
-
-class AIFF
+/// Writes big-endian AIFF files, or AIFF-C files for floating-point samples
+class AIFF : public PcmWriter
 {
 public:
 	AIFF(const std::string& filePath, BitDepth bitDepth, uint16_t channels, double sampleRate);
-	~AIFF();
 
-	BitDepth bitDepth() const { return _bitDepth; }
+	/// Streams exactly frames sample frames to out, which is never rewound
+	AIFF(std::ostream& out, BitDepth bitDepth, uint16_t channels, double sampleRate, uint32_t frames);
 
-	uint16_t channels() const { return _channels; }
+	~AIFF();
 
-	double sampleRate() const { return _sampleRate; }
+protected:
+	void encode(const float* samples, size_t count, uint8_t* out) const override;
 
-	AIFF& operator<<(double sample);
+	void encode(const double* samples, size_t count, uint8_t* out) const override;
 
 private:
-	std::ofstream _f;
-
-	const BitDepth _bitDepth;
-	const uint16_t _channels;
-	const double _sampleRate;
-	uint8_t _sampleDepth;
-	uint32_t _samples;
+	/// Writes FORM, COMM (preceded by FVER for AIFF-C) and SSND chunk headers
+	/// sized for totalFrames() frames
+	void writeHeader();
 };
 
 } // namespace mk
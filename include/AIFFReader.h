@@ -0,0 +1,60 @@
+#pragma once
+
+#include "PCM.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace mk {
+
+/// Read-only view of an AIFF or AIFF-C file mapped into memory.
+/// Sample frames are accessed in place, without intermediate copies.
+class AIFFReader
+{
+public:
+	explicit AIFFReader(const std::string& filePath);
+	~AIFFReader();
+
+	AIFFReader(const AIFFReader&) = delete;
+	AIFFReader& operator=(const AIFFReader&) = delete;
+
+	/// Returns true if the file was mapped and its chunks parsed successfully
+	bool valid() const { return _samples != nullptr; }
+
+	uint16_t channels() const { return _channels; }
+
+	BitDepth bitDepth() const { return _bitDepth; }
+
+	/// Returns the number of bits per sample
+	uint16_t sampleDepth() const { return bitsPerSample(_bitDepth); }
+
+	double sampleRate() const { return _sampleRate; }
+
+	/// Returns the number of sample frames in the SSND chunk
+	uint32_t frames() const { return _frames; }
+
+	/// Returns the size of an encoded sample frame in bytes
+	size_t frameSize() const { return _frameSize; }
+
+	/// Returns the encoded (big-endian) samples of a frame
+	const uint8_t* frame(size_t index) const { return _samples + index * _frameSize; }
+
+	/// Decodes up to frameCount interleaved frames starting at firstFrame into
+	/// floating-point samples in [-1;1). Returns the number of frames decoded.
+	size_t read(size_t firstFrame, size_t frameCount, float* out) const;
+
+private:
+	bool parse(const std::string& filePath);
+
+	void* _map;
+	size_t _mapSize;
+
+	const uint8_t* _samples;
+	uint16_t _channels;
+	BitDepth _bitDepth;
+	double _sampleRate;
+	uint32_t _frames;
+	size_t _frameSize;
+};
+
+} // namespace mk
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace mk {
+
+/// Value of a parameter at a time in seconds
+struct AutomationPoint {
+	double time;
+	double value;
+};
+
+/// Breakpoint automation of a parameter, such as a gain in dB or a pan
+/// position: its value ramps linearly from each breakpoint to the next, and
+/// holds the value of the first and last breakpoints before and after them.
+/// Breakpoints at the same time make the value jump.
+///
+///     Automation fadeIn;
+///     fadeIn.add(0.0, -60.0).add(2.5, 0.0);
+class Automation
+{
+public:
+	Automation();
+
+	explicit Automation(const std::vector<AutomationPoint>& breakpoints);
+
+	/// Adds a breakpoint, at the time of the last one or later
+	Automation& add(double time, double value);
+
+	/// Parses breakpoints written as time:value, separated by commas or
+	/// whitespace, e.g. "0:-60, 2.5:0". Returns false, after printing why, if
+	/// they're incorrect, leaving the automation unchanged.
+	bool parse(const std::string& text);
+
+	/// Parses the breakpoints of a text file, see parse()
+	bool load(const std::string& filePath);
+
+	/// Loads the breakpoints of a file if fileOrText names one that can be
+	/// opened, parses fileOrText itself otherwise, e.g. for a command line
+	/// argument taking either
+	bool read(const std::string& fileOrText);
+
+	bool empty() const { return _breakpoints.empty(); }
+
+	const std::vector<AutomationPoint>& breakpoints() const { return _breakpoints; }
+
+	/// Returns the value at a time, 0 if there are no breakpoints
+	double valueAt(double time) const;
+
+private:
+	std::vector<AutomationPoint> _breakpoints;
+};
+
+} // namespace mk
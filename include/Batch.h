@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace mk {
+
+class ThreadPool;
+
+/// Outcome of a batch: files that failed don't stop the others
+struct BatchReport {
+	BatchReport();
+
+	/// Returns the input throughput in MB/s
+	double megabytesPerSecond() const;
+
+	size_t succeeded;
+
+	// input files that failed
+	std::vector<std::string> failures;
+
+	// size of the input files processed successfully
+	uint64_t bytes;
+	double seconds;
+};
+
+/// Processes an input file into an output file, see Util.h
+typedef std::function<bool(const std::string& inputFilePath, const std::string& outputFilePath)> FileOperation;
+
+/// Returns the path of the output of a batch for an input file: the file
+/// name of the input in the output directory
+std::string batchOutputPath(const std::string& inputFilePath, const std::string& outputDirectory);
+
+/// Applies an operation to each input file, writing to batchOutputPath(), on
+/// all threads of a pool. Files are handed out largest first, each to the
+/// next thread done with its previous file, so the batch isn't left waiting
+/// for a long file started last. The operation runs on the threads of the
+/// pool, so it must not run loops on the pool itself.
+BatchReport processBatch(const std::vector<std::string>& inputFilePaths,
+						 const std::string& outputDirectory,
+						 const FileOperation& operation,
+						 ThreadPool& pool);
+
+/// Normalizes files as an album: a single gain, bringing the peak of all
+/// files to peakLoudness, is applied to each file, so their relative levels
+/// are kept. Files whose peak can't be scanned are reported as failures and
+/// left out.
+BatchReport normalizeAlbum(const std::vector<std::string>& inputFilePaths,
+						   const std::string& outputDirectory,
+						   float peakLoudness,
+						   ThreadPool& pool);
+
+} // namespace mk
@@ -0,0 +1,226 @@
+#pragma once
+
+#include "Simd.h"
+#include "Synthesis.h"
+#include <cstddef>
+#include <tuple>
+#include <utility>
+
+/// Modules composed at compile time.
+///
+/// Combinators hold their modules by value, so calls to their operator() and
+/// render() are bound statically and can be inlined, where a graph of
+/// AudioModule pointers costs an indirect call per node per sample. Block
+/// rendering combines whole blocks with vectorized loops. Combinators are
+/// modules themselves and nest, e.g.
+///
+///     Mul<ADEnvelope, Sum<SineWave, SawWave>> voice(ADEnvelope(...), Sum<SineWave, SawWave>(440.0, 220.0));
+///     std::get<1>(voice._modules).render(...);
+///
+/// and plug into runtime graphs as any AudioModule. ModuleRef plugs a
+/// runtime module into a combinator in turn.
+
+namespace mk {
+
+namespace combinators {
+
+// frames combined at once by block rendering, from a buffer on the stack
+constexpr size_t CHUNK_FRAMES = 256;
+
+struct Multiply {
+	static double combine(double a, double b) {
+		return a * b;
+	}
+
+	static void combine(float* out, const float* in, size_t count) {
+		size_t i = 0;
+#if defined(MK_AVX2)
+		for (; i + 8 <= count; i += 8) {
+			_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(out + i), _mm256_loadu_ps(in + i)));
+		}
+#elif defined(MK_SSE2)
+		for (; i + 4 <= count; i += 4) {
+			_mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(out + i), _mm_loadu_ps(in + i)));
+		}
+#endif
+		for (; i < count; ++i) {
+			out[i] *= in[i];
+		}
+	}
+};
+
+struct Add {
+	static double combine(double a, double b) {
+		return a + b;
+	}
+
+	static void combine(float* out, const float* in, size_t count) {
+		size_t i = 0;
+#if defined(MK_AVX2)
+		for (; i + 8 <= count; i += 8) {
+			_mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), _mm256_loadu_ps(in + i)));
+		}
+#elif defined(MK_SSE2)
+		for (; i + 4 <= count; i += 4) {
+			_mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_loadu_ps(in + i)));
+		}
+#endif
+		for (; i < count; ++i) {
+			out[i] += in[i];
+		}
+	}
+};
+
+/// Combines modules I to I + Count - 1 of a tuple with Op
+template<typename Op, size_t I, size_t Count>
+struct Fold {
+	template<typename Tuple>
+	static double sample(const Tuple& modules, double time) {
+		return Op::combine(std::get<I>(modules)(time), Fold<Op, I + 1, Count - 1>::sample(modules, time));
+	}
+
+	/// Renders each module into scratch and combines it into out
+	template<typename Tuple>
+	static void render(Tuple& modules, float* out, float* scratch, size_t frames, double sampleRate) {
+		Fold<Op, I, 1>::render(modules, out, scratch, frames, sampleRate);
+		Fold<Op, I + 1, Count - 1>::render(modules, out, scratch, frames, sampleRate);
+	}
+
+	template<typename Tuple>
+	static void reset(Tuple& modules) {
+		std::get<I>(modules).reset();
+		Fold<Op, I + 1, Count - 1>::reset(modules);
+	}
+};
+
+template<typename Op, size_t I>
+struct Fold<Op, I, 1> {
+	template<typename Tuple>
+	static double sample(const Tuple& modules, double time) {
+		return std::get<I>(modules)(time);
+	}
+
+	template<typename Tuple>
+	static void render(Tuple& modules, float* out, float* scratch, size_t frames, double sampleRate) {
+		std::get<I>(modules).render(scratch, frames, sampleRate);
+		Op::combine(out, scratch, frames);
+	}
+
+	template<typename Tuple>
+	static void reset(Tuple& modules) {
+		std::get<I>(modules).reset();
+	}
+};
+
+/// Combines two or more modules sample by sample with Op
+template<typename Op, typename... Modules>
+struct Combinator : public AudioModule {
+	static_assert(sizeof...(Modules) >= 2, "combinators need at least two modules");
+
+	Combinator(Modules... modules)
+		: _modules(std::move(modules)...)
+	{
+	}
+
+	double operator()(double time) const override {
+		return Fold<Op, 0, sizeof...(Modules)>::sample(_modules, time);
+	}
+
+	void render(float* out, size_t frames, double sampleRate) override {
+		float scratch[CHUNK_FRAMES];
+		for (size_t first = 0; first < frames; first += CHUNK_FRAMES) {
+			const size_t n = frames - first < CHUNK_FRAMES ? frames - first : CHUNK_FRAMES;
+			std::get<0>(_modules).render(out + first, n, sampleRate);
+			Fold<Op, 1, sizeof...(Modules) - 1>::render(_modules, out + first, scratch, n, sampleRate);
+		}
+		_renderedFrames += frames;
+	}
+
+	void reset() override {
+		AudioModule::reset();
+		Fold<Op, 0, sizeof...(Modules)>::reset(_modules);
+	}
+
+	std::tuple<Modules...> _modules;
+};
+
+} // namespace combinators
+
+/// Product of modules, e.g. an envelope applied to an oscillator
+template<typename... Modules>
+using Mul = combinators::Combinator<combinators::Multiply, Modules...>;
+
+/// Sum of modules, e.g. a mix of oscillators
+template<typename... Modules>
+using Sum = combinators::Combinator<combinators::Add, Modules...>;
+
+/// Constant level, e.g. a gain or a DC offset in a combinator
+struct Constant : public AudioModule {
+	explicit Constant(double level) : _level(level) {}
+
+	double operator()(double) const override {
+		return _level;
+	}
+
+	void render(float* out, size_t frames, double) override {
+		const float level = static_cast<float>(_level);
+		for (size_t i = 0; i < frames; ++i) {
+			out[i] = level;
+		}
+		_renderedFrames += frames;
+	}
+
+	double _level;
+};
+
+/// Module scaled by a gain
+template<typename Module>
+struct Gain : public AudioModule {
+	Gain(Module module, double gain)
+		: _module(std::move(module))
+		, _gain(gain)
+	{
+	}
+
+	double operator()(double time) const override {
+		return _gain * _module(time);
+	}
+
+	void render(float* out, size_t frames, double sampleRate) override {
+		_module.render(out, frames, sampleRate);
+		const float gain = static_cast<float>(_gain);
+		for (size_t i = 0; i < frames; ++i) {
+			out[i] *= gain;
+		}
+		_renderedFrames += frames;
+	}
+
+	void reset() override {
+		AudioModule::reset();
+		_module.reset();
+	}
+
+	Module _module;
+	double _gain;
+};
+
+/// Runtime module plugged into a combinator by reference, through virtual calls
+struct ModuleRef {
+	ModuleRef(AudioModule& module) : _module(&module) {}
+
+	double operator()(double time) const {
+		return (*_module)(time);
+	}
+
+	void render(float* out, size_t frames, double sampleRate) {
+		_module->render(out, frames, sampleRate);
+	}
+
+	void reset() {
+		_module->reset();
+	}
+
+	AudioModule* _module;
+};
+
+} // namespace mk
@@ -4,14 +4,14 @@
 
 namespace mk {
 
-uint32_t swapEndianness32(uint32_t n) {
+inline uint32_t swapEndianness32(uint32_t n) {
 	return (n & 0xFF000000) >> 24 |
 		   (n & 0x00FF0000) >>  8 |
 		   (n & 0x0000FF00) <<  8 |
 		   (n & 0x000000FF) << 24;
 }
 
-uint16_t swapEndianness16(uint16_t n) {
+inline uint16_t swapEndianness16(uint16_t n) {
 	return (n & 0xFF00) >>  8 |
 		   (n & 0x00FF) <<  8;
 }
@@ -9,6 +9,9 @@ namespace mk {
 struct IeeeExtended {
 	IeeeExtended(double n = 0);
 
+	/// Copies an already encoded value from its 10 raw bytes
+	explicit IeeeExtended(const uint8_t* raw);
+
 	void operator=(double n);
 
 	operator double() const;
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mk {
+
+enum class BitDepth {
+	BitDepth8 = 8,
+	BitDepth16 = 16,
+	BitDepth24 = 24,
+	BitDepth32 = 32,
+
+	// IEEE floating-point samples, flagged with 0x100 on top of their bit count
+	Float32 = 0x100 | 32,
+	Float64 = 0x100 | 64,
+};
+
+/// Byte order of encoded multi-byte samples
+enum class ByteOrder {
+	BigEndian,
+	LittleEndian,
+};
+
+/// Returns the number of bits used to store each sample
+inline uint16_t bitsPerSample(BitDepth bitDepth) { return static_cast<uint16_t>(bitDepth) & 0xFF; }
+
+/// Returns true for floating-point sample formats
+inline bool isFloatingPoint(BitDepth bitDepth) { return (static_cast<uint16_t>(bitDepth) & 0x100) != 0; }
+
+/// Quantizes samples to 8-bit signed PCM, 1 byte per sample.
+/// Samples are clamped to [-1;1] and scaled to the maximum positive 8-bit value.
+void encodePCM8(const float* samples, size_t count, uint8_t* out);
+
+/// Quantizes samples to 8-bit signed PCM, 1 byte per sample.
+/// Samples are clamped to [-1;1] and scaled to the maximum positive 8-bit value.
+void encodePCM8(const double* samples, size_t count, uint8_t* out);
+
+/// Quantizes samples to 8-bit unsigned PCM (signed values offset by 128), 1 byte per sample
+void encodePCM8Unsigned(const float* samples, size_t count, uint8_t* out);
+
+/// Quantizes samples to 8-bit unsigned PCM (signed values offset by 128), 1 byte per sample
+void encodePCM8Unsigned(const double* samples, size_t count, uint8_t* out);
+
+/// Quantizes samples to 16-bit big-endian PCM, 2 bytes per sample.
+/// Samples are clamped to [-1;1] and scaled to the maximum positive 16-bit value.
+void encodePCM16BE(const float* samples, size_t count, uint8_t* out);
+
+/// Quantizes samples to 16-bit big-endian PCM, 2 bytes per sample.
+/// Samples are clamped to [-1;1] and scaled to the maximum positive 16-bit value.
+void encodePCM16BE(const double* samples, size_t count, uint8_t* out);
+
+/// Quantizes samples to tightly packed 24-bit big-endian PCM, 3 bytes per sample.
+/// Samples are clamped to [-1;1] and scaled to the maximum positive 24-bit value.
+void encodePCM24BE(const float* samples, size_t count, uint8_t* out);
+
+/// Quantizes samples to tightly packed 24-bit big-endian PCM, 3 bytes per sample.
+/// Samples are clamped to [-1;1] and scaled to the maximum positive 24-bit value.
+void encodePCM24BE(const double* samples, size_t count, uint8_t* out);
+
+/// Quantizes samples to 32-bit big-endian PCM, 4 bytes per sample.
+/// Samples are clamped to [-1;1] and scaled to the maximum positive 32-bit value.
+void encodePCM32BE(const float* samples, size_t count, uint8_t* out);
+
+/// Quantizes samples to 32-bit big-endian PCM, 4 bytes per sample.
+/// Samples are clamped to [-1;1] and scaled to the maximum positive 32-bit value.
+void encodePCM32BE(const double* samples, size_t count, uint8_t* out);
+
+/// Stores samples as big-endian IEEE 32-bit floats, without clamping
+void encodeFloat32BE(const float* samples, size_t count, uint8_t* out);
+
+/// Stores samples as big-endian IEEE 32-bit floats, without clamping
+void encodeFloat32BE(const double* samples, size_t count, uint8_t* out);
+
+/// Stores samples as big-endian IEEE 64-bit floats, without clamping
+void encodeFloat64BE(const float* samples, size_t count, uint8_t* out);
+
+/// Stores samples as big-endian IEEE 64-bit floats, without clamping
+void encodeFloat64BE(const double* samples, size_t count, uint8_t* out);
+
+/// Encodes samples in any format and byte order, 8-bit samples are signed.
+/// Little-endian output needs no byte swapping on little-endian hosts.
+void encodeSamples(const float* samples, size_t count, BitDepth bitDepth, ByteOrder byteOrder, uint8_t* out);
+
+/// Encodes samples in any format and byte order, 8-bit samples are signed.
+/// Little-endian output needs no byte swapping on little-endian hosts.
+void encodeSamples(const double* samples, size_t count, BitDepth bitDepth, ByteOrder byteOrder, uint8_t* out);
+
+/// Converts 8-bit signed PCM to floating-point samples in [-1;1)
+void decodePCM8(const uint8_t* in, size_t count, float* samples);
+
+/// Converts 16-bit big-endian PCM to floating-point samples in [-1;1)
+void decodePCM16BE(const uint8_t* in, size_t count, float* samples);
+
+/// Converts tightly packed 24-bit big-endian PCM to floating-point samples in [-1;1)
+void decodePCM24BE(const uint8_t* in, size_t count, float* samples);
+
+/// Converts 32-bit big-endian PCM to floating-point samples in [-1;1)
+void decodePCM32BE(const uint8_t* in, size_t count, float* samples);
+
+/// Converts big-endian IEEE 32-bit floats to samples
+void decodeFloat32BE(const uint8_t* in, size_t count, float* samples);
+
+/// Converts big-endian IEEE 64-bit floats to samples
+void decodeFloat64BE(const uint8_t* in, size_t count, float* samples);
+
+} // namespace mk
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "Synthesis.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace mk {
+
+class ThreadPool;
+
+/// Synthesis network built at runtime, rendering blocks through connections.
+///
+/// Module nodes render an AudioModule. Processor nodes compute a block from
+/// the blocks of their inputs, in the order they were connected: sums,
+/// products or any function. Each connection carries a block from one node
+/// to another, and one node is the output of the graph.
+///
+/// compile() sorts the nodes that feed the output into levels, each level
+/// depending only on the levels before it, and assigns their output blocks
+/// from an arena. A block is reused once the last level reading it is done,
+/// so the arena grows with the width of the graph rather than its node count.
+/// With a thread pool, the nodes of a level render in parallel; each module
+/// must then belong to a single node. Rendering never allocates.
+class PatchGraph
+{
+public:
+	typedef size_t NodeId;
+
+	/// Computes out from inputs[0] ... inputs[inputCount - 1], frames samples each
+	typedef std::function<void(const float* const* inputs, size_t inputCount, float* out, size_t frames)> Processor;
+
+	static constexpr NodeId NO_NODE = SIZE_MAX;
+
+	/// Creates a graph rendering at sampleRate in blocks of up to blockFrames frames
+	PatchGraph(double sampleRate, size_t blockFrames = 256);
+
+	/// Adds a node rendering module, which must outlive the graph
+	NodeId addModule(AudioModule& module);
+
+	/// Adds a node summing its inputs
+	NodeId addSum();
+
+	/// Adds a node multiplying its inputs, e.g. an oscillator by an envelope
+	NodeId addProduct();
+
+	/// Adds a node computing its block with processor
+	NodeId addProcessor(const Processor& processor);
+
+	/// Connects the output of a node to an input of a processor node.
+	/// Returns false if a node doesn't exist or to is a module node.
+	bool connect(NodeId from, NodeId to);
+
+	/// Selects the node whose block is the graph's output
+	void setOutput(NodeId node);
+
+	/// Renders the nodes of each level in parallel on pool, or on the calling
+	/// thread when pool is nullptr. The pool must outlive the graph.
+	void setThreadPool(ThreadPool* pool) { _pool = pool; }
+
+	/// Schedules the nodes feeding the output and assigns their blocks.
+	/// Returns false if the graph has no output or a cycle.
+	bool compile();
+
+	/// Renders frames frames of the output, compiling the graph if it has
+	/// changed. Renders silence if the graph doesn't compile.
+	void render(float* out, size_t frames);
+
+	size_t nodeCount() const { return _nodes.size(); }
+
+	/// Returns the number of levels scheduled by compile()
+	size_t levelCount() const { return _levels.size(); }
+
+	/// Returns the number of blocks in the arena after compile()
+	size_t bufferCount() const { return _buffers; }
+
+private:
+	struct Node {
+		AudioModule* module;
+		Processor processor;
+		std::vector<NodeId> inputs;
+
+		// assigned by compile(): arena block and its input blocks
+		float* buffer;
+		std::vector<const float*> inputBuffers;
+	};
+
+	/// Renders a block of at most _blockFrames frames of a node
+	void renderNode(Node& node, size_t frames);
+
+	const double _sampleRate;
+	const size_t _blockFrames;
+	std::vector<Node> _nodes;
+	NodeId _output;
+	ThreadPool* _pool;
+
+	// schedule built by compile(): node ids by level
+	bool _compiled;
+	std::vector<std::vector<NodeId>> _levels;
+	size_t _buffers;
+	std::vector<float> _arena;
+
+	// level rendered in parallel and its frame count
+	const std::vector<NodeId>* _level;
+	size_t _levelFrames;
+};
+
+} // namespace mk
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "PCM.h"
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mk {
+
+/// Base class of audio file writers. Samples are staged in memory,
+/// encoded in blocks and appended to the file with large writes.
+/// Subclasses write the file header and encode samples in their own format.
+///
+/// Writers either own a file, whose header is completed when the writer is
+/// destroyed, or stream to a non-seekable output such as a pipe or stdout.
+/// Streams must declare their frame count up front so the header is final
+/// when it's written: missing frames are filled with silence and frames
+/// beyond the declared count are dropped.
+class PcmWriter
+{
+public:
+	virtual ~PcmWriter();
+
+	BitDepth bitDepth() const { return _bitDepth; }
+
+	uint16_t channels() const { return _channels; }
+
+	double sampleRate() const { return _sampleRate; }
+
+	/// Returns the number of complete sample frames written so far
+	uint64_t frames() const { return _samples / _channels; }
+
+	/// Returns true when writing to a stream that is never rewound
+	bool streaming() const { return _streaming; }
+
+	/// Appends a block of interleaved sample frames
+	void write(const float* frames, size_t frameCount);
+
+	/// Appends a block of interleaved sample frames
+	void write(const double* frames, size_t frameCount);
+
+	/// Appends a single sample
+	PcmWriter& operator<<(double sample);
+
+	/// Writes all staged samples to the file
+	void flush();
+
+	/// Moves file writes to a background thread, so that producing samples and
+	/// disk I/O overlap. Encoded blocks come from a pool preallocated here and
+	/// at most queueDepth of them wait to be written; when the queue is full
+	/// the producer blocks. flush() and the destructor wait for pending blocks.
+	void enableAsync(size_t queueDepth = 4);
+
+protected:
+	PcmWriter(const std::string& filePath, BitDepth bitDepth, uint16_t channels, double sampleRate);
+
+	PcmWriter(std::ostream& out, BitDepth bitDepth, uint16_t channels, double sampleRate, uint64_t frames);
+
+	/// Encodes samples in the file's sample format
+	virtual void encode(const float* samples, size_t count, uint8_t* out) const = 0;
+
+	/// Encodes samples in the file's sample format
+	virtual void encode(const double* samples, size_t count, uint8_t* out) const = 0;
+
+	/// Completes the final sample frame with silence, or all declared frames when
+	/// streaming, and writes all staged samples. Subclasses call it before
+	/// completing their header.
+	void finish();
+
+	/// Returns true if the output was opened successfully
+	bool isOpen() const { return _streaming || _file.is_open(); }
+
+	/// Returns the number of frames the output will hold: the declared frame
+	/// count when streaming, or the frames written so far otherwise
+	uint64_t totalFrames() const { return _streaming ? _streamFrames : frames(); }
+
+	/// Returns the number of bytes of encoded sample data written so far
+	uint64_t dataSize() const { return _samples * (bitsPerSample(_bitDepth) / 8); }
+
+private:
+	std::ofstream _file;
+
+protected:
+	std::ostream& _f;
+
+	const BitDepth _bitDepth;
+	const uint16_t _channels;
+	const double _sampleRate;
+	uint64_t _samples;
+
+private:
+	const bool _streaming;
+	const uint64_t _streamFrames;
+
+	struct AsyncWriter;
+
+	template<class T> void writeSamples(const T* samples, size_t count);
+
+	/// Returns false once writing to the file has failed
+	bool good() const;
+
+	// encoded samples waiting to be written to the file
+	std::vector<uint8_t> _buffer;
+	size_t _buffered;
+
+	std::unique_ptr<AsyncWriter> _async;
+};
+
+} // namespace mk
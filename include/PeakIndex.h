@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mk {
+
+/// Returns the index of the first of count samples of largest magnitude, 0 if
+/// all are silent. Vectorized: the largest magnitude of each chunk of samples
+/// is found first, then the first sample reaching it, only in chunks with a
+/// new peak. NaNs are ignored.
+size_t findPeak(const float* samples, size_t count);
+
+/// Summary of the samples of a channel over a range of frames
+struct PeakBlock {
+	float min;
+	float max;
+	float rms;
+};
+
+/// Identifies the contents of a file without reading all of it: its size,
+/// its modification and status change times in nanoseconds, and a hash of its
+/// first and last HASHED_BYTES bytes. The status change time catches copies
+/// that preserve the modification time (cp -p, rsync -t), since it can't be
+/// set back.
+struct FileKey {
+	static constexpr size_t HASHED_BYTES = 64 * 1024;
+
+	FileKey();
+
+	/// Reads the key of a file, returns false if it can't be read
+	bool read(const std::string& filePath);
+
+	bool operator==(const FileKey& other) const;
+	bool operator!=(const FileKey& other) const { return !(*this == other); }
+
+	uint64_t size;
+	int64_t mtime;
+	int64_t ctime;
+	uint64_t hash;
+};
+
+/// Multi-resolution overview of an audio file: the min, max and RMS of each
+/// channel per block of frames, at zoom levels of BLOCK_FRAMES frames per
+/// block and FAN_OUT times more at each level up, plus the location of the
+/// file's peak sample.
+///
+/// An index is built from the frames of a file, in one pass, and saved to a
+/// sidecar file with the key of the audio file. Loading it back fails if the
+/// audio file has changed, so peaks and overviews of unchanged files are read
+/// without decoding samples (see scanMax() and waveformOverview() in Util.h).
+/// Changes go undetected only if they keep the size of the file and its
+/// hashed head and tail, and happen within the same tick of the file
+/// system's timestamps as the previous write: on file systems with coarse
+/// timestamps (1 s on HFS+ or ext3, 2 s on FAT), an index built right after
+/// a write may survive a same-size edit to the middle of the file made in the
+/// same second.
+class PeakIndex
+{
+public:
+	/// Frames per block of the first level
+	static constexpr uint32_t BLOCK_FRAMES = 256;
+
+	/// Blocks of a level summarized by each block of the next one
+	static constexpr uint32_t FAN_OUT = 16;
+
+	PeakIndex();
+
+	/// Returns the path of the sidecar index of an audio file
+	static std::string sidecarPath(const std::string& audioFilePath);
+
+	/// Starts building the index of frames of channels samples
+	void reset(uint16_t channels);
+
+	/// Adds interleaved frames following those already added
+	void add(const float* samples, size_t frames);
+
+	/// Adds the frames summarized by a finished index of the frames following
+	/// those added so far, which must fill whole blocks. Indexes of
+	/// consecutive ranges of a file, built in parallel, are combined this way
+	/// in order, into the index of the whole file.
+	void add(const PeakIndex& next);
+
+	/// Summarizes the frames added so far into all levels
+	void finish();
+
+	/// Returns true once finished or loaded
+	bool valid() const { return !_levels.empty(); }
+
+	uint16_t channels() const { return _channels; }
+
+	uint64_t frames() const { return _frames; }
+
+	/// Location and value of the first sample of largest magnitude, like scanMax()
+	uint64_t peakFrame() const { return _peakFrame; }
+	uint16_t peakChannel() const { return _peakChannel; }
+	float peakAmplitude() const { return _peakAmplitude; }
+
+	size_t levels() const { return _levels.size(); }
+
+	uint64_t blockFrames(size_t level) const;
+
+	size_t blocks(size_t level) const { return _levels[level].size() / _channels; }
+
+	const PeakBlock& block(size_t level, size_t index, uint16_t channel) const {
+		return _levels[level][index * _channels + channel];
+	}
+
+	/// Summarizes frames [first;first + frames) of a channel in width blocks,
+	/// from the coarsest level with at least width blocks in the range. Each
+	/// block covers the blocks of the level overlapping its range.
+	std::vector<PeakBlock> overview(uint16_t channel, uint64_t first, uint64_t frames, size_t width) const;
+
+	/// Saves the index of the file with a key. Returns false on failure.
+	bool save(const std::string& indexFilePath, const FileKey& key) const;
+
+	/// Loads an index saved with the same key. Returns false, leaving the index
+	/// invalid, if there's none or if it's stale or corrupt.
+	bool load(const std::string& indexFilePath, const FileKey& key);
+
+private:
+	/// Closes the block being built at the first level
+	void closeBlock();
+
+	uint16_t _channels;
+	uint64_t _frames;
+	uint64_t _peakFrame;
+	uint16_t _peakChannel;
+	float _peakAmplitude;
+
+	// blocks of each level, interleaved by channel
+	std::vector<std::vector<PeakBlock>> _levels;
+
+	// first level, being built: blocks, and the block in progress with the
+	// sums of squares of its channels
+	std::vector<PeakBlock> _blocks;
+	std::vector<PeakBlock> _current;
+	std::vector<double> _squares;
+	uint32_t _currentFrames;
+};
+
+} // namespace mk
@@ -0,0 +1,198 @@
+#pragma once
+
+#include "Automation.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace mk {
+
+class PeakIndex;
+
+/// Processing step of a Pipeline, transforming blocks of interleaved frames
+/// in place
+struct Stage {
+	virtual ~Stage() {}
+
+	/// Prepares the stage for a new stream of frames of channels samples at a
+	/// sample rate. Returns false, after printing why, if the stage can't
+	/// process it.
+	virtual bool prepare(uint16_t channels, uint32_t sampleRate);
+
+	/// Restarts the stream at its first frame, before each pass over the
+	/// input, keeping what analyze() found
+	virtual void rewind() {}
+
+	/// Returns true if the stage must see its whole input, through analyze(),
+	/// before processing it
+	virtual bool analyzes() const { return false; }
+
+	/// Receives the input of the stage, block by block, before the first call
+	/// to process()
+	virtual void analyze(const float* samples, size_t frames, uint16_t channels);
+
+	/// Takes the analysis of its input from the peak index of the input file,
+	/// when the stage is the first one, instead of analyze(). Returns false if
+	/// the index doesn't hold what the stage needs.
+	virtual bool analyze(const PeakIndex& index);
+
+	virtual void process(float* samples, size_t frames, uint16_t channels) = 0;
+};
+
+/// Multiplies samples by a gain in dB
+struct GainStage : public Stage {
+	GainStage(double gain);
+
+	void process(float* samples, size_t frames, uint16_t channels) override;
+
+	double _ratio;
+};
+
+/// Limits samples to a range, [-1;1] by default, so they don't overflow
+/// the dynamic range of the output
+struct ClampStage : public Stage {
+	ClampStage(double min = -1.0, double max = 1.0);
+
+	void process(float* samples, size_t frames, uint16_t channels) override;
+
+	double _min;
+	double _max;
+};
+
+struct InvertStage : public Stage {
+	void process(float* samples, size_t frames, uint16_t channels) override;
+};
+
+/// Pans stereo frames with constant power, from -1 (left) to 1 (right)
+struct PanStage : public Stage {
+	PanStage(double position);
+
+	bool prepare(uint16_t channels, uint32_t sampleRate) override;
+
+	void process(float* samples, size_t frames, uint16_t channels) override;
+
+	double _left;
+	double _right;
+};
+
+/// Piece of an automation over which its value is linear: frames frames,
+/// starting offset frames into a ramp of length frames from one value to
+/// another. Values are held by ramps from a value to itself.
+struct Ramp {
+	size_t frames;
+	double offset;
+	double length;
+	double from;
+	double to;
+};
+
+/// Stage following an automation, frame by frame. The ramps of each block are
+/// computed incrementally from their first frame, evaluated exactly, so
+/// rounding errors don't build up over blocks.
+struct AutomationStage : public Stage {
+	AutomationStage(const Automation& automation);
+
+	bool prepare(uint16_t channels, uint32_t sampleRate) override;
+
+	void rewind() override;
+
+	/// Returns the ramp of the next frames, up to frames of them
+	Ramp nextRamp(size_t frames);
+
+	Automation _automation;
+
+	// frame positions of the breakpoints at the sample rate of the stream
+	std::vector<double> _positions;
+
+	// next frame, and the breakpoint before it
+	uint64_t _frame;
+	size_t _breakpoint;
+};
+
+/// Multiplies samples by a gain automation in dB. Ramps between gains are
+/// multiplicative recurrences, so they're linear in dB, except ramps from or
+/// to silence (-inf dB), linear recurrences of amplitudes.
+struct GainAutomationStage : public AutomationStage {
+	GainAutomationStage(const Automation& gain);
+
+	/// Fails for gains that aren't finite, except -inf dB
+	bool prepare(uint16_t channels, uint32_t sampleRate) override;
+
+	void process(float* samples, size_t frames, uint16_t channels) override;
+};
+
+/// Pans stereo frames with constant power, following an automation of
+/// positions from -1 (left) to 1 (right). Ramps between positions rotate the
+/// gains of both channels by a constant angle per frame.
+struct PanAutomationStage : public AutomationStage {
+	PanAutomationStage(const Automation& positions);
+
+	bool prepare(uint16_t channels, uint32_t sampleRate) override;
+
+	void process(float* samples, size_t frames, uint16_t channels) override;
+};
+
+/// Scales samples so that the peak of the input reaches a loudness in dB
+struct NormalizeStage : public Stage {
+	NormalizeStage(double peakLoudness = 0.0);
+
+	bool prepare(uint16_t channels, uint32_t sampleRate) override;
+
+	bool analyzes() const override { return true; }
+
+	void analyze(const float* samples, size_t frames, uint16_t channels) override;
+
+	bool analyze(const PeakIndex& index) override;
+
+	void process(float* samples, size_t frames, uint16_t channels) override;
+
+	double _peakLoudness;
+
+	// largest absolute sample of the input
+	float _max;
+};
+
+/// Chain of stages processing blocks of frames one after the other, so a
+/// file goes through all of them in a single read and write (see
+/// mk::process() in Util.h).
+///
+///     Pipeline pipeline;
+///     pipeline.gain(-3.0).pan(0.2).invert();
+class Pipeline
+{
+public:
+	Pipeline& add(std::unique_ptr<Stage> stage);
+
+	Pipeline& gain(double gain) { return add(std::unique_ptr<Stage>(new GainStage(gain))); }
+
+	Pipeline& clamp(double min = -1.0, double max = 1.0) { return add(std::unique_ptr<Stage>(new ClampStage(min, max))); }
+
+	Pipeline& invert() { return add(std::unique_ptr<Stage>(new InvertStage())); }
+
+	Pipeline& gain(const Automation& gain) { return add(std::unique_ptr<Stage>(new GainAutomationStage(gain))); }
+
+	Pipeline& pan(double position) { return add(std::unique_ptr<Stage>(new PanStage(position))); }
+
+	Pipeline& pan(const Automation& positions) { return add(std::unique_ptr<Stage>(new PanAutomationStage(positions))); }
+
+	Pipeline& normalize(double peakLoudness = 0.0) { return add(std::unique_ptr<Stage>(new NormalizeStage(peakLoudness))); }
+
+	size_t size() const { return _stages.size(); }
+
+	Stage& stage(size_t index) { return *_stages[index]; }
+
+	/// Prepares all stages for a new stream, see Stage::prepare()
+	bool prepare(uint16_t channels, uint32_t sampleRate);
+
+	/// Rewinds all stages, see Stage::rewind()
+	void rewind();
+
+	/// Runs the stages in [first;last) on a block of interleaved frames
+	void process(float* samples, size_t frames, uint16_t channels, size_t first = 0, size_t last = SIZE_MAX);
+
+private:
+	std::vector<std::unique_ptr<Stage>> _stages;
+};
+
+} // namespace mk
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "SpscQueue.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace mk {
+
+/// Timing of the blocks rendered by a RenderEngine. Latency is measured from
+/// the time a block is due to start, by the device clock, to the time it's
+/// rendered. A block misses its deadline when it's rendered later than a
+/// buffer period after it was due.
+struct RenderStats {
+	uint64_t blocks;
+	uint64_t deadlineMisses;
+	double periodSeconds;
+	double lastRenderSeconds;
+	double averageRenderSeconds;
+	double worstRenderSeconds;
+	double worstLatencySeconds;
+};
+
+/// Renders audio through a callback, a buffer at a time, as a sound card
+/// driver does.
+///
+/// Parameters of the modules rendered by the callback, such as
+/// SineWave::_frequency, are changed from another thread with set(). Changes
+/// go through a lock-free queue and are written to the parameters right
+/// before the next block renders, so the render thread never waits and never
+/// sees a parameter change mid-block.
+///
+/// The device is simulated by a clock ticking every buffer period, so the
+/// engine runs headless: run() renders on the calling thread, start() on a
+/// device thread until stop(). Each block's render time and latency are
+/// measured against its deadline.
+class RenderEngine
+{
+public:
+	/// Renders frames samples into out
+	typedef std::function<void(float* out, size_t frames)> Callback;
+
+	/// Receives each rendered block, e.g. to write it to a file
+	typedef std::function<void(const float* samples, size_t frames)> Sink;
+
+	/// Creates an engine rendering buffers of bufferFrames frames at sampleRate,
+	/// queueing up to queueCapacity parameter changes between blocks
+	RenderEngine(size_t bufferFrames, double sampleRate, size_t queueCapacity = 1024);
+
+	/// Stops the device thread
+	~RenderEngine();
+
+	size_t bufferFrames() const { return _buffer.size(); }
+
+	double sampleRate() const { return _sampleRate; }
+
+	/// Sets the callback rendering each block. Not while the engine runs.
+	void setCallback(const Callback& callback) { _callback = callback; }
+
+	/// Sets the receiver of rendered blocks. Not while the engine runs.
+	void setSink(const Sink& sink) { _sink = sink; }
+
+	/// Queues *parameter = value for the start of the next block. Called by one
+	/// control thread at a time. Returns false, dropping the change, if the
+	/// queue is full.
+	bool set(double* parameter, double value);
+
+	/// Records the render times of the next blocks, up to blocks of them
+	void enableBlockLog(size_t blocks);
+
+	/// Returns the render time in seconds of each block logged so far
+	const std::vector<float>& blockLog() const { return _blockLog; }
+
+	/// Renders blocks on the calling thread. When paced, waits for the device
+	/// clock before each block, otherwise renders them back to back as if each
+	/// was due when the previous one was done.
+	void run(uint64_t blocks, bool paced = true);
+
+	/// Renders paced blocks on a device thread until stop()
+	void start();
+
+	/// Stops the device thread after its current block
+	void stop();
+
+	bool running() const { return _thread.joinable(); }
+
+	/// Returns the timing of all blocks rendered so far. Safe while running.
+	RenderStats stats() const;
+
+	/// Clears the timing statistics and the block log. Not while the engine runs.
+	void resetStats();
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct ParameterChange {
+		double* parameter;
+		double value;
+	};
+
+	/// Renders blocks until count are done or the engine stops
+	void renderBlocks(uint64_t count, bool paced);
+
+	/// Applies pending changes, renders the block due at a time and measures it
+	void renderBlock(Clock::time_point due);
+
+	const double _sampleRate;
+	const Clock::duration _period;
+	std::vector<float> _buffer;
+	Callback _callback;
+	Sink _sink;
+	SpscQueue<ParameterChange> _changes;
+
+	std::thread _thread;
+	std::atomic<bool> _stopping;
+
+	// statistics, written by the render thread only
+	std::atomic<uint64_t> _blocks;
+	std::atomic<uint64_t> _deadlineMisses;
+	std::atomic<double> _lastRenderSeconds;
+	std::atomic<double> _totalRenderSeconds;
+	std::atomic<double> _worstRenderSeconds;
+	std::atomic<double> _worstLatencySeconds;
+
+	// preallocated log of render times
+	std::vector<float> _blockLog;
+	size_t _blockLogCapacity;
+};
+
+} // namespace mk
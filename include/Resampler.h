@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mk {
+
+/// Trade-off between the speed of a Resampler, the part of the band it keeps
+/// and how much it attenuates aliases. Filters get longer as quality goes up.
+enum class ResamplerQuality {
+	Fast,   // 85% of the band, 60 dB
+	Medium, // 90% of the band, 90 dB
+	Best    // 95% of the band, 120 dB
+};
+
+/// Streaming sample rate converter for interleaved frames.
+///
+/// The conversion ratio is reduced to up/down factors L/M and samples are
+/// interpolated with a bank of L windowed-sinc filters (one per fractional
+/// position, or "phase"), precomputed once, whose cutoff also removes what
+/// would alias when the rate goes down. Each output sample is the inner
+/// product of one filter with the recent input of its channel, computed with
+/// SIMD. Ratios whose L exceeds MAX_PHASES interpolate between the filters of
+/// a bank of MAX_PHASES phases instead.
+///
+/// Output sample n is input time n * M / L, so converted signals stay aligned
+/// with the original: the filter delay is compensated.
+class Resampler
+{
+public:
+	/// Largest filter bank, in phases
+	static constexpr uint32_t MAX_PHASES = 1024;
+
+	Resampler(uint32_t inputRate, uint32_t outputRate, uint16_t channels,
+			  ResamplerQuality quality = ResamplerQuality::Medium);
+
+	uint32_t inputRate() const { return _inputRate; }
+
+	uint32_t outputRate() const { return _outputRate; }
+
+	uint16_t channels() const { return _channels; }
+
+	/// Returns the number of filter taps, that is input frames per output sample
+	size_t taps() const { return _taps; }
+
+	/// Returns the most frames that process() or flush() may output for a
+	/// block of inputFrames frames
+	size_t maxOutputFrames(size_t inputFrames) const;
+
+	/// Converts a block of interleaved input frames and writes the frames
+	/// that are ready to out, which holds maxOutputFrames(inputFrames) frames.
+	/// Returns the number of frames written. Allocates only when a block is
+	/// larger than all previous ones.
+	size_t process(const float* in, size_t inputFrames, float* out);
+
+	/// Writes the last frames, up to the end of the input, after the last
+	/// call to process(). out holds maxOutputFrames(taps()) frames.
+	size_t flush(float* out);
+
+	/// Returns the number of output frames for inputFrames input frames
+	uint64_t outputFrames(uint64_t inputFrames) const;
+
+	/// Forgets all input, to convert a new stream
+	void reset();
+
+private:
+	/// Writes output frames while the history holds enough input, up to
+	/// limit frames in total since the reset
+	size_t produce(float* out, uint64_t limit);
+
+	/// Appends planar frames to the history of each channel
+	void append(const float* in, size_t frames, bool silence);
+
+	const uint32_t _inputRate;
+	const uint32_t _outputRate;
+	const uint16_t _channels;
+
+	// output time advances by _down / _up input frames per output frame
+	uint64_t _up;
+	uint64_t _down;
+	size_t _step;
+	uint64_t _remainder;
+
+	// filter bank: _phases + 1 rows of _stride floats, the last row being
+	// the first one shifted by a frame, so adjacent phases always exist
+	uint32_t _phases;
+	size_t _taps;
+	size_t _stride;
+	std::vector<float> _bank;
+
+	// recent input of each channel, planar, starting with the oldest frame
+	// the next output reads
+	std::vector<float> _history;
+	size_t _historyCapacity;
+	size_t _historyFrames;
+
+	// position of the next output frame: history frame and phase in [0;_up)
+	size_t _index;
+	uint64_t _phase;
+
+	uint64_t _inputFrames;
+	uint64_t _outputFrames;
+};
+
+} // namespace mk
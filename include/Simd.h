@@ -0,0 +1,28 @@
+#pragma once
+
+// Instruction sets available to the vectorized kernels, selected at compile time.
+// Every kernel has a scalar fallback; define MK_DISABLE_SIMD to force it.
+
+#if !defined(MK_DISABLE_SIMD)
+
+#if defined(__AVX2__)
+#define MK_AVX2 1
+#endif
+
+#if defined(__SSSE3__) || defined(MK_AVX2)
+#define MK_SSSE3 1
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MK_SSE2 1
+#endif
+
+#endif // MK_DISABLE_SIMD
+
+#if defined(MK_AVX2)
+#include <immintrin.h>
+#elif defined(MK_SSSE3)
+#include <tmmintrin.h>
+#elif defined(MK_SSE2)
+#include <emmintrin.h>
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+
+// Precision of the sine and cosine kernels in bits, selected at compile time:
+// 16 uses shorter polynomials, 24 (the default) is accurate to single precision.
+#if !defined(MK_SINCOS_PRECISION)
+#define MK_SINCOS_PRECISION 24
+#endif
+
+#if MK_SINCOS_PRECISION != 16 && MK_SINCOS_PRECISION != 24
+#error "MK_SINCOS_PRECISION must be 16 or 24"
+#endif
+
+namespace mk {
+
+/// Maximum absolute error of the sine and cosine kernels compared to std::sin
+/// and std::cos: below the LSB of 16-bit samples (2^-15) or 24-bit samples (2^-23)
+constexpr double SINCOS_MAX_ERROR = MK_SINCOS_PRECISION == 16 ? 1.0 / 32768.0 : 1.0 / 8388608.0;
+
+/// Computes sin(2π x) for phases x given in cycles, |x| < 2^20
+void sinCycles(const float* phases, size_t count, float* out);
+
+/// Computes sin(2π x) and cos(2π x) for phases x given in cycles, |x| < 2^20
+void sinCosCycles(const float* phases, size_t count, float* sines, float* cosines);
+
+/// Computes sin(2π (start + i * increment)) for i in [0;count), as oscillators do.
+/// Phases are computed and reduced in double precision so that they don't
+/// add to the kernel's error, provided that they remain below 2^20 cycles.
+void sinCyclesRamp(double start, double increment, size_t count, float* out);
+
+} // namespace mk
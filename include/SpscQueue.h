@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace mk {
+
+/// Bounded lock-free queue between one producer thread and one consumer
+/// thread. Neither side blocks or allocates: push() fails when the queue is
+/// full and pop() when it's empty. Each index is written by one side only.
+template<typename T>
+class SpscQueue
+{
+public:
+	/// Creates a queue holding up to capacity items, rounded up to a power of 2
+	explicit SpscQueue(size_t capacity)
+		: _items(roundUpToPowerOf2(capacity))
+		, _mask(_items.size() - 1)
+		, _head(0)
+		, _tail(0)
+	{
+	}
+
+	size_t capacity() const { return _items.size(); }
+
+	/// Called by the producer. Returns false if the queue is full.
+	bool push(const T& item) {
+		const size_t tail = _tail.load(std::memory_order_relaxed);
+		if (tail - _head.load(std::memory_order_acquire) == _items.size())
+			return false;
+
+		_items[tail & _mask] = item;
+		_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/// Called by the consumer. Returns false if the queue is empty.
+	bool pop(T& item) {
+		const size_t head = _head.load(std::memory_order_relaxed);
+		if (head == _tail.load(std::memory_order_acquire))
+			return false;
+
+		item = _items[head & _mask];
+		_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	static size_t roundUpToPowerOf2(size_t n) {
+		size_t p = 1;
+		while (p < n) {
+			p <<= 1;
+		}
+		return p;
+	}
+
+	static constexpr size_t CACHE_LINE_BYTES = 64;
+
+	std::vector<T> _items;
+	const size_t _mask;
+
+	// read position, written by the consumer, and write position, written by
+	// the producer, on separate cache lines so the threads don't contend. They
+	// are padded a cache line apart from each other and from the members
+	// around them rather than aligned: before C++17, new doesn't align objects
+	// beyond alignof(std::max_align_t), so a queue on the heap wouldn't get
+	// aligned members.
+	char _padding0[CACHE_LINE_BYTES];
+	std::atomic<size_t> _head;
+	char _padding1[CACHE_LINE_BYTES - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> _tail;
+	char _padding2[CACHE_LINE_BYTES - sizeof(std::atomic<size_t>)];
+};
+
+} // namespace mk
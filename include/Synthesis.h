@@ -1,7 +1,10 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <iosfwd>
+#include <iterator>
+#include <vector>
 
 namespace mk {
 
@@ -12,48 +15,248 @@ constexpr double SAMPLE_RATE_96K = 96000.0;
 constexpr double SAMPLE_RATE_192K = 192000.0;
 
 struct AudioModule {
+	virtual ~AudioModule() {}
+
 	virtual double operator()(double time) const = 0;
+
+	/// Renders the next frames samples at the given sample rate and advances
+	/// the module's internal position, so that consecutive calls render a
+	/// continuous signal. Parameters changed between calls take effect at the
+	/// start of the next block. By default, samples operator() at times
+	/// derived from the number of frames rendered so far.
+	virtual void render(float* out, size_t frames, double sampleRate);
+
+	/// Restarts rendering from time 0
+	virtual void reset();
+
+	// number of frames rendered since the last reset
+	uint64_t _renderedFrames = 0;
 };
 
+/// Renders blocks with the vectorized sine kernel (see SinCos.h), reading
+/// phases from a phase accumulator that is exact over long renders
 struct SineWave : public AudioModule {
 	SineWave(double frequency);
 
 	double operator()(double time) const override;
 
+	void render(float* out, size_t frames, double sampleRate) override;
+
+	void reset() override;
+
 	double _frequency;
+
+	// position in the current cycle, in [0;1)
+	double _cycle;
 };
 
+/// Renders blocks with a phase accumulator
 struct SawWave : public AudioModule {
 	SawWave(double frequency);
 
 	double operator()(double time) const override;
 
+	void render(float* out, size_t frames, double sampleRate) override;
+
+	void reset() override;
+
 	double _frequency;
 	double _amplitude;
 	double _offset;
 	double _phase;
 	double _polarity;
+
+	// position in the current cycle, in [0;1)
+	double _cycle;
+};
+
+/// Level reached at the end of an envelope segment lasting duration seconds
+struct Breakpoint {
+	double level;
+	double duration;
+};
+
+/// Envelope made of exponential segments between breakpoints.
+///
+/// Segments follow the curves of exponentialEnvelope() and are rendered with
+/// its multiplicative recurrence, one multiply per sample. Segments start and
+/// end on exact sample frames, and land exactly on their breakpoint level.
+/// With a sustain breakpoint, the level holds there until release(), then
+/// continues with the following segments. Events take effect at the start of
+/// the next block, so splitting blocks at event frames makes them
+/// sample-accurate.
+class Envelope : public AudioModule {
+public:
+	static constexpr size_t NO_SUSTAIN = SIZE_MAX;
+
+	Envelope(double startLevel, const std::vector<Breakpoint>& breakpoints, size_t sustain = NO_SUSTAIN);
+
+	/// Returns the level at a time since the start, holding at the sustain
+	/// breakpoint as if never released
+	double operator()(double time) const override;
+
+	void render(float* out, size_t frames, double sampleRate) override;
+
+	/// Multiplies samples by the envelope and advances it like render(),
+	/// e.g. to shape a block rendered by an oscillator
+	void apply(float* samples, size_t frames, double sampleRate);
+
+	/// Restarts from the start level
+	void reset() override;
+
+	/// Restarts the first segment from the current level, so that
+	/// retriggering a sounding envelope doesn't click
+	void trigger();
+
+	/// Continues with the segment after the sustain breakpoint, from the
+	/// current level. Does nothing without a sustain breakpoint.
+	void release();
+
+	/// Returns true once the last breakpoint is reached
+	bool finished() const;
+
+	/// Returns the level of the next sample
+	double level() const;
+
+private:
+	// exponential curve rendered as _offset + _level with _level *= _k
+	struct Ramp {
+		void start(double from, double to, uint64_t frames);
+
+		double _offset;
+		double _level;
+		double _k;
+		uint64_t _remaining;
+	};
+
+	template<bool Apply>
+	void process(float* samples, size_t frames, double sampleRate);
+
+	/// Restarts segment from a level on the next block
+	void restart(size_t segment, double from);
+
+	const double _startLevel;
+	const std::vector<Breakpoint> _breakpoints;
+	const size_t _sustain;
+
+	// index of the breakpoint the current segment ramps to
+	size_t _segment;
+	// level the current segment starts from, once started on the next block
+	double _from;
+	bool _pending;
+	bool _released;
+	Ramp _ramp;
 };
 
-struct ADEnvelope : public AudioModule {
+/// Attack-decay envelope: startLevel to peakLevel, then to endLevel
+struct ADEnvelope : public Envelope {
 	ADEnvelope(double startLevel, double peakLevel, double endLevel,
 			   double attackDuration, double decayDuration);
+};
 
-	double operator()(double time) const override;
+/// Attack-decay-sustain-release envelope from and back to silence,
+/// sustaining until released
+struct ADSREnvelope : public Envelope {
+	ADSREnvelope(double attackDuration, double decayDuration, double sustainLevel,
+				 double releaseDuration, double peakLevel = 1.0);
+};
 
-	double _startLevel;
-	double _peakLevel;
-	double _endLevel;
-	double _attackDuration;
-	double _decayDuration;
+/// Point of an envelope: a time in seconds and a level
+struct EnvelopePoint {
+	double time;
+	double level;
+};
+
+/// Points of a general exponential envelope, computed lazily with a
+/// multiplicative recurrence while the range is iterated. See
+/// exponentialEnvelope().
+class ExponentialEnvelope {
+public:
+	class iterator {
+	public:
+		typedef std::input_iterator_tag iterator_category;
+		typedef EnvelopePoint value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const EnvelopePoint* pointer;
+		typedef EnvelopePoint reference;
+
+		EnvelopePoint operator*() const { return {_envelope->_startTime + _index * _envelope->_dt, _level + _envelope->_offset}; }
+
+		iterator& operator++() {
+			++_index;
+			_level *= _envelope->_k;
+			return *this;
+		}
+
+		iterator operator++(int) {
+			iterator i = *this;
+			++*this;
+			return i;
+		}
+
+		bool operator==(const iterator& other) const { return _index == other._index; }
+		bool operator!=(const iterator& other) const { return _index != other._index; }
+
+	private:
+		friend class ExponentialEnvelope;
+
+		iterator(const ExponentialEnvelope* envelope, size_t index, double level)
+			: _envelope(envelope), _index(index), _level(level) {}
+
+		const ExponentialEnvelope* _envelope;
+		size_t _index;
+		double _level;
+	};
+
+	ExponentialEnvelope(double startTime, double endTime, double startLevel, double endLevel, double sampleRate);
+
+	iterator begin() const { return iterator(this, 0, _level); }
+	iterator end() const { return iterator(this, _size, 0.0); }
+
+	/// Returns the number of points, or 0 if the parameters are invalid
+	size_t size() const { return _size; }
+
+	/// Writes the levels of the first count points to out, at one multiply per
+	/// sample. Returns the number of levels written.
+	size_t fill(float* out, size_t count) const;
+
+private:
+	double _startTime;
+	double _dt;
+	double _level;
+	double _k;
+	double _offset;
+	size_t _size;
 };
 
 // TODO: move to Util.h
-/// Prints out a general exponential envelope for the given time range
-/// where values increase or decrease from startLevel to endLevel.
+/// Returns the points of a general exponential envelope for the given time
+/// range, sampled at sampleRate, where values increase or decrease from
+/// startLevel to endLevel.
 /// If startLevel < endLevel => attack envelope
 /// If startLevel > endLevel => decay envelope
 /// If startLevel == endLevel => constant envelope (i.e. no change)
+/// The range covers both ends of the time range. It's empty if the time range
+/// is empty or longer than an hour, or if sampleRate isn't positive.
+ExponentialEnvelope exponentialEnvelope(double startTime,
+										double endTime,
+										double startLevel,
+										double endLevel,
+										double sampleRate);
+
+/// Writes the levels of exponentialEnvelope() to out, up to count levels.
+/// Returns the number of levels written.
+size_t exponentialEnvelope(float* out,
+						   size_t count,
+						   double startTime,
+						   double endTime,
+						   double startLevel,
+						   double endLevel,
+						   double sampleRate);
+
+/// Prints out the points of exponentialEnvelope() as lines of tab-separated
+/// time and level, using the stream's precision. Lines are formatted into
+/// large blocks before they're written, and the stream isn't flushed.
 void exponentialEnvelope(std::ostream& out,
 						 double startTime,
 						 double endTime,
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mk {
+
+/// Fixed set of worker threads running parallel loops.
+///
+/// run() hands out the indices of a loop to the workers and the calling
+/// thread, so a pool of one thread runs everything on the caller. Workers
+/// sleep between loops. One thread at a time may call run().
+class ThreadPool
+{
+public:
+	/// Starts threads - 1 workers, the caller being the last thread
+	explicit ThreadPool(size_t threads = std::thread::hardware_concurrency());
+
+	/// Waits for the current loop and stops the workers
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/// Returns the number of threads running loops, including the caller
+	size_t size() const { return _workers.size() + 1; }
+
+	/// Runs task(i) for each i in [0;count) and returns once all have returned
+	void run(size_t count, const std::function<void(size_t)>& task);
+
+private:
+	/// Runs loop indices until none are left
+	void runTasks();
+
+	/// Worker thread body
+	void work();
+
+	std::vector<std::thread> _workers;
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	std::condition_variable _done;
+
+	// current loop, published under the mutex with a new generation
+	const std::function<void(size_t)>* _task;
+	size_t _count;
+	std::atomic<size_t> _next;
+	uint64_t _generation;
+
+	// workers that haven't finished the current loop yet
+	size_t _busy;
+	bool _stop;
+};
+
+} // namespace mk
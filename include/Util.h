@@ -1,10 +1,16 @@
 #pragma once
 
+#include "PeakIndex.h"
+#include "Pipeline.h"
+#include "Resampler.h"
 #include <algorithm>
 #include <string>
+#include <vector>
 
 namespace mk {
 
+class ThreadPool;
+
 struct SampleInfo {
 	SampleInfo();
 
@@ -24,19 +30,89 @@ double loudnessToAmplitude(double loudness);
 bool audioToText(const std::string& audioFilePath,
 				 const std::string& textFilePath);
 
-bool scanMax(const std::string& inputFilePath, SampleInfo& max);
+/// Finds the first sample of largest magnitude, from the peak index of the
+/// file (see PeakIndex.h), which is built and saved if missing or stale. With
+/// a thread pool, ranges of the file are read in parallel to build the index,
+/// with the same result.
+bool scanMax(const std::string& inputFilePath, SampleInfo& max, ThreadPool* pool = nullptr);
+
+/// Finds the first sample of largest magnitude in interleaved frames
+SampleInfo scanMax(const float* samples, size_t frames, uint16_t channels);
+
+/// Summarizes a channel of an audio file in width blocks, e.g. to draw its
+/// waveform, from the peak index of the file like scanMax()
+bool waveformOverview(const std::string& inputFilePath,
+					  uint16_t channel,
+					  size_t width,
+					  std::vector<PeakBlock>& overview,
+					  ThreadPool* pool = nullptr);
+
+/// Streams an audio file through the stages of a pipeline into another file,
+/// reading and writing each frame once. Stages that analyze their input, such
+/// as NormalizeStage, add a read-only pass of the input file each, except for
+/// a first stage reading the input's peak index, built during its pass if
+/// missing or stale, or in parallel like scanMax() with a thread pool.
+bool process(const std::string& inputFilePath,
+			 const std::string& outputFilePath,
+			 Pipeline& pipeline,
+			 ThreadPool* pool = nullptr);
 
 bool normalize(const std::string& inputFilePath,
 			   const std::string& outputFilePath,
-			   float peakLoudness = 0.0);
+			   float peakLoudness = 0.0,
+			   ThreadPool* pool = nullptr);
 
 bool amplify(const std::string& inputFilePath,
 			 const std::string& outputFilePath,
 			 float gain);
 
+/// Amplifies a file following an automation of gains in dB, see
+/// GainAutomationStage
+bool amplify(const std::string& inputFilePath,
+			 const std::string& outputFilePath,
+			 const Automation& gain);
+
 bool invertPhase(const std::string& inputFilePath,
 				 const std::string& outputFilePath);
 
+/// Converts a file to another sample rate
+bool resample(const std::string& inputFilePath,
+			  const std::string& outputFilePath,
+			  uint32_t sampleRate,
+			  ResamplerQuality quality = ResamplerQuality::Medium);
+
+/// Input file of a mix
+struct MixInput {
+	MixInput(const std::string& filePath, double gain = 0.0);
+
+	std::string filePath;
+
+	// gain in dB
+	double gain;
+
+	// output channel of each channel of the file, or empty to mix each
+	// channel into the output channel of the same index
+	std::vector<uint16_t> channelMap;
+};
+
+/// Precision of the sums of a mix. Float is faster, double adds up many
+/// inputs without accumulating rounding errors.
+enum class MixPrecision {
+	Float,
+	Double
+};
+
+/// Mixes files with their gains and channel maps. The output has the sample
+/// rate and format of the first file, files at other sample rates being
+/// resampled, and as many channels and frames as the largest of them: files
+/// that end early are followed by silence. Files are streamed a block at a
+/// time, the sums being clamped to [-1;1].
+bool mix(const std::vector<MixInput>& inputs,
+		 const std::string& outputFilePath,
+		 MixPrecision precision = MixPrecision::Float);
+
+/// Mixes two files with gains in dB, see mix() above. Sums are computed
+/// in double precision.
 bool mix(const std::string& inputFilePath1,
 		 const std::string& inputFilePath2,
 		 const std::string& outputFilePath,
@@ -47,4 +123,10 @@ bool panStereoFile(const std::string& inputFilePath,
 				   const std::string& outputFilePath,
 				   double position);
 
+/// Pans a stereo file following an automation of positions, see
+/// PanAutomationStage
+bool panStereoFile(const std::string& inputFilePath,
+				   const std::string& outputFilePath,
+				   const Automation& positions);
+
 } // namespace mk
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "Note.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mk {
+
+/// Polyphonic synthesizer playing sine voices from a fixed pool.
+///
+/// Voice state is stored as structure-of-arrays and rendered a SIMD register
+/// of voices at a time, so thousands of voices (e.g. the partials of additive
+/// synthesis) cost no virtual calls. Active voices are kept packed at the
+/// front of the arrays. Rendering never allocates.
+///
+/// Each voice has a linear envelope: it ramps up to its amplitude during the
+/// attack, holds it until released and ramps down to silence during the
+/// release, after which the voice returns to the pool. Envelope stages change
+/// on exact sample frames. Events take effect at the start of the next render().
+///
+/// When all voices are busy, starting a voice steals the quietest released
+/// voice, or the oldest voice if none is released. Stolen voices ramp from
+/// their current level to the new amplitude, over at least 5 ms even without
+/// attack, so stealing doesn't click.
+class VoiceEngine
+{
+public:
+	/// Preallocates a pool of maxVoices voices rendered at sampleRate
+	VoiceEngine(size_t maxVoices, double sampleRate);
+
+	size_t maxVoices() const { return _maxVoices; }
+
+	/// Returns the number of voices playing, including released voices
+	size_t activeVoices() const { return _active; }
+
+	double sampleRate() const { return _sampleRate; }
+
+	/// Sets attack and release durations in seconds, for voices started afterwards
+	void setEnvelope(double attack, double release);
+
+	/// Starts a voice playing a note, tagged with its key
+	void noteOn(const Note& note, float velocity = 1.0f);
+
+	/// Releases the voices playing a note
+	void noteOff(const Note& note);
+
+	/// Starts a voice at any frequency, with a tag to release it by
+	void start(double frequency, float amplitude, uint32_t tag);
+
+	/// Releases the voices with a tag that aren't released yet
+	void release(uint32_t tag);
+
+	/// Releases all voices
+	void releaseAll();
+
+	/// Renders the sum of all voices
+	void render(float* out, size_t frames);
+
+private:
+	enum Stage : uint8_t {
+		Attack,
+		Sustain,
+		Release
+	};
+
+	/// Returns the pool index of the voice to start next, stealing one if needed
+	size_t allocate();
+
+	/// Starts the release of voice i. Returns false if the voice was freed at once.
+	bool releaseVoice(size_t i);
+
+	/// Moves voices whose envelope stage ended to their next stage
+	void advanceStages(size_t frames);
+
+	/// Returns voice i to the pool, moving the last active voice in its place
+	void free(size_t i);
+
+	/// Renders frames frames of all active voices into out
+	void renderVoices(float* out, size_t frames);
+
+	const size_t _maxVoices;
+	const double _sampleRate;
+	size_t _attackFrames;
+	size_t _releaseFrames;
+
+	size_t _active;
+	uint64_t _started;
+
+	// voice state, rendered by SIMD passes: phase in [0;1) and phase increment
+	// in cycles, envelope level and its per-sample increment. Arrays are padded
+	// to a whole number of registers with silent voices.
+	std::vector<float> _phase;
+	std::vector<float> _increment;
+	std::vector<float> _level;
+	std::vector<float> _delta;
+
+	// voice state, updated between SIMD passes
+	std::vector<double> _cycle;
+	std::vector<double> _cycleIncrement;
+	std::vector<float> _amplitude;
+	std::vector<uint32_t> _remaining;
+	std::vector<Stage> _stage;
+	std::vector<uint32_t> _tag;
+	std::vector<uint64_t> _order;
+
+	// per-frame sums of each SIMD lane, reduced once per frame
+	std::vector<float> _lanes;
+};
+
+} // namespace mk
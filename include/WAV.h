@@ -0,0 +1,32 @@
+#pragma once
+
+#include "PcmWriter.h"
+#include <cstdint>
+#include <string>
+
+namespace mk {
+
+/// Writes little-endian RIFF/WAVE files. Files that grow past 4 GiB
+/// are turned into RF64 files when they're closed.
+class WAV : public PcmWriter
+{
+public:
+	WAV(const std::string& filePath, BitDepth bitDepth, uint16_t channels, double sampleRate);
+
+	/// Streams exactly frames sample frames to out, which is never rewound
+	WAV(std::ostream& out, BitDepth bitDepth, uint16_t channels, double sampleRate, uint64_t frames);
+
+	~WAV();
+
+protected:
+	void encode(const float* samples, size_t count, uint8_t* out) const override;
+
+	void encode(const double* samples, size_t count, uint8_t* out) const override;
+
+private:
+	/// Writes RIFF (or RF64), JUNK (or ds64), fmt and data chunk headers
+	/// sized for totalFrames() frames
+	void writeHeader();
+};
+
+} // namespace mk
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "Synthesis.h"
+#include <cstddef>
+#include <vector>
+
+namespace mk {
+
+enum class Waveform {
+	Sine,
+	Saw,
+	Square,
+	Triangle
+};
+
+enum class Interpolation {
+	Linear,
+	Cubic
+};
+
+/// A single-cycle waveform stored as a set of band-limited tables, one per
+/// octave of the MIDI note range (see Note). The table of an octave only
+/// contains harmonics below the Nyquist frequency for all notes of the
+/// octave, so that oscillators reading it don't alias.
+class Wavetable
+{
+public:
+	/// Number of samples in a table
+	static constexpr size_t SIZE = 2048;
+
+	/// Number of tables, covering keys 0..127 an octave at a time
+	static constexpr size_t OCTAVES = 11;
+
+	/// Builds tables of a standard waveform peaking at +/-1. Saw waves ramp
+	/// up like SawWave, square and triangle waves start with the positive half.
+	Wavetable(Waveform waveform, double sampleRate);
+
+	/// Builds tables from the amplitudes of the sine harmonics of a waveform,
+	/// starting with the fundamental
+	Wavetable(const std::vector<double>& harmonics, double sampleRate);
+
+	/// Builds tables from a single cycle of a waveform, whose harmonics
+	/// are found with a discrete Fourier transform
+	Wavetable(const float* cycle, size_t size, double sampleRate);
+
+	double sampleRate() const { return _sampleRate; }
+
+	/// Returns the index of the table to read for a given frequency
+	size_t octave(double frequency) const;
+
+	/// Returns the number of harmonics in the table of an octave
+	size_t harmonics(size_t octave) const { return _harmonics[octave]; }
+
+	/// Returns the table of an octave. Samples -1, SIZE and SIZE + 1 wrap
+	/// around so that interpolation never needs to.
+	const float* table(size_t octave) const { return &_tables[octave][1]; }
+
+private:
+	/// Builds tables from the cosine and sine amplitudes of each harmonic
+	void build(const std::vector<double>& cosines, const std::vector<double>& sines);
+
+	double _sampleRate;
+	std::vector<float> _tables[OCTAVES];
+	size_t _harmonics[OCTAVES];
+};
+
+/// Oscillator reading a wavetable with a phase accumulator
+struct WavetableOscillator : public AudioModule {
+	/// The wavetable is shared by reference and must outlive the oscillator
+	WavetableOscillator(const Wavetable& wavetable, double frequency);
+
+	double operator()(double time) const override;
+
+	/// Tables are band-limited for the wavetable's sample rate, which should match sampleRate
+	void render(float* out, size_t frames, double sampleRate) override;
+
+	void reset() override;
+
+	const Wavetable* _wavetable;
+	double _frequency;
+	double _amplitude;
+	Interpolation _interpolation;
+
+	// position in the current cycle, in [0;1)
+	double _cycle;
+};
+
+} // namespace mk
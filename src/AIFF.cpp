@@ -1,7 +1,6 @@
 #include "AIFF.h"
 #include "IEEEExtended.h"
 #include "Endian.h"
-#include "Util.h"
 #include <cstdint>
 #include <iostream>
 
@@ -59,34 +58,71 @@ SSND chunk (mandatory):
  12      4 bytes  <block size>       // (=0)
  16     (n)bytes  Comment
  16+(n) (s)bytes  <Sample data>      // (s) := (x) - (n) - 8
+
+AIFF-C (floating-point samples):
+FORM chunk's formType is 'AIFC' and a format version chunk precedes COMM.
+
+FVER chunk (mandatory, 12 bytes):
+  0      4 bytes  "FVER"
+  4      4 bytes  <FVER chunk size>  // (=4)
+  8      4 bytes  <Timestamp>        // (=0xA2805140, AIFF-C version 1)
+
+COMM chunk (mandatory, 26 + 4 + (p) bytes)
+  0     26 bytes  <Same fields as the AIFF COMM chunk>
+ 26      4 bytes  <Compression type> // 'fl32' or 'fl64'
+ 30     (p)bytes  <Compression name> // Pascal string padded to an even size
 */
 
 namespace {
 
 const char* ID_AIFF = "AIFF";
+const char* ID_AIFC = "AIFC";
 const char* ID_FORM = "FORM";
+const char* ID_FORMAT_VERSION = "FVER";
 const char* ID_COMMON = "COMM";
 const char* ID_SSND = "SSND";
 
-constexpr size_t OFFSET_FORM_FILE_SIZE = 4;
-constexpr size_t OFFSET_COMM_FRAME_COUNT = 22;
-constexpr size_t OFFSET_SSND_CHUNK_SIZE = 42;
+constexpr uint32_t AIFC_VERSION_1 = 0xA2805140;
+
+// size of the header fields preceding the sample data
+constexpr size_t HEADER_SIZE = 12 + 26 + 16;
+
+// AIFF-C headers add the FVER chunk and extend the COMM chunk
+constexpr size_t FVER_CHUNK_SIZE = 12;
+constexpr size_t COMM_COMPRESSION_SIZE = 4 + 22;
+constexpr size_t AIFC_HEADER_SIZE = HEADER_SIZE + FVER_CHUNK_SIZE + COMM_COMPRESSION_SIZE;
+
+// Compression type and name (a Pascal string padded to an even size) of floating-point formats
+const char* COMPRESSION_FL32 = "fl32\x15" "32-bit floating point";
+const char* COMPRESSION_FL64 = "fl64\x15" "64-bit floating point";
 
-void writeFORM(std::ostream& o)
+void writeFORM(std::ostream& o, bool aifc, uint32_t fileSize)
 {
-	uint32_t fileSize = 0;
+	fileSize = mk::swapEndianness32(fileSize);
 	o << ID_FORM;
 	o.write(reinterpret_cast<const char*>(&fileSize), sizeof(uint32_t));
-	o << ID_AIFF;
+	o << (aifc ? ID_AIFC : ID_AIFF);
+}
+
+void writeFVER(std::ostream& o)
+{
+	const uint32_t chunkSize = mk::swapEndianness32(4);
+	const uint32_t timestamp = mk::swapEndianness32(AIFC_VERSION_1);
+
+	o << ID_FORMAT_VERSION;
+	o.write(reinterpret_cast<const char*>(&chunkSize), sizeof(uint32_t));
+	o.write(reinterpret_cast<const char*>(&timestamp), sizeof(uint32_t));
 }
 
 void writeCOMM(std::ostream& o,
 			   uint16_t channels,
+			   uint32_t frameCount,
 			   uint16_t sampleBitDepth,
-			   double sampleRate)
+			   double sampleRate,
+			   const char* compression)
 {
-	const uint32_t chunkSize = mk::swapEndianness32(18);
-	const uint32_t frameCount = mk::swapEndianness32(0); // not yet known
+	const uint32_t chunkSize = mk::swapEndianness32(compression ? 18 + COMM_COMPRESSION_SIZE : 18);
+	frameCount = mk::swapEndianness32(frameCount);
 	channels = mk::swapEndianness16(channels);
 	sampleBitDepth = mk::swapEndianness16(sampleBitDepth);
 
@@ -96,11 +132,15 @@ void writeCOMM(std::ostream& o,
 	o.write(reinterpret_cast<const char*>(&frameCount), sizeof(uint32_t));
 	o.write(reinterpret_cast<const char*>(&sampleBitDepth), sizeof(uint16_t));
 	o.write(reinterpret_cast<const char*>(mk::IeeeExtended(sampleRate).raw()), mk::IeeeExtended::size);
+
+	if (compression) {
+		o.write(compression, COMM_COMPRESSION_SIZE);
+	}
 }
 
-void writeSSND(std::ostream& o)
+void writeSSND(std::ostream& o, uint32_t chunkSize)
 {
-	const uint32_t chunkSize = mk::swapEndianness32(0);
+	chunkSize = mk::swapEndianness32(chunkSize);
 	const uint32_t offset = 0;
 	const uint32_t blockSize = 0;
 
@@ -115,94 +155,82 @@ void writeSSND(std::ostream& o)
 namespace mk {
 
 AIFF::AIFF(const std::string& filePath, BitDepth bitDepth, uint16_t channels, double sampleRate)
-	: _f(filePath, std::ios::binary)
-	, _bitDepth(bitDepth)
-	, _channels(channels)
-	, _sampleRate(sampleRate)
-	, _sampleDepth(0)
-	, _samples(0)
+	: PcmWriter(filePath, bitDepth, channels, sampleRate)
 {
-	if (_f.bad()) {
-		std::cerr << "Failed to create AIFF file" << std::endl;
+	if (!isOpen())
 		return;
-	}
-
-	switch (_bitDepth) {
-		case BitDepth::BitDepth16:
-		_sampleDepth = 16;
-		break;
-
-		case BitDepth::BitDepth24:
-		_sampleDepth = 24;
-		break;
 
-		default:
-		break;
-	}
-	
-	// write FORM, COMM and SSND chunks beforehand
-	writeFORM(_f);
-	writeCOMM(_f, _channels, _sampleDepth, _sampleRate);
-	writeSSND(_f);
+	// write FORM, COMM and SSND chunks beforehand, sizes are patched on close
+	writeHeader();
 }
 
-AIFF::~AIFF() {
-	// fill missing samples (if any) to complete final sample frame
-	if (_samples % _channels != 0) {
-		const uint8_t remainingSamples = _channels - (_samples % _channels);
-		for (size_t i = 0; i < channels() - remainingSamples; ++i) {
-			*this << 0.0;
-		}
+AIFF::AIFF(std::ostream& out, BitDepth bitDepth, uint16_t channels, double sampleRate, uint32_t frames)
+	: PcmWriter(out, bitDepth, channels, sampleRate, frames)
+{
+	// AIFF sizes are 32-bit values
+	const uint64_t headerSize = isFloatingPoint(_bitDepth) ? AIFC_HEADER_SIZE : HEADER_SIZE;
+	if (headerSize + static_cast<uint64_t>(frames) * _channels * (bitsPerSample(_bitDepth) / 8) > UINT32_MAX) {
+		std::cerr << "Warning: AIFF stream exceeds 4 GiB, its header is invalid" << std::endl;
 	}
 
-	// rewind stream and write remaining variable-length data
-
-	// since we're done appending samples, the current file position is the file's size
-	const uint32_t fileSize = swapEndianness32(static_cast<uint32_t>(_f.tellp()) - 8);
+	// the declared frame count gives the final sizes, the header is never rewritten
+	writeHeader();
+}
 
-	_f.seekp(OFFSET_FORM_FILE_SIZE);
-	_f.write(reinterpret_cast<const char*>(&fileSize), sizeof(fileSize));
+AIFF::~AIFF() {
+	if (!isOpen())
+		return;
 
-	_f.seekp(OFFSET_COMM_FRAME_COUNT);
-	const uint32_t frameCount = swapEndianness32(_samples / channels());
-	_f.write(reinterpret_cast<const char*>(&frameCount), sizeof(uint32_t));
+	finish();
 
-	_f.seekp(OFFSET_SSND_CHUNK_SIZE);
-	const uint32_t ssndChunkSize = swapEndianness32(_samples * _channels * _sampleDepth + 8);
-	_f.write(reinterpret_cast<const char*>(&ssndChunkSize), sizeof(uint32_t));
-}
+	if (streaming()) {
+		_f.flush();
+		return;
+	}
 
-void writeSample16(std::ostream& o, double sample) {
-	// clamp floating-point sample to [-1;1] and scale
-	// it to maximum positive value for a 16-bit sample
-	uint16_t s = swapEndianness16(32767 * clamp(sample, -1.0, 1.0));
-	o.write((const char*)&s, 2);
-}
+	// AIFF sizes and frame counts are 32-bit values
+	if (static_cast<uint64_t>(_f.tellp()) > UINT32_MAX) {
+		std::cerr << "Warning: AIFF file exceeds 4 GiB, its header is invalid" << std::endl;
+	}
 
-void writeSample24(std::ostream& o, double sample) {
-	// clamp floating-point sample to [-1;1] and scale
-	// it to maximum positive value for a 24-bit sample
-	uint32_t s = swapEndianness32(8388607 * clamp(sample, -1.0, 1.0)) >> 8;
-	o.write((const char*)&s, 3);
+	// rewind stream and write the header again with the final sizes
+	_f.seekp(0);
+	writeHeader();
 }
 
-AIFF& AIFF::operator<<(double sample) {
-	if (_f.good()) {
-		switch (_bitDepth) {
-		case BitDepth::BitDepth16:
-			writeSample16(_f, sample);
+void AIFF::writeHeader() {
+	// floating-point samples require the AIFF-C format
+	const char* compression = nullptr;
+	switch (_bitDepth) {
+		case BitDepth::Float32:
+		compression = COMPRESSION_FL32;
 		break;
 
-		case BitDepth::BitDepth24:
-			writeSample24(_f, sample);
+		case BitDepth::Float64:
+		compression = COMPRESSION_FL64;
 		break;
 
 		default:
-			break;
-		}
-		++_samples;
+		break;
+	}
+
+	const uint64_t dataSize = totalFrames() * _channels * (bitsPerSample(_bitDepth) / 8);
+	const uint64_t headerSize = compression ? AIFC_HEADER_SIZE : HEADER_SIZE;
+
+	writeFORM(_f, compression != nullptr, static_cast<uint32_t>(headerSize + dataSize - 8));
+	if (compression) {
+		writeFVER(_f);
 	}
-	return *this;
+	writeCOMM(_f, _channels, static_cast<uint32_t>(totalFrames()), bitsPerSample(_bitDepth), _sampleRate, compression);
+	writeSSND(_f, static_cast<uint32_t>(dataSize + 8));
+}
+
+void AIFF::encode(const float* samples, size_t count, uint8_t* out) const {
+	encodeSamples(samples, count, _bitDepth, ByteOrder::BigEndian, out);
+}
+
+void AIFF::encode(const double* samples, size_t count, uint8_t* out) const {
+	encodeSamples(samples, count, _bitDepth, ByteOrder::BigEndian, out);
 }
 
 } // namespace mk
@@ -0,0 +1,204 @@
+#include "AIFFReader.h"
+#include "IEEEExtended.h"
+#include "PCM.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t CHUNK_HEADER_SIZE = 8;
+constexpr size_t FORM_HEADER_SIZE = 12;
+constexpr size_t COMM_CHUNK_SIZE = 18;
+constexpr size_t AIFC_COMM_CHUNK_SIZE = 22;
+constexpr size_t SSND_HEADER_SIZE = 8;
+
+uint16_t read16BE(const uint8_t* p) {
+	return static_cast<uint16_t>(p[0] << 8 | p[1]);
+}
+
+uint32_t read32BE(const uint8_t* p) {
+	return static_cast<uint32_t>(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+bool isChunk(const uint8_t* p, const char* id) {
+	return memcmp(p, id, 4) == 0;
+}
+
+} // namespace
+
+namespace mk {
+
+AIFFReader::AIFFReader(const std::string& filePath)
+	: _map(nullptr)
+	, _mapSize(0)
+	, _samples(nullptr)
+	, _channels(0)
+	, _bitDepth(BitDepth::BitDepth16)
+	, _sampleRate(0.0)
+	, _frames(0)
+	, _frameSize(0)
+{
+	parse(filePath);
+}
+
+AIFFReader::~AIFFReader() {
+	if (_map) {
+		munmap(_map, _mapSize);
+	}
+}
+
+bool AIFFReader::parse(const std::string& filePath) {
+	const int fd = open(filePath.c_str(), O_RDONLY);
+	if (fd < 0) {
+		std::cerr << "Failed to open AIFF file: " << filePath << std::endl;
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < FORM_HEADER_SIZE) {
+		std::cerr << "Not an AIFF file: " << filePath << std::endl;
+		close(fd);
+		return false;
+	}
+
+	_mapSize = static_cast<size_t>(st.st_size);
+	void* map = mmap(nullptr, _mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		std::cerr << "Failed to map AIFF file: " << filePath << std::endl;
+		return false;
+	}
+	_map = map;
+
+	// sample data is typically scanned front to back
+	madvise(_map, _mapSize, MADV_SEQUENTIAL);
+
+	const uint8_t* data = static_cast<const uint8_t*>(_map);
+	const bool aifc = isChunk(data + 8, "AIFC");
+	if (!isChunk(data, "FORM") || (!aifc && !isChunk(data + 8, "AIFF"))) {
+		std::cerr << "Not an AIFF file: " << filePath << std::endl;
+		return false;
+	}
+
+	// walk chunks inside the FORM chunk, which may be shorter than the file
+	const size_t formEnd = std::min<size_t>(_mapSize, CHUNK_HEADER_SIZE + read32BE(data + 4));
+	const uint8_t* ssnd = nullptr;
+	size_t ssndSize = 0;
+	bool hasCOMM = false;
+	uint16_t bits = 0;
+	const uint8_t* compression = nullptr;
+
+	for (size_t pos = FORM_HEADER_SIZE; pos + CHUNK_HEADER_SIZE <= formEnd;) {
+		const uint8_t* chunk = data + pos;
+		const size_t size = std::min<size_t>(read32BE(chunk + 4), formEnd - pos - CHUNK_HEADER_SIZE);
+		const uint8_t* body = chunk + CHUNK_HEADER_SIZE;
+
+		if (isChunk(chunk, "COMM") && size >= COMM_CHUNK_SIZE) {
+			_channels = read16BE(body);
+			_frames = read32BE(body + 2);
+			bits = read16BE(body + 6);
+			_sampleRate = IeeeExtended(body + 8);
+			if (aifc && size >= AIFC_COMM_CHUNK_SIZE) {
+				compression = body + COMM_CHUNK_SIZE;
+			}
+			hasCOMM = true;
+		}
+		else if (isChunk(chunk, "SSND") && size >= SSND_HEADER_SIZE) {
+			const uint32_t offset = read32BE(body);
+			if (offset <= size - SSND_HEADER_SIZE) {
+				ssnd = body + SSND_HEADER_SIZE + offset;
+				ssndSize = size - SSND_HEADER_SIZE - offset;
+			}
+		}
+
+		// chunks are padded to an even size
+		pos += CHUNK_HEADER_SIZE + size + (size & 1);
+	}
+
+	if (!hasCOMM || !ssnd) {
+		std::cerr << "Missing COMM or SSND chunk in AIFF file: " << filePath << std::endl;
+		return false;
+	}
+
+	// uncompressed AIFF-C samples are stored like AIFF ones
+	bool supported = bits == 8 || bits == 16 || bits == 24 || bits == 32;
+	_bitDepth = static_cast<BitDepth>(bits);
+	if (compression && !isChunk(compression, "NONE") && !isChunk(compression, "twos")) {
+		if (isChunk(compression, "fl32") || isChunk(compression, "FL32")) {
+			_bitDepth = BitDepth::Float32;
+			supported = bits == 32;
+		}
+		else if (isChunk(compression, "fl64") || isChunk(compression, "FL64")) {
+			_bitDepth = BitDepth::Float64;
+			supported = bits == 64;
+		}
+		else {
+			supported = false;
+		}
+	}
+
+	if (_channels == 0 || !supported) {
+		std::cerr << "Unsupported AIFF sample format: " << _channels << " channel(s), "
+				  << bits << " bits per sample" << std::endl;
+		return false;
+	}
+
+	_frameSize = _channels * (sampleDepth() / 8);
+
+	// never expose frames beyond the end of the sound data
+	if (_frames > ssndSize / _frameSize) {
+		std::cerr << "Warning: AIFF file is truncated, " << ssndSize / _frameSize
+				  << " of " << _frames << " frames available" << std::endl;
+		_frames = static_cast<uint32_t>(ssndSize / _frameSize);
+	}
+
+	_samples = ssnd;
+	return true;
+}
+
+size_t AIFFReader::read(size_t firstFrame, size_t frameCount, float* out) const {
+	if (!valid() || firstFrame >= _frames)
+		return 0;
+
+	frameCount = std::min<size_t>(frameCount, _frames - firstFrame);
+	const uint8_t* in = frame(firstFrame);
+	const size_t count = frameCount * _channels;
+
+	switch (_bitDepth) {
+	case BitDepth::BitDepth8:
+		decodePCM8(in, count, out);
+	break;
+
+	case BitDepth::BitDepth16:
+		decodePCM16BE(in, count, out);
+	break;
+
+	case BitDepth::BitDepth24:
+		decodePCM24BE(in, count, out);
+	break;
+
+	case BitDepth::BitDepth32:
+		decodePCM32BE(in, count, out);
+	break;
+
+	case BitDepth::Float32:
+		decodeFloat32BE(in, count, out);
+	break;
+
+	case BitDepth::Float64:
+		decodeFloat64BE(in, count, out);
+	break;
+
+	default:
+		return 0;
+	}
+
+	return frameCount;
+}
+
+} // namespace mk
@@ -0,0 +1,95 @@
+#include "Automation.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace mk {
+
+Automation::Automation() {
+}
+
+Automation::Automation(const std::vector<AutomationPoint>& breakpoints)
+	: _breakpoints(breakpoints)
+{
+}
+
+Automation& Automation::add(double time, double value) {
+	_breakpoints.push_back(AutomationPoint{ time, value });
+	return *this;
+}
+
+bool Automation::parse(const std::string& text) {
+	std::vector<AutomationPoint> breakpoints;
+	const char* p = text.c_str();
+	for (;;) {
+		while (*p == ',' || ::isspace(static_cast<unsigned char>(*p))) {
+			++p;
+		}
+		if (*p == '\0')
+			break;
+
+		char* end;
+		AutomationPoint breakpoint;
+		breakpoint.time = strtod(p, &end);
+		if (end == p || *end != ':' || !std::isfinite(breakpoint.time)) {
+			std::cerr << "Incorrect breakpoint time: '" << p << "', pass time:value" << std::endl;
+			return false;
+		}
+		if (!breakpoints.empty() && breakpoint.time < breakpoints.back().time) {
+			std::cerr << "Breakpoint times must not decrease: " << breakpoint.time << " after " << breakpoints.back().time << std::endl;
+			return false;
+		}
+
+		p = end + 1;
+		breakpoint.value = strtod(p, &end);
+		if (end == p || std::isnan(breakpoint.value)) {
+			std::cerr << "Incorrect breakpoint value: '" << p << "'" << std::endl;
+			return false;
+		}
+		breakpoints.push_back(breakpoint);
+		p = end;
+	}
+
+	if (breakpoints.empty()) {
+		std::cerr << "No breakpoints in: '" << text << "'" << std::endl;
+		return false;
+	}
+
+	_breakpoints.swap(breakpoints);
+	return true;
+}
+
+bool Automation::load(const std::string& filePath) {
+	std::ifstream file(filePath);
+	if (!file) {
+		std::cerr << "Failed to open automation file: " << filePath << std::endl;
+		return false;
+	}
+	return parse(std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()));
+}
+
+bool Automation::read(const std::string& fileOrText) {
+	return std::ifstream(fileOrText) ? load(fileOrText) : parse(fileOrText);
+}
+
+double Automation::valueAt(double time) const {
+	if (_breakpoints.empty())
+		return 0.0;
+
+	// the first breakpoint after time, the last of equal ones before it
+	const auto next = std::upper_bound(_breakpoints.begin(), _breakpoints.end(), time,
+		[](double t, const AutomationPoint& breakpoint) { return t < breakpoint.time; });
+	if (next == _breakpoints.begin())
+		return next->value;
+	if (next == _breakpoints.end())
+		return _breakpoints.back().value;
+
+	const AutomationPoint& previous = *(next - 1);
+	return previous.value + (next->value - previous.value) * (time - previous.time) / (next->time - previous.time);
+}
+
+} // namespace mk
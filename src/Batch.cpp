@@ -0,0 +1,188 @@
+#include "Batch.h"
+#include "ThreadPool.h"
+#include "Util.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <set>
+#include <sys/stat.h>
+
+namespace {
+
+struct Job {
+	std::string input;
+	std::string output;
+	uint64_t bytes;
+};
+
+// device and inode of a file, the same for all paths to it
+typedef std::pair<dev_t, ino_t> FileId;
+
+uint64_t fileSize(const std::string& filePath) {
+	struct stat status;
+	return ::stat(filePath.c_str(), &status) == 0 ? static_cast<uint64_t>(status.st_size) : 0;
+}
+
+bool fileId(const std::string& filePath, FileId& id) {
+	struct stat status;
+	if (::stat(filePath.c_str(), &status) != 0)
+		return false;
+
+	id = FileId(status.st_dev, status.st_ino);
+	return true;
+}
+
+/// Returns the jobs of a batch, largest input first. Inputs that would
+/// overwrite the output of a previous one, or whose output is an input file
+/// of the batch, such as itself through another path ("a.aiff" written to
+/// "./a.aiff"), are failures: writing it would truncate a file being read.
+std::vector<Job> makeJobs(const std::vector<std::string>& inputFilePaths,
+						  const std::string& outputDirectory,
+						  mk::BatchReport& report) {
+	std::set<FileId> inputs;
+	for (const auto& input : inputFilePaths) {
+		FileId id;
+		if (fileId(input, id)) {
+			inputs.insert(id);
+		}
+	}
+
+	std::vector<Job> jobs;
+	std::set<std::string> outputs;
+	for (const auto& input : inputFilePaths) {
+		const std::string output = mk::batchOutputPath(input, outputDirectory);
+		if (!outputs.insert(output).second) {
+			std::cerr << "Output file of '" << input << "' is the output of another input file: " << output << std::endl;
+			report.failures.push_back(input);
+			continue;
+		}
+
+		FileId id;
+		if (fileId(output, id) && inputs.count(id)) {
+			std::cerr << "Output file of '" << input << "' is an input file: " << output << std::endl;
+			report.failures.push_back(input);
+			continue;
+		}
+		jobs.push_back(Job{ input, output, fileSize(input) });
+	}
+
+	std::stable_sort(jobs.begin(), jobs.end(), [](const Job& a, const Job& b) { return a.bytes > b.bytes; });
+	return jobs;
+}
+
+/// Runs an operation on all jobs and records their outcome
+void runJobs(const std::vector<Job>& jobs,
+			 const std::function<bool(const Job&)>& operation,
+			 mk::ThreadPool& pool,
+			 mk::BatchReport& report) {
+	std::vector<char> succeeded(jobs.size(), 0);
+	pool.run(jobs.size(), [&](size_t i) {
+		succeeded[i] = operation(jobs[i]);
+	});
+
+	for (size_t i = 0; i < jobs.size(); ++i) {
+		if (succeeded[i]) {
+			++report.succeeded;
+			report.bytes += jobs[i].bytes;
+		}
+		else {
+			report.failures.push_back(jobs[i].input);
+		}
+	}
+}
+
+double secondsSince(const std::chrono::steady_clock::time_point& start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+namespace mk {
+
+BatchReport::BatchReport()
+	: succeeded(0)
+	, bytes(0)
+	, seconds(0.0)
+{
+}
+
+double BatchReport::megabytesPerSecond() const {
+	return seconds > 0.0 ? bytes / seconds / 1.0e6 : 0.0;
+}
+
+std::string batchOutputPath(const std::string& inputFilePath, const std::string& outputDirectory) {
+	const size_t separator = inputFilePath.find_last_of("/\\");
+	const std::string fileName = separator == std::string::npos ? inputFilePath : inputFilePath.substr(separator + 1);
+	if (outputDirectory.empty())
+		return fileName;
+
+	const char last = outputDirectory[outputDirectory.size() - 1];
+	return last == '/' || last == '\\' ? outputDirectory + fileName : outputDirectory + '/' + fileName;
+}
+
+BatchReport processBatch(const std::vector<std::string>& inputFilePaths,
+						 const std::string& outputDirectory,
+						 const FileOperation& operation,
+						 ThreadPool& pool) {
+	const auto start = std::chrono::steady_clock::now();
+
+	BatchReport report;
+	const std::vector<Job> jobs = makeJobs(inputFilePaths, outputDirectory, report);
+	runJobs(jobs, [&](const Job& job) { return operation(job.input, job.output); }, pool, report);
+
+	report.seconds = secondsSince(start);
+	return report;
+}
+
+BatchReport normalizeAlbum(const std::vector<std::string>& inputFilePaths,
+						   const std::string& outputDirectory,
+						   float peakLoudness,
+						   ThreadPool& pool) {
+	const auto start = std::chrono::steady_clock::now();
+
+	BatchReport report;
+	if (peakLoudness > 0.0) {
+		std::cerr << "Peak value is out of range: " << peakLoudness << ", max peak value is 0 dB" << std::endl;
+		report.failures = inputFilePaths;
+		return report;
+	}
+
+	std::vector<Job> jobs = makeJobs(inputFilePaths, outputDirectory, report);
+
+	// scan the peak of each file, from its peak index if it has one
+	std::vector<float> peaks(jobs.size(), 0.0f);
+	std::vector<char> scanned(jobs.size(), 0);
+	pool.run(jobs.size(), [&](size_t i) {
+		SampleInfo max;
+		scanned[i] = scanMax(jobs[i].input, max);
+		peaks[i] = static_cast<float>(std::abs(max.amplitude));
+	});
+
+	float albumPeak = 0.0f;
+	std::vector<Job> scannedJobs;
+	for (size_t i = 0; i < jobs.size(); ++i) {
+		if (scanned[i]) {
+			albumPeak = std::max(albumPeak, peaks[i]);
+			scannedJobs.push_back(jobs[i]);
+		}
+		else {
+			report.failures.push_back(jobs[i].input);
+		}
+	}
+
+	// a silent album stays silent
+	const float peakAmplitude = clamp(loudnessToAmplitude(peakLoudness), 0.0, 1.0);
+	const double gain = albumPeak > 0.0f ? 20.0 * std::log10(peakAmplitude / static_cast<double>(albumPeak)) : 0.0;
+
+	runJobs(scannedJobs, [&](const Job& job) {
+		Pipeline pipeline;
+		pipeline.gain(gain);
+		return process(job.input, job.output, pipeline);
+	}, pool, report);
+
+	report.seconds = secondsSince(start);
+	return report;
+}
+
+} // namespace mk
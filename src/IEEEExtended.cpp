@@ -1,5 +1,6 @@
 #include "IEEEExtended.h"
 #include <cmath>
+#include <cstring>
 
 #ifndef HUGE_VAL
 #define HUGE_VAL HUGE
@@ -23,6 +24,11 @@ IeeeExtended::IeeeExtended(double n)
 	*this = n;
 }
 
+IeeeExtended::IeeeExtended(const uint8_t* raw)
+{
+	memcpy(_buff, raw, size);
+}
+
 void IeeeExtended::operator=(double n)
 {
 	doubleToIeeeExtended(n, _buff);
@@ -0,0 +1,423 @@
+#include "PCM.h"
+#include "Simd.h"
+#include "Util.h"
+#include <cstring>
+
+namespace {
+
+// full scale values of signed integer samples
+constexpr double SCALE_8 = 127.0;
+constexpr double SCALE_16 = 32767.0;
+constexpr double SCALE_24 = 8388607.0;
+constexpr double SCALE_32 = 2147483647.0;
+
+// decoded samples are normalized by 2^(bits - 1), like libsndfile does
+constexpr float NORM_8 = 1.0f / 128.0f;
+constexpr float NORM_16 = 1.0f / 32768.0f;
+constexpr float NORM_24 = 1.0f / 8388608.0f;
+constexpr double NORM_32 = 1.0 / 2147483648.0;
+
+// Reference quantizer: clamps the sample to [-1;1], scales it
+// and truncates it towards zero. Vectorized kernels must match it bit by bit.
+inline int32_t quantize(double sample, double scale) {
+	return static_cast<int32_t>(scale * mk::clamp(sample, -1.0, 1.0));
+}
+
+using mk::ByteOrder;
+
+// Byte-wise stores are endian-neutral: compilers emit plain stores for
+// little-endian output on little-endian hosts and a byte swap otherwise
+template<ByteOrder order>
+inline void store16(uint8_t* out, uint32_t s) {
+	const bool be = order == ByteOrder::BigEndian;
+	out[be ? 0 : 1] = static_cast<uint8_t>(s >> 8);
+	out[be ? 1 : 0] = static_cast<uint8_t>(s);
+}
+
+template<ByteOrder order>
+inline void store24(uint8_t* out, uint32_t s) {
+	const bool be = order == ByteOrder::BigEndian;
+	out[be ? 0 : 2] = static_cast<uint8_t>(s >> 16);
+	out[1] = static_cast<uint8_t>(s >> 8);
+	out[be ? 2 : 0] = static_cast<uint8_t>(s);
+}
+
+template<ByteOrder order>
+inline void store32(uint8_t* out, uint32_t s) {
+	const bool be = order == ByteOrder::BigEndian;
+	out[be ? 0 : 3] = static_cast<uint8_t>(s >> 24);
+	out[be ? 1 : 2] = static_cast<uint8_t>(s >> 16);
+	out[be ? 2 : 1] = static_cast<uint8_t>(s >> 8);
+	out[be ? 3 : 0] = static_cast<uint8_t>(s);
+}
+
+template<ByteOrder order>
+inline void store64(uint8_t* out, uint64_t s) {
+	const bool be = order == ByteOrder::BigEndian;
+	store32<order>(out + (be ? 0 : 4), static_cast<uint32_t>(s >> 32));
+	store32<order>(out + (be ? 4 : 0), static_cast<uint32_t>(s));
+}
+
+inline int32_t load16BE(const uint8_t* in) {
+	return static_cast<int16_t>(in[0] << 8 | in[1]);
+}
+
+inline int32_t load24BE(const uint8_t* in) {
+	// place the sample in the upper 24 bits and shift it back to extend its sign
+	return static_cast<int32_t>(static_cast<uint32_t>(in[0]) << 24 | in[1] << 16 | in[2] << 8) >> 8;
+}
+
+inline int32_t load32BE(const uint8_t* in) {
+	return static_cast<int32_t>(static_cast<uint32_t>(in[0]) << 24 | in[1] << 16 | in[2] << 8 | in[3]);
+}
+
+inline uint64_t load64BE(const uint8_t* in) {
+	return static_cast<uint64_t>(static_cast<uint32_t>(load32BE(in))) << 32 | static_cast<uint32_t>(load32BE(in + 4));
+}
+
+template<class T>
+void encode8(const T* samples, size_t count, uint8_t* out, uint8_t offset) {
+	for (size_t i = 0; i < count; ++i) {
+		out[i] = static_cast<uint8_t>(quantize(samples[i], SCALE_8) + offset);
+	}
+}
+
+template<ByteOrder order, class T>
+void encode16(const T* samples, size_t count, uint8_t* out, size_t i) {
+	for (; i < count; ++i) {
+		store16<order>(out + 2 * i, quantize(samples[i], SCALE_16));
+	}
+}
+
+template<ByteOrder order, class T>
+void encode24(const T* samples, size_t count, uint8_t* out, size_t i) {
+	for (; i < count; ++i) {
+		store24<order>(out + 3 * i, quantize(samples[i], SCALE_24));
+	}
+}
+
+template<ByteOrder order, class T>
+void encode32(const T* samples, size_t count, uint8_t* out) {
+	for (size_t i = 0; i < count; ++i) {
+		store32<order>(out + 4 * i, static_cast<uint32_t>(quantize(samples[i], SCALE_32)));
+	}
+}
+
+template<ByteOrder order, class T>
+void encodeFloat32(const T* samples, size_t count, uint8_t* out) {
+	for (size_t i = 0; i < count; ++i) {
+		const float f = static_cast<float>(samples[i]);
+		uint32_t s;
+		memcpy(&s, &f, 4);
+		store32<order>(out + 4 * i, s);
+	}
+}
+
+template<ByteOrder order, class T>
+void encodeFloat64(const T* samples, size_t count, uint8_t* out) {
+	for (size_t i = 0; i < count; ++i) {
+		const double d = static_cast<double>(samples[i]);
+		uint64_t s;
+		memcpy(&s, &d, 8);
+		store64<order>(out + 8 * i, s);
+	}
+}
+
+void decode16BE(const uint8_t* in, size_t count, float* samples, size_t i) {
+	for (; i < count; ++i) {
+		samples[i] = NORM_16 * load16BE(in + 2 * i);
+	}
+}
+
+void decode24BE(const uint8_t* in, size_t count, float* samples, size_t i) {
+	for (; i < count; ++i) {
+		samples[i] = NORM_24 * load24BE(in + 3 * i);
+	}
+}
+
+#if defined(MK_SSE2)
+
+// Quantizes 4 samples to 32-bit integers. Samples are widened to double
+// so that scaling rounds exactly like the scalar path, and min/max operands
+// are ordered like mk::clamp so that NaNs propagate the same way.
+#if defined(MK_AVX2)
+
+inline __m256d load4(const float* p) { return _mm256_cvtps_pd(_mm_loadu_ps(p)); }
+inline __m256d load4(const double* p) { return _mm256_loadu_pd(p); }
+
+template<class T>
+inline __m128i quantize4(const T* p, double scale) {
+	const __m256d x = _mm256_min_pd(_mm256_set1_pd(1.0), _mm256_max_pd(_mm256_set1_pd(-1.0), load4(p)));
+	return _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_set1_pd(scale), x));
+}
+
+#else
+
+inline __m128d load2(const float* p) { return _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)))); }
+inline __m128d load2(const double* p) { return _mm_loadu_pd(p); }
+
+inline __m128i quantize2(__m128d x, double scale) {
+	x = _mm_min_pd(_mm_set1_pd(1.0), _mm_max_pd(_mm_set1_pd(-1.0), x));
+	return _mm_cvttpd_epi32(_mm_mul_pd(_mm_set1_pd(scale), x));
+}
+
+template<class T>
+inline __m128i quantize4(const T* p, double scale) {
+	return _mm_unpacklo_epi64(quantize2(load2(p), scale), quantize2(load2(p + 2), scale));
+}
+
+#endif // MK_AVX2
+
+// The kernels below assume a little-endian host, which holds for every SSE2 target
+
+template<ByteOrder order, class T>
+void encode16Kernel(const T* samples, size_t count, uint8_t* out) {
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i a = quantize4(samples + i, SCALE_16);
+		__m128i b = quantize4(samples + i + 4, SCALE_16);
+
+		// sign-extend the low 16 bits so the saturating pack keeps them unchanged
+		a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+		b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+		__m128i v = _mm_packs_epi32(a, b);
+
+		// swap bytes of each 16-bit sample
+		if (order == ByteOrder::BigEndian) {
+			v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), v);
+	}
+	encode16<order>(samples, count, out, i);
+}
+
+template<ByteOrder order, class T>
+void encode24Kernel(const T* samples, size_t count, uint8_t* out) {
+	size_t i = 0;
+#if defined(MK_SSSE3)
+	// picks the 3 least significant bytes of each 32-bit sample in the requested order
+	const __m128i pack = order == ByteOrder::BigEndian
+		? _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)
+		: _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	for (; i + 16 <= count; i += 16) {
+		const __m128i a = _mm_shuffle_epi8(quantize4(samples + i, SCALE_24), pack);
+		const __m128i b = _mm_shuffle_epi8(quantize4(samples + i + 4, SCALE_24), pack);
+		const __m128i c = _mm_shuffle_epi8(quantize4(samples + i + 8, SCALE_24), pack);
+		const __m128i d = _mm_shuffle_epi8(quantize4(samples + i + 12, SCALE_24), pack);
+
+		// stitch four 12-byte groups into three 16-byte stores
+		__m128i* o = reinterpret_cast<__m128i*>(out + 3 * i);
+		_mm_storeu_si128(o, _mm_or_si128(a, _mm_slli_si128(b, 12)));
+		_mm_storeu_si128(o + 1, _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+		_mm_storeu_si128(o + 2, _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+	}
+#else
+	int32_t s[4];
+	for (; i + 4 <= count; i += 4) {
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(s), quantize4(samples + i, SCALE_24));
+		for (size_t j = 0; j < 4; ++j) {
+			store24<order>(out + 3 * (i + j), s[j]);
+		}
+	}
+#endif // MK_SSSE3
+	encode24<order>(samples, count, out, i);
+}
+
+void decode16BEKernel(const uint8_t* in, size_t count, float* samples) {
+	const __m128 norm = _mm_set1_ps(NORM_16);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i));
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+
+		// move each 16-bit sample to the upper half of a 32-bit lane and shift it back to extend its sign
+		const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+		_mm_storeu_ps(samples + i, _mm_mul_ps(norm, _mm_cvtepi32_ps(lo)));
+		_mm_storeu_ps(samples + i + 4, _mm_mul_ps(norm, _mm_cvtepi32_ps(hi)));
+	}
+	decode16BE(in, count, samples, i);
+}
+
+void decode24BEKernel(const uint8_t* in, size_t count, float* samples) {
+	size_t i = 0;
+#if defined(MK_SSSE3)
+	// moves each 3-byte big-endian sample to the upper 24 bits of a 32-bit lane
+	const __m128i unpack = _mm_setr_epi8(-1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9);
+	const __m128 norm = _mm_set1_ps(NORM_24);
+	// each load reads 16 bytes but consumes 12, so stop while 4 spare bytes remain
+	for (; 3 * i + 16 <= 3 * count; i += 4) {
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 3 * i));
+		const __m128i s = _mm_srai_epi32(_mm_shuffle_epi8(v, unpack), 8);
+		_mm_storeu_ps(samples + i, _mm_mul_ps(norm, _mm_cvtepi32_ps(s)));
+	}
+#endif // MK_SSSE3
+	decode24BE(in, count, samples, i);
+}
+
+#else
+
+void decode16BEKernel(const uint8_t* in, size_t count, float* samples) {
+	decode16BE(in, count, samples, 0);
+}
+
+void decode24BEKernel(const uint8_t* in, size_t count, float* samples) {
+	decode24BE(in, count, samples, 0);
+}
+
+template<ByteOrder order, class T>
+void encode16Kernel(const T* samples, size_t count, uint8_t* out) {
+	encode16<order>(samples, count, out, 0);
+}
+
+template<ByteOrder order, class T>
+void encode24Kernel(const T* samples, size_t count, uint8_t* out) {
+	encode24<order>(samples, count, out, 0);
+}
+
+#endif // MK_SSE2
+
+template<ByteOrder order, class T>
+void encode(const T* samples, size_t count, mk::BitDepth bitDepth, uint8_t* out) {
+	switch (bitDepth) {
+	case mk::BitDepth::BitDepth8:
+		encode8(samples, count, out, 0);
+	break;
+
+	case mk::BitDepth::BitDepth16:
+		encode16Kernel<order>(samples, count, out);
+	break;
+
+	case mk::BitDepth::BitDepth24:
+		encode24Kernel<order>(samples, count, out);
+	break;
+
+	case mk::BitDepth::BitDepth32:
+		encode32<order>(samples, count, out);
+	break;
+
+	case mk::BitDepth::Float32:
+		encodeFloat32<order>(samples, count, out);
+	break;
+
+	case mk::BitDepth::Float64:
+		encodeFloat64<order>(samples, count, out);
+	break;
+	}
+}
+
+} // namespace
+
+namespace mk {
+
+void encodePCM8(const float* samples, size_t count, uint8_t* out) {
+	encode8(samples, count, out, 0);
+}
+
+void encodePCM8(const double* samples, size_t count, uint8_t* out) {
+	encode8(samples, count, out, 0);
+}
+
+void encodePCM8Unsigned(const float* samples, size_t count, uint8_t* out) {
+	encode8(samples, count, out, 128);
+}
+
+void encodePCM8Unsigned(const double* samples, size_t count, uint8_t* out) {
+	encode8(samples, count, out, 128);
+}
+
+void encodePCM16BE(const float* samples, size_t count, uint8_t* out) {
+	encode16Kernel<ByteOrder::BigEndian>(samples, count, out);
+}
+
+void encodePCM16BE(const double* samples, size_t count, uint8_t* out) {
+	encode16Kernel<ByteOrder::BigEndian>(samples, count, out);
+}
+
+void encodePCM24BE(const float* samples, size_t count, uint8_t* out) {
+	encode24Kernel<ByteOrder::BigEndian>(samples, count, out);
+}
+
+void encodePCM24BE(const double* samples, size_t count, uint8_t* out) {
+	encode24Kernel<ByteOrder::BigEndian>(samples, count, out);
+}
+
+void encodePCM32BE(const float* samples, size_t count, uint8_t* out) {
+	encode32<ByteOrder::BigEndian>(samples, count, out);
+}
+
+void encodePCM32BE(const double* samples, size_t count, uint8_t* out) {
+	encode32<ByteOrder::BigEndian>(samples, count, out);
+}
+
+void encodeFloat32BE(const float* samples, size_t count, uint8_t* out) {
+	encodeFloat32<ByteOrder::BigEndian>(samples, count, out);
+}
+
+void encodeFloat32BE(const double* samples, size_t count, uint8_t* out) {
+	encodeFloat32<ByteOrder::BigEndian>(samples, count, out);
+}
+
+void encodeFloat64BE(const float* samples, size_t count, uint8_t* out) {
+	encodeFloat64<ByteOrder::BigEndian>(samples, count, out);
+}
+
+void encodeFloat64BE(const double* samples, size_t count, uint8_t* out) {
+	encodeFloat64<ByteOrder::BigEndian>(samples, count, out);
+}
+
+void encodeSamples(const float* samples, size_t count, BitDepth bitDepth, ByteOrder byteOrder, uint8_t* out) {
+	if (byteOrder == ByteOrder::BigEndian) {
+		encode<ByteOrder::BigEndian>(samples, count, bitDepth, out);
+	}
+	else {
+		encode<ByteOrder::LittleEndian>(samples, count, bitDepth, out);
+	}
+}
+
+void encodeSamples(const double* samples, size_t count, BitDepth bitDepth, ByteOrder byteOrder, uint8_t* out) {
+	if (byteOrder == ByteOrder::BigEndian) {
+		encode<ByteOrder::BigEndian>(samples, count, bitDepth, out);
+	}
+	else {
+		encode<ByteOrder::LittleEndian>(samples, count, bitDepth, out);
+	}
+}
+
+void decodePCM8(const uint8_t* in, size_t count, float* samples) {
+	for (size_t i = 0; i < count; ++i) {
+		samples[i] = NORM_8 * static_cast<int8_t>(in[i]);
+	}
+}
+
+void decodePCM16BE(const uint8_t* in, size_t count, float* samples) {
+	decode16BEKernel(in, count, samples);
+}
+
+void decodePCM24BE(const uint8_t* in, size_t count, float* samples) {
+	decode24BEKernel(in, count, samples);
+}
+
+void decodePCM32BE(const uint8_t* in, size_t count, float* samples) {
+	for (size_t i = 0; i < count; ++i) {
+		samples[i] = static_cast<float>(NORM_32 * load32BE(in + 4 * i));
+	}
+}
+
+void decodeFloat32BE(const uint8_t* in, size_t count, float* samples) {
+	for (size_t i = 0; i < count; ++i) {
+		const uint32_t s = static_cast<uint32_t>(load32BE(in + 4 * i));
+		memcpy(&samples[i], &s, 4);
+	}
+}
+
+void decodeFloat64BE(const uint8_t* in, size_t count, float* samples) {
+	for (size_t i = 0; i < count; ++i) {
+		const uint64_t s = load64BE(in + 8 * i);
+		double d;
+		memcpy(&d, &s, 8);
+		samples[i] = static_cast<float>(d);
+	}
+}
+
+} // namespace mk
@@ -0,0 +1,208 @@
+#include "PatchGraph.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <iostream>
+
+namespace mk {
+
+constexpr PatchGraph::NodeId PatchGraph::NO_NODE;
+
+PatchGraph::PatchGraph(double sampleRate, size_t blockFrames)
+	: _sampleRate(sampleRate)
+	, _blockFrames(std::max<size_t>(blockFrames, 1))
+	, _output(NO_NODE)
+	, _pool(nullptr)
+	, _compiled(false)
+	, _buffers(0)
+	, _level(nullptr)
+	, _levelFrames(0)
+{
+}
+
+PatchGraph::NodeId PatchGraph::addModule(AudioModule& module) {
+	_compiled = false;
+	_nodes.push_back(Node{&module, Processor(), {}, nullptr, {}});
+	return _nodes.size() - 1;
+}
+
+PatchGraph::NodeId PatchGraph::addSum() {
+	return addProcessor([](const float* const* inputs, size_t inputCount, float* out, size_t frames) {
+		std::fill(out, out + frames, 0.0f);
+		for (size_t i = 0; i < inputCount; ++i) {
+			for (size_t j = 0; j < frames; ++j) {
+				out[j] += inputs[i][j];
+			}
+		}
+	});
+}
+
+PatchGraph::NodeId PatchGraph::addProduct() {
+	return addProcessor([](const float* const* inputs, size_t inputCount, float* out, size_t frames) {
+		std::fill(out, out + frames, 1.0f);
+		for (size_t i = 0; i < inputCount; ++i) {
+			for (size_t j = 0; j < frames; ++j) {
+				out[j] *= inputs[i][j];
+			}
+		}
+	});
+}
+
+PatchGraph::NodeId PatchGraph::addProcessor(const Processor& processor) {
+	_compiled = false;
+	_nodes.push_back(Node{nullptr, processor, {}, nullptr, {}});
+	return _nodes.size() - 1;
+}
+
+bool PatchGraph::connect(NodeId from, NodeId to) {
+	if (from >= _nodes.size() || to >= _nodes.size()) {
+		std::cerr << "Can't connect missing node: " << std::max(from, to) << std::endl;
+		return false;
+	}
+	if (_nodes[to].module) {
+		std::cerr << "Module node " << to << " has no inputs" << std::endl;
+		return false;
+	}
+
+	_compiled = false;
+	_nodes[to].inputs.push_back(from);
+	return true;
+}
+
+void PatchGraph::setOutput(NodeId node) {
+	_compiled = false;
+	_output = node;
+}
+
+bool PatchGraph::compile() {
+	_compiled = false;
+	_levels.clear();
+	_buffers = 0;
+
+	if (_output >= _nodes.size()) {
+		std::cerr << "Patch graph has no output" << std::endl;
+		return false;
+	}
+
+	// level of each node feeding the output: one more than its deepest input.
+	// Depth-first, with nodes in progress marking cycles.
+	const size_t UNVISITED = SIZE_MAX;
+	const size_t VISITING = SIZE_MAX - 1;
+	std::vector<size_t> level(_nodes.size(), UNVISITED);
+	std::vector<std::pair<NodeId, size_t>> stack { {_output, 0} };
+	level[_output] = VISITING;
+	while (!stack.empty()) {
+		const NodeId id = stack.back().first;
+		const size_t input = stack.back().second;
+		const Node& node = _nodes[id];
+
+		if (input < node.inputs.size()) {
+			++stack.back().second;
+			const NodeId from = node.inputs[input];
+			if (level[from] == VISITING) {
+				std::cerr << "Patch graph has a cycle through node " << from << std::endl;
+				return false;
+			}
+			if (level[from] == UNVISITED) {
+				level[from] = VISITING;
+				stack.push_back({from, 0});
+			}
+			continue;
+		}
+
+		size_t l = 0;
+		for (NodeId from : node.inputs) {
+			l = std::max(l, level[from] + 1);
+		}
+		level[id] = l;
+		if (l >= _levels.size()) {
+			_levels.resize(l + 1);
+		}
+		_levels[l].push_back(id);
+		stack.pop_back();
+	}
+
+	// liveness: a block is free again after the last level reading it.
+	// The output's block stays live until the graph's output is copied.
+	std::vector<size_t> lastUse(_nodes.size(), 0);
+	for (const auto& nodes : _levels) {
+		for (NodeId id : nodes) {
+			lastUse[id] = level[id];
+			for (NodeId from : _nodes[id].inputs) {
+				lastUse[from] = std::max(lastUse[from], level[id]);
+			}
+		}
+	}
+	lastUse[_output] = _levels.size();
+
+	std::vector<std::vector<size_t>> released(_levels.size() + 1);
+	std::vector<size_t> freeBuffers;
+	std::vector<size_t> assigned(_nodes.size());
+	for (size_t l = 0; l < _levels.size(); ++l) {
+		// nodes of a level may run in parallel, so blocks read by this level
+		// only become free for the next one
+		if (l > 0) {
+			freeBuffers.insert(freeBuffers.end(), released[l - 1].begin(), released[l - 1].end());
+		}
+		for (NodeId id : _levels[l]) {
+			if (freeBuffers.empty()) {
+				assigned[id] = _buffers++;
+			}
+			else {
+				assigned[id] = freeBuffers.back();
+				freeBuffers.pop_back();
+			}
+			released[lastUse[id]].push_back(assigned[id]);
+		}
+	}
+
+	_arena.assign(_buffers * _blockFrames, 0.0f);
+	for (const auto& nodes : _levels) {
+		for (NodeId id : nodes) {
+			Node& node = _nodes[id];
+			node.buffer = &_arena[assigned[id] * _blockFrames];
+			node.inputBuffers.clear();
+			for (NodeId from : node.inputs) {
+				node.inputBuffers.push_back(&_arena[assigned[from] * _blockFrames]);
+			}
+		}
+	}
+
+	_compiled = true;
+	return true;
+}
+
+void PatchGraph::render(float* out, size_t frames) {
+	if (!_compiled && !compile()) {
+		std::fill(out, out + frames, 0.0f);
+		return;
+	}
+
+	for (size_t first = 0; first < frames; first += _blockFrames) {
+		const size_t n = std::min(_blockFrames, frames - first);
+		for (const auto& nodes : _levels) {
+			if (_pool && nodes.size() > 1) {
+				// the task only captures this, so it fits in std::function without allocating
+				_level = &nodes;
+				_levelFrames = n;
+				_pool->run(nodes.size(), [this](size_t i) { renderNode(_nodes[(*_level)[i]], _levelFrames); });
+			}
+			else {
+				for (NodeId id : nodes) {
+					renderNode(_nodes[id], n);
+				}
+			}
+		}
+		std::copy(_nodes[_output].buffer, _nodes[_output].buffer + n, out + first);
+	}
+}
+
+void PatchGraph::renderNode(Node& node, size_t frames) {
+	if (node.module) {
+		node.module->render(node.buffer, frames, _sampleRate);
+	}
+	else {
+		node.processor(node.inputBuffers.data(), node.inputBuffers.size(), node.buffer, frames);
+	}
+}
+
+} // namespace mk
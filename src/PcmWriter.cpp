@@ -0,0 +1,239 @@
+#include "PcmWriter.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+// number of samples staged in memory before they're written to the file
+constexpr size_t BUFFER_SAMPLES = 32768;
+
+} // namespace
+
+namespace mk {
+
+/// Background thread draining a bounded ring of encoded blocks into the file
+struct PcmWriter::AsyncWriter {
+	struct Block {
+		std::vector<uint8_t> data;
+		size_t size;
+	};
+
+	AsyncWriter(std::ostream& out, size_t queueDepth, size_t blockSize)
+		: _out(out)
+		, _blocks(queueDepth)
+		, _head(0)
+		, _count(0)
+		, _stop(false)
+		, _failed(false)
+	{
+		for (auto& block : _blocks) {
+			block.data.resize(blockSize);
+			block.size = 0;
+		}
+		_thread = std::thread(&AsyncWriter::run, this);
+	}
+
+	~AsyncWriter() {
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+		_cv.notify_all();
+		_thread.join();
+	}
+
+	/// Queues the first size bytes of buffer and hands back an empty
+	/// block of the same capacity in its place
+	void submit(std::vector<uint8_t>& buffer, size_t size) {
+		std::unique_lock<std::mutex> lock(_mutex);
+		_cv.wait(lock, [this] { return _count < _blocks.size(); });
+
+		// the writer thread only touches the block at the head of the queue
+		Block& block = _blocks[(_head + _count) % _blocks.size()];
+		block.data.swap(buffer);
+		block.size = size;
+		++_count;
+		_cv.notify_all();
+	}
+
+	/// Waits until all queued blocks have been written
+	void drain() {
+		std::unique_lock<std::mutex> lock(_mutex);
+		_cv.wait(lock, [this] { return _count == 0; });
+	}
+
+	bool failed() const { return _failed; }
+
+private:
+	void run() {
+		std::unique_lock<std::mutex> lock(_mutex);
+		for (;;) {
+			_cv.wait(lock, [this] { return _count > 0 || _stop; });
+			if (_count == 0)
+				return;
+
+			// write without holding the lock so the producer can keep queueing
+			const Block& block = _blocks[_head];
+			lock.unlock();
+			if (!_failed) {
+				_out.write(reinterpret_cast<const char*>(block.data.data()), block.size);
+				_failed = !_out.good();
+			}
+			lock.lock();
+
+			_head = (_head + 1) % _blocks.size();
+			--_count;
+			_cv.notify_all();
+		}
+	}
+
+	std::ostream& _out;
+	std::vector<Block> _blocks;
+	size_t _head;
+	size_t _count;
+	bool _stop;
+	std::atomic<bool> _failed;
+
+	std::mutex _mutex;
+	std::condition_variable _cv;
+	std::thread _thread;
+};
+
+PcmWriter::PcmWriter(const std::string& filePath, BitDepth bitDepth, uint16_t channels, double sampleRate)
+	: _file(filePath, std::ios::binary)
+	, _f(_file)
+	, _bitDepth(bitDepth)
+	, _channels(channels)
+	, _sampleRate(sampleRate)
+	, _samples(0)
+	, _streaming(false)
+	, _streamFrames(0)
+	, _buffer(BUFFER_SAMPLES * (bitsPerSample(bitDepth) / 8))
+	, _buffered(0)
+{
+	if (!_file.is_open()) {
+		std::cerr << "Failed to create audio file: " << filePath << std::endl;
+	}
+}
+
+PcmWriter::PcmWriter(std::ostream& out, BitDepth bitDepth, uint16_t channels, double sampleRate, uint64_t frames)
+	: _f(out)
+	, _bitDepth(bitDepth)
+	, _channels(channels)
+	, _sampleRate(sampleRate)
+	, _samples(0)
+	, _streaming(true)
+	, _streamFrames(frames)
+	, _buffer(BUFFER_SAMPLES * (bitsPerSample(bitDepth) / 8))
+	, _buffered(0)
+{
+}
+
+PcmWriter::~PcmWriter() {
+}
+
+void PcmWriter::enableAsync(size_t queueDepth) {
+	if (_async || !_f.good())
+		return;
+
+	flush();
+	_async.reset(new AsyncWriter(_f, std::max<size_t>(queueDepth, 1), _buffer.size()));
+}
+
+bool PcmWriter::good() const {
+	// while the writer thread is running, the stream's state belongs to it
+	return _async ? !_async->failed() : _f.good();
+}
+
+void PcmWriter::write(const float* frames, size_t frameCount) {
+	writeSamples(frames, frameCount * _channels);
+}
+
+void PcmWriter::write(const double* frames, size_t frameCount) {
+	writeSamples(frames, frameCount * _channels);
+}
+
+PcmWriter& PcmWriter::operator<<(double sample) {
+	writeSamples(&sample, 1);
+	return *this;
+}
+
+void PcmWriter::flush() {
+	if (_async) {
+		if (_buffered > 0) {
+			_async->submit(_buffer, _buffered);
+		}
+		_async->drain();
+	}
+	else if (_buffered > 0 && _f.good()) {
+		_f.write(reinterpret_cast<const char*>(_buffer.data()), _buffered);
+	}
+	_buffered = 0;
+}
+
+void PcmWriter::finish() {
+	// fill missing samples (if any) to complete final sample frame
+	if (_samples % _channels != 0) {
+		const size_t remainingSamples = _channels - (_samples % _channels);
+		for (size_t i = 0; i < remainingSamples; ++i) {
+			*this << 0.0;
+		}
+	}
+
+	// streams must hold exactly as many frames as their header declares
+	if (_streaming && frames() < _streamFrames) {
+		const std::vector<float> silence(BUFFER_SAMPLES);
+		const size_t silenceFrames = silence.size() / _channels;
+		while (frames() < _streamFrames && good()) {
+			write(silence.data(), std::min<uint64_t>(silenceFrames, _streamFrames - frames()));
+		}
+	}
+
+	flush();
+
+	// the file is all ours again, subclasses may now seek back to their header
+	_async.reset();
+}
+
+template<class T>
+void PcmWriter::writeSamples(const T* samples, size_t count) {
+	if (!good())
+		return;
+
+	// drop samples beyond the frame count declared in a stream's header
+	if (_streaming && _samples + count > _streamFrames * _channels) {
+		if (_samples < _streamFrames * _channels) {
+			std::cerr << "Warning: dropping samples beyond the declared " << _streamFrames << " frames" << std::endl;
+		}
+		count = _streamFrames * _channels - std::min(_samples, _streamFrames * _channels);
+	}
+
+	const size_t sampleSize = bitsPerSample(_bitDepth) / 8;
+	_samples += count;
+
+	while (count > 0) {
+		// encode as many samples as fit in the staging buffer
+		const size_t n = std::min(count, (_buffer.size() - _buffered) / sampleSize);
+		encode(samples, n, &_buffer[_buffered]);
+
+		_buffered += n * sampleSize;
+		samples += n;
+		count -= n;
+
+		if (_buffered == _buffer.size()) {
+			if (_async) {
+				_async->submit(_buffer, _buffered);
+				_buffered = 0;
+			}
+			else {
+				flush();
+			}
+		}
+	}
+}
+
+} // namespace mk
@@ -0,0 +1,465 @@
+#include "PeakIndex.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <sys/stat.h>
+
+namespace {
+
+constexpr char MAGIC[4] = { 'M', 'K', 'P', 'K' };
+constexpr uint32_t VERSION = 2;
+
+constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+constexpr uint64_t FNV_PRIME = 1099511628211ULL;
+
+uint64_t fnv1a(const char* bytes, size_t size, uint64_t hash) {
+	for (size_t i = 0; i < size; ++i) {
+		hash = (hash ^ static_cast<uint8_t>(bytes[i])) * FNV_PRIME;
+	}
+	return hash;
+}
+
+// nanoseconds of a time of a file, named st_mtim or st_mtimespec depending
+// on the platform
+#if defined(__APPLE__)
+#define MK_STAT_NANOSECONDS(status, time) ((status).st_##time##espec.tv_nsec)
+#elif defined(_WIN32)
+#define MK_STAT_NANOSECONDS(status, time) 0
+#else
+#define MK_STAT_NANOSECONDS(status, time) ((status).st_##time.tv_nsec)
+#endif
+
+/// Returns a time of a file in nanoseconds since the epoch
+int64_t nanoseconds(time_t seconds, long nanoseconds) {
+	return static_cast<int64_t>(seconds) * 1000000000 + nanoseconds;
+}
+
+template<typename T> void write(std::ostream& s, const T& value) {
+	s.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T> bool read(std::istream& s, T& value) {
+	return static_cast<bool>(s.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+// samples searched for a peak at once, so locating it reads cached samples
+constexpr size_t PEAK_CHUNK_SAMPLES = 4096;
+
+/// Returns the index of the lowest set bit of a non-zero mask
+inline size_t firstSetBit(int mask) {
+	size_t i = 0;
+	while (!(mask & 1)) {
+		mask >>= 1;
+		++i;
+	}
+	return i;
+}
+
+/// Returns the largest magnitude of count samples. The maximum instructions
+/// return their second operand when either one is NaN, so NaN samples are
+/// passed first to be ignored.
+float maxMagnitude(const float* samples, size_t count) {
+	size_t i = 0;
+	float max = 0.0f;
+
+#if defined(MK_AVX2)
+	const __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+	__m256 m0 = _mm256_setzero_ps();
+	__m256 m1 = m0, m2 = m0, m3 = m0;
+	for (; i + 32 <= count; i += 32) {
+		m0 = _mm256_max_ps(_mm256_and_ps(_mm256_loadu_ps(samples + i), mask), m0);
+		m1 = _mm256_max_ps(_mm256_and_ps(_mm256_loadu_ps(samples + i + 8), mask), m1);
+		m2 = _mm256_max_ps(_mm256_and_ps(_mm256_loadu_ps(samples + i + 16), mask), m2);
+		m3 = _mm256_max_ps(_mm256_and_ps(_mm256_loadu_ps(samples + i + 24), mask), m3);
+	}
+	for (; i + 8 <= count; i += 8) {
+		m0 = _mm256_max_ps(_mm256_and_ps(_mm256_loadu_ps(samples + i), mask), m0);
+	}
+	m0 = _mm256_max_ps(_mm256_max_ps(m0, m1), _mm256_max_ps(m2, m3));
+	__m128 m = _mm_max_ps(_mm256_castps256_ps128(m0), _mm256_extractf128_ps(m0, 1));
+	m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+	m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+	max = _mm_cvtss_f32(m);
+#elif defined(MK_SSE2)
+	const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	__m128 m0 = _mm_setzero_ps();
+	__m128 m1 = m0, m2 = m0, m3 = m0;
+	for (; i + 16 <= count; i += 16) {
+		m0 = _mm_max_ps(_mm_and_ps(_mm_loadu_ps(samples + i), mask), m0);
+		m1 = _mm_max_ps(_mm_and_ps(_mm_loadu_ps(samples + i + 4), mask), m1);
+		m2 = _mm_max_ps(_mm_and_ps(_mm_loadu_ps(samples + i + 8), mask), m2);
+		m3 = _mm_max_ps(_mm_and_ps(_mm_loadu_ps(samples + i + 12), mask), m3);
+	}
+	for (; i + 4 <= count; i += 4) {
+		m0 = _mm_max_ps(_mm_and_ps(_mm_loadu_ps(samples + i), mask), m0);
+	}
+	__m128 m = _mm_max_ps(_mm_max_ps(m0, m1), _mm_max_ps(m2, m3));
+	m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+	m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+	max = _mm_cvtss_f32(m);
+#endif
+
+	for (; i < count; ++i) {
+		const float magnitude = std::abs(samples[i]);
+		if (max < magnitude) {
+			max = magnitude;
+		}
+	}
+	return max;
+}
+
+/// Returns the index of the first of count samples of magnitude max
+size_t locate(const float* samples, size_t count, float max) {
+	size_t i = 0;
+
+#if defined(MK_AVX2)
+	const __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+	const __m256 target = _mm256_set1_ps(max);
+	for (; i + 8 <= count; i += 8) {
+		const __m256 magnitudes = _mm256_and_ps(_mm256_loadu_ps(samples + i), mask);
+		const int found = _mm256_movemask_ps(_mm256_cmp_ps(magnitudes, target, _CMP_EQ_OQ));
+		if (found)
+			return i + firstSetBit(found);
+	}
+#elif defined(MK_SSE2)
+	const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	const __m128 target = _mm_set1_ps(max);
+	for (; i + 4 <= count; i += 4) {
+		const __m128 magnitudes = _mm_and_ps(_mm_loadu_ps(samples + i), mask);
+		const int found = _mm_movemask_ps(_mm_cmpeq_ps(magnitudes, target));
+		if (found)
+			return i + firstSetBit(found);
+	}
+#endif
+
+	for (; i < count; ++i) {
+		if (std::abs(samples[i]) == max)
+			return i;
+	}
+	return count;
+}
+
+/// Merges b into a, b covering bFrames frames and a aFrames
+void merge(mk::PeakBlock& a, uint64_t aFrames, const mk::PeakBlock& b, uint64_t bFrames) {
+	const double squares = double(a.rms) * a.rms * aFrames + double(b.rms) * b.rms * bFrames;
+	a.min = std::min(a.min, b.min);
+	a.max = std::max(a.max, b.max);
+	a.rms = static_cast<float>(std::sqrt(squares / (aFrames + bFrames)));
+}
+
+} // namespace
+
+namespace mk {
+
+size_t findPeak(const float* samples, size_t count) {
+	size_t peak = 0;
+	float max = 0.0f;
+	for (size_t first = 0; first < count; first += PEAK_CHUNK_SAMPLES) {
+		const size_t n = std::min(PEAK_CHUNK_SAMPLES, count - first);
+		const float chunkMax = maxMagnitude(samples + first, n);
+		if (max < chunkMax) {
+			max = chunkMax;
+			peak = first + locate(samples + first, n, chunkMax);
+		}
+	}
+	return peak;
+}
+
+constexpr size_t FileKey::HASHED_BYTES;
+constexpr uint32_t PeakIndex::BLOCK_FRAMES;
+constexpr uint32_t PeakIndex::FAN_OUT;
+
+FileKey::FileKey()
+	: size(0)
+	, mtime(0)
+	, ctime(0)
+	, hash(0)
+{
+}
+
+bool FileKey::read(const std::string& filePath) {
+	struct stat status;
+	if (::stat(filePath.c_str(), &status) != 0)
+		return false;
+
+	std::ifstream f(filePath, std::ios::binary);
+	if (!f)
+		return false;
+
+	size = static_cast<uint64_t>(status.st_size);
+	mtime = nanoseconds(status.st_mtime, MK_STAT_NANOSECONDS(status, mtim));
+	ctime = nanoseconds(status.st_ctime, MK_STAT_NANOSECONDS(status, ctim));
+
+	// hash the head and the tail of the file, where headers and the last
+	// written samples are
+	std::vector<char> bytes(static_cast<size_t>(std::min<uint64_t>(size, HASHED_BYTES)));
+	hash = FNV_OFFSET_BASIS;
+	if (!f.read(bytes.data(), bytes.size()))
+		return false;
+	hash = fnv1a(bytes.data(), bytes.size(), hash);
+
+	const uint64_t tail = std::min<uint64_t>(size - bytes.size(), HASHED_BYTES);
+	if (tail > 0) {
+		f.seekg(static_cast<std::streamoff>(size - tail));
+		bytes.resize(static_cast<size_t>(tail));
+		if (!f.read(bytes.data(), bytes.size()))
+			return false;
+		hash = fnv1a(bytes.data(), bytes.size(), hash);
+	}
+	return true;
+}
+
+bool FileKey::operator==(const FileKey& other) const {
+	return size == other.size && mtime == other.mtime && ctime == other.ctime && hash == other.hash;
+}
+
+PeakIndex::PeakIndex()
+	: _channels(0)
+	, _frames(0)
+	, _peakFrame(0)
+	, _peakChannel(0)
+	, _peakAmplitude(0.0f)
+	, _currentFrames(0)
+{
+}
+
+std::string PeakIndex::sidecarPath(const std::string& audioFilePath) {
+	return audioFilePath + ".mkpk";
+}
+
+void PeakIndex::reset(uint16_t channels) {
+	_channels = channels;
+	_frames = 0;
+	_peakFrame = 0;
+	_peakChannel = 0;
+	_peakAmplitude = 0.0f;
+	_levels.clear();
+	_blocks.clear();
+	_current.assign(channels, PeakBlock{ std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), 0.0f });
+	_squares.assign(channels, 0.0);
+	_currentFrames = 0;
+}
+
+void PeakIndex::add(const float* samples, size_t frames) {
+	while (frames > 0) {
+		// frames of the block in progress
+		const size_t n = std::min<size_t>(frames, BLOCK_FRAMES - _currentFrames);
+		for (uint16_t j = 0; j < _channels; ++j) {
+			PeakBlock& block = _current[j];
+			double squares = _squares[j];
+			for (size_t i = 0; i < n; ++i) {
+				const float s = samples[i * _channels + j];
+				block.min = std::min(block.min, s);
+				block.max = std::max(block.max, s);
+				squares += double(s) * s;
+			}
+			_squares[j] = squares;
+		}
+
+		const size_t peak = findPeak(samples, n * _channels);
+		if (std::abs(_peakAmplitude) < std::abs(samples[peak])) {
+			_peakAmplitude = samples[peak];
+			_peakFrame = _frames + peak / _channels;
+			_peakChannel = static_cast<uint16_t>(peak % _channels);
+		}
+
+		samples += n * _channels;
+		frames -= n;
+		_frames += n;
+		_currentFrames += static_cast<uint32_t>(n);
+		if (_currentFrames == BLOCK_FRAMES) {
+			closeBlock();
+		}
+	}
+}
+
+void PeakIndex::add(const PeakIndex& next) {
+	// on equal magnitudes the first peak stays, as when adding frames
+	if (std::abs(_peakAmplitude) < std::abs(next._peakAmplitude)) {
+		_peakAmplitude = next._peakAmplitude;
+		_peakFrame = _frames + next._peakFrame;
+		_peakChannel = next._peakChannel;
+	}
+
+	if (next.valid()) {
+		_blocks.insert(_blocks.end(), next._levels[0].begin(), next._levels[0].end());
+	}
+	_frames += next._frames;
+}
+
+void PeakIndex::closeBlock() {
+	for (uint16_t j = 0; j < _channels; ++j) {
+		PeakBlock block = _current[j];
+		block.rms = static_cast<float>(std::sqrt(_squares[j] / _currentFrames));
+		_blocks.push_back(block);
+	}
+	_current.assign(_channels, PeakBlock{ std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), 0.0f });
+	_squares.assign(_channels, 0.0);
+	_currentFrames = 0;
+}
+
+void PeakIndex::finish() {
+	if (_currentFrames > 0) {
+		closeBlock();
+	}
+
+	_levels.clear();
+	_levels.push_back(std::move(_blocks));
+	_blocks.clear();
+
+	// each level up summarizes FAN_OUT blocks of the previous one, up to a
+	// single block
+	while (blocks(_levels.size() - 1) > 1) {
+		const size_t level = _levels.size() - 1;
+		const uint64_t frames = blockFrames(level);
+		const size_t count = blocks(level);
+
+		std::vector<PeakBlock> next;
+		next.reserve((count + FAN_OUT - 1) / FAN_OUT * _channels);
+		for (size_t first = 0; first < count; first += FAN_OUT) {
+			for (uint16_t j = 0; j < _channels; ++j) {
+				PeakBlock summary = block(level, first, j);
+				uint64_t summaryFrames = std::min(frames, _frames - first * frames);
+				for (size_t k = first + 1; k < std::min<size_t>(first + FAN_OUT, count); ++k) {
+					const uint64_t blockFrames = std::min(frames, _frames - k * frames);
+					merge(summary, summaryFrames, block(level, k, j), blockFrames);
+					summaryFrames += blockFrames;
+				}
+				next.push_back(summary);
+			}
+		}
+		_levels.push_back(std::move(next));
+	}
+}
+
+uint64_t PeakIndex::blockFrames(size_t level) const {
+	uint64_t frames = BLOCK_FRAMES;
+	for (size_t i = 0; i < level; ++i) {
+		frames *= FAN_OUT;
+	}
+	return frames;
+}
+
+std::vector<PeakBlock> PeakIndex::overview(uint16_t channel, uint64_t first, uint64_t frames, size_t width) const {
+	std::vector<PeakBlock> result;
+	if (!valid() || channel >= _channels || first >= _frames || width == 0)
+		return result;
+
+	frames = std::min(frames, _frames - first);
+
+	size_t level = 0;
+	while (level + 1 < levels() && blockFrames(level + 1) * width <= frames) {
+		++level;
+	}
+
+	const uint64_t size = blockFrames(level);
+	result.reserve(width);
+	for (size_t i = 0; i < width; ++i) {
+		// range of the overview block, at least a frame when zoomed in past
+		// a frame per block
+		const uint64_t start = first + frames * i / width;
+		const uint64_t end = std::max(first + frames * (i + 1) / width, start + 1);
+
+		const size_t firstBlock = static_cast<size_t>(start / size);
+		const size_t lastBlock = static_cast<size_t>((end - 1) / size);
+		PeakBlock summary = block(level, firstBlock, channel);
+		uint64_t summaryFrames = std::min(size, _frames - firstBlock * size);
+		for (size_t k = firstBlock + 1; k <= lastBlock; ++k) {
+			const uint64_t blockFrames = std::min(size, _frames - k * size);
+			merge(summary, summaryFrames, block(level, k, channel), blockFrames);
+			summaryFrames += blockFrames;
+		}
+		result.push_back(summary);
+	}
+	return result;
+}
+
+bool PeakIndex::save(const std::string& indexFilePath, const FileKey& key) const {
+	if (!valid())
+		return false;
+
+	std::ofstream f(indexFilePath, std::ios::binary | std::ios::trunc);
+	if (!f)
+		return false;
+
+	f.write(MAGIC, sizeof(MAGIC));
+	write(f, VERSION);
+	write(f, key.size);
+	write(f, key.mtime);
+	write(f, key.ctime);
+	write(f, key.hash);
+	write(f, _channels);
+	write(f, _frames);
+	write(f, _peakFrame);
+	write(f, _peakChannel);
+	write(f, _peakAmplitude);
+	write(f, static_cast<uint32_t>(_levels.size()));
+	for (const auto& level : _levels) {
+		f.write(reinterpret_cast<const char*>(level.data()), level.size() * sizeof(PeakBlock));
+	}
+	return static_cast<bool>(f);
+}
+
+bool PeakIndex::load(const std::string& indexFilePath, const FileKey& key) {
+	_levels.clear();
+
+	std::ifstream f(indexFilePath, std::ios::binary);
+	if (!f)
+		return false;
+
+	char magic[sizeof(MAGIC)];
+	uint32_t version;
+	FileKey saved;
+	if (!f.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), MAGIC)
+		|| !read(f, version) || version != VERSION
+		|| !read(f, saved.size) || !read(f, saved.mtime) || !read(f, saved.ctime) || !read(f, saved.hash) || saved != key)
+		return false;
+
+	uint16_t channels;
+	uint64_t frames;
+	uint64_t peakFrame;
+	uint16_t peakChannel;
+	float peakAmplitude;
+	uint32_t levelCount;
+	if (!read(f, channels) || !read(f, frames) || !read(f, peakFrame) || !read(f, peakChannel)
+		|| !read(f, peakAmplitude) || !read(f, levelCount) || channels == 0)
+		return false;
+
+	// level sizes follow from the number of frames, and must fit in the rest
+	// of the file, so a corrupt index can't make us allocate much
+	const std::streamoff start = f.tellg();
+	f.seekg(0, std::ios::end);
+	uint64_t remaining = static_cast<uint64_t>(f.tellg() - start);
+	f.seekg(start);
+
+	reset(channels);
+	_frames = frames;
+	std::vector<std::vector<PeakBlock>> levels;
+	for (uint32_t i = 0; i < levelCount; ++i) {
+		if (i > 0 && levels.back().size() <= channels)
+			return false;
+
+		const uint64_t size = blockFrames(i);
+		const uint64_t count = (frames + size - 1) / size * channels;
+		if (count > remaining / sizeof(PeakBlock))
+			return false;
+		remaining -= count * sizeof(PeakBlock);
+
+		std::vector<PeakBlock> level(static_cast<size_t>(count));
+		if (!f.read(reinterpret_cast<char*>(level.data()), level.size() * sizeof(PeakBlock)))
+			return false;
+		levels.push_back(std::move(level));
+	}
+	if (levels.empty() || levels.back().size() > channels)
+		return false;
+
+	_peakFrame = peakFrame;
+	_peakChannel = peakChannel;
+	_peakAmplitude = peakAmplitude;
+	_levels = std::move(levels);
+	return true;
+}
+
+} // namespace mk
@@ -0,0 +1,319 @@
+#include "Pipeline.h"
+#include "PeakIndex.h"
+#include "SinCos.h"
+#include "Util.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+namespace {
+
+std::pair<double, double> constPowerPanPos(double position) {
+	position = mk::clamp(position, -1.0, 1.0);
+	constexpr double SQRT_2_OVER_2 = 0.707106781186548;
+
+	// the angle is position * PI / 4, an eighth of a cycle
+	const float angle = static_cast<float>(position / 8.0);
+	float s, c;
+	mk::sinCosCycles(&angle, 1, &s, &c);
+	return std::make_pair(SQRT_2_OVER_2 * (s - c), SQRT_2_OVER_2 * (s + c));
+}
+
+} // namespace
+
+namespace mk {
+
+bool Stage::prepare(uint16_t, uint32_t) {
+	return true;
+}
+
+void Stage::analyze(const float*, size_t, uint16_t) {
+}
+
+bool Stage::analyze(const PeakIndex&) {
+	return false;
+}
+
+GainStage::GainStage(double gain)
+	: _ratio(loudnessToAmplitude(gain))
+{
+}
+
+void GainStage::process(float* samples, size_t frames, uint16_t channels) {
+	const size_t count = frames * channels;
+	for (size_t i = 0; i < count; ++i) {
+		samples[i] *= _ratio;
+	}
+}
+
+ClampStage::ClampStage(double min, double max)
+	: _min(min)
+	, _max(max)
+{
+}
+
+void ClampStage::process(float* samples, size_t frames, uint16_t channels) {
+	const size_t count = frames * channels;
+	for (size_t i = 0; i < count; ++i) {
+		samples[i] = clamp<double>(samples[i], _min, _max);
+	}
+}
+
+void InvertStage::process(float* samples, size_t frames, uint16_t channels) {
+	const size_t count = frames * channels;
+	for (size_t i = 0; i < count; ++i) {
+		samples[i] *= -1.0;
+	}
+}
+
+PanStage::PanStage(double position) {
+	const auto pannedStereoField = constPowerPanPos(position);
+	_left = pannedStereoField.first;
+	_right = pannedStereoField.second;
+}
+
+bool PanStage::prepare(uint16_t channels, uint32_t) {
+	if (channels != 2) {
+		std::cerr << "Panning needs a stereo input, not " << channels << " channel(s)" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void PanStage::process(float* samples, size_t frames, uint16_t) {
+	for (size_t i = 0; i < 2 * frames; i += 2) {
+		samples[i] *= _left;
+		samples[i + 1] *= _right;
+	}
+}
+
+AutomationStage::AutomationStage(const Automation& automation)
+	: _automation(automation)
+	, _frame(0)
+	, _breakpoint(0)
+{
+}
+
+bool AutomationStage::prepare(uint16_t, uint32_t sampleRate) {
+	const auto& breakpoints = _automation.breakpoints();
+	if (breakpoints.empty()) {
+		std::cerr << "Automation has no breakpoints" << std::endl;
+		return false;
+	}
+
+	_positions.clear();
+	for (const auto& breakpoint : breakpoints) {
+		if (!std::isfinite(breakpoint.time) || (!_positions.empty() && breakpoint.time * sampleRate < _positions.back())) {
+			std::cerr << "Incorrect automation breakpoint time: " << breakpoint.time << ", times must be finite and not decrease" << std::endl;
+			return false;
+		}
+		_positions.push_back(breakpoint.time * sampleRate);
+	}
+
+	rewind();
+	return true;
+}
+
+void AutomationStage::rewind() {
+	_frame = 0;
+	_breakpoint = 0;
+}
+
+Ramp AutomationStage::nextRamp(size_t frames) {
+	const auto& breakpoints = _automation.breakpoints();
+	const double frame = static_cast<double>(_frame);
+
+	// the last breakpoint at or before the frame
+	while (_breakpoint + 1 < _positions.size() && _positions[_breakpoint + 1] <= frame) {
+		++_breakpoint;
+	}
+
+	Ramp ramp;
+	if (frame < _positions[0]) {
+		// hold the first value until the first breakpoint
+		ramp = Ramp{ static_cast<size_t>(std::min<double>(frames, std::ceil(_positions[0]) - frame)), 0.0, 1.0, breakpoints[0].value, breakpoints[0].value };
+	}
+	else if (_breakpoint + 1 == _positions.size()) {
+		// hold the last value
+		ramp = Ramp{ frames, 0.0, 1.0, breakpoints.back().value, breakpoints.back().value };
+	}
+	else {
+		const double next = _positions[_breakpoint + 1];
+		ramp.frames = static_cast<size_t>(std::min<double>(frames, std::ceil(next) - frame));
+		ramp.offset = frame - _positions[_breakpoint];
+		ramp.length = next - _positions[_breakpoint];
+		ramp.from = breakpoints[_breakpoint].value;
+		ramp.to = breakpoints[_breakpoint + 1].value;
+	}
+
+	_frame += ramp.frames;
+	return ramp;
+}
+
+GainAutomationStage::GainAutomationStage(const Automation& gain)
+	: AutomationStage(gain)
+{
+}
+
+bool GainAutomationStage::prepare(uint16_t channels, uint32_t sampleRate) {
+	for (const auto& breakpoint : _automation.breakpoints()) {
+		if (std::isnan(breakpoint.value) || breakpoint.value == std::numeric_limits<double>::infinity()) {
+			std::cerr << "Incorrect gain: " << breakpoint.value << ", gains must be finite or -inf dB" << std::endl;
+			return false;
+		}
+	}
+	return AutomationStage::prepare(channels, sampleRate);
+}
+
+void GainAutomationStage::process(float* samples, size_t frames, uint16_t channels) {
+	for (size_t done = 0; done < frames;) {
+		const Ramp ramp = nextRamp(frames - done);
+		const double from = loudnessToAmplitude(ramp.from);
+		const double to = loudnessToAmplitude(ramp.to);
+
+		// gain of the first frame, multiplied by ratio or increased by step
+		// at each frame
+		double gain;
+		double ratio = 1.0;
+		double step = 0.0;
+		if (ramp.from == ramp.to) {
+			gain = from;
+		}
+		else if (from == 0.0 || to == 0.0) {
+			step = (to - from) / ramp.length;
+			gain = from + step * ramp.offset;
+		}
+		else {
+			const double slope = (ramp.to - ramp.from) / ramp.length;
+			gain = loudnessToAmplitude(ramp.from + slope * ramp.offset);
+			ratio = loudnessToAmplitude(slope);
+		}
+
+		float* frame = samples + done * channels;
+		for (size_t i = 0; i < ramp.frames; ++i, frame += channels) {
+			for (uint16_t j = 0; j < channels; ++j) {
+				frame[j] *= gain;
+			}
+			gain = gain * ratio + step;
+		}
+		done += ramp.frames;
+	}
+}
+
+PanAutomationStage::PanAutomationStage(const Automation& positions)
+	: AutomationStage(positions)
+{
+}
+
+bool PanAutomationStage::prepare(uint16_t channels, uint32_t sampleRate) {
+	if (channels != 2) {
+		std::cerr << "Panning needs a stereo input, not " << channels << " channel(s)" << std::endl;
+		return false;
+	}
+
+	for (const auto& breakpoint : _automation.breakpoints()) {
+		if (!(breakpoint.value >= -1.0 && breakpoint.value <= 1.0)) {
+			std::cerr << "Incorrect pan position: " << breakpoint.value << ", positions range from -1.0 to 1.0" << std::endl;
+			return false;
+		}
+	}
+	return AutomationStage::prepare(channels, sampleRate);
+}
+
+void PanAutomationStage::process(float* samples, size_t frames, uint16_t) {
+	// the angle of a position is position * PI / 4
+	constexpr double PI_OVER_4 = 0.785398163397448;
+
+	for (size_t done = 0; done < frames;) {
+		const Ramp ramp = nextRamp(frames - done);
+		const double slope = (ramp.to - ramp.from) / ramp.length;
+		const auto pannedStereoField = constPowerPanPos(ramp.from + slope * ramp.offset);
+		double left = pannedStereoField.first;
+		double right = pannedStereoField.second;
+
+		// moving by slope, the angle turns by a constant angle per frame, so
+		// do the gains of the channels, (s - c) and (s + c) scaled by sqrt(2) / 2
+		const double c = std::cos(slope * PI_OVER_4);
+		const double s = std::sin(slope * PI_OVER_4);
+
+		float* frame = samples + 2 * done;
+		for (size_t i = 0; i < ramp.frames; ++i, frame += 2) {
+			frame[0] *= left;
+			frame[1] *= right;
+			const double nextLeft = left * c + right * s;
+			right = right * c - left * s;
+			left = nextLeft;
+		}
+		done += ramp.frames;
+	}
+}
+
+NormalizeStage::NormalizeStage(double peakLoudness)
+	: _peakLoudness(peakLoudness)
+	, _max(0.0f)
+{
+}
+
+bool NormalizeStage::prepare(uint16_t, uint32_t) {
+	if (_peakLoudness > 0.0) {
+		std::cerr << "Peak value is out of range: " << _peakLoudness << ", max peak value is 0 dB" << std::endl;
+		return false;
+	}
+
+	_max = 0.0f;
+	return true;
+}
+
+void NormalizeStage::analyze(const float* samples, size_t frames, uint16_t channels) {
+	const size_t count = frames * channels;
+	for (size_t i = 0; i < count; ++i) {
+		_max = std::max(_max, std::abs(samples[i]));
+	}
+}
+
+bool NormalizeStage::analyze(const PeakIndex& index) {
+	_max = std::abs(index.peakAmplitude());
+	return true;
+}
+
+void NormalizeStage::process(float* samples, size_t frames, uint16_t channels) {
+	// silence stays silent
+	if (_max == 0.0f)
+		return;
+
+	const float peakAmplitude = clamp(loudnessToAmplitude(_peakLoudness), 0.0, 1.0);
+	const double gain = peakAmplitude / static_cast<double>(_max);
+	const size_t count = frames * channels;
+	for (size_t i = 0; i < count; ++i) {
+		samples[i] *= gain;
+	}
+}
+
+Pipeline& Pipeline::add(std::unique_ptr<Stage> stage) {
+	_stages.push_back(std::move(stage));
+	return *this;
+}
+
+bool Pipeline::prepare(uint16_t channels, uint32_t sampleRate) {
+	for (auto& stage : _stages) {
+		if (!stage->prepare(channels, sampleRate))
+			return false;
+	}
+	return true;
+}
+
+void Pipeline::rewind() {
+	for (auto& stage : _stages) {
+		stage->rewind();
+	}
+}
+
+void Pipeline::process(float* samples, size_t frames, uint16_t channels, size_t first, size_t last) {
+	last = std::min(last, _stages.size());
+	for (size_t i = first; i < last; ++i) {
+		_stages[i]->process(samples, frames, channels);
+	}
+}
+
+} // namespace mk
@@ -0,0 +1,139 @@
+#include "RenderEngine.h"
+#include <algorithm>
+#include <iostream>
+
+namespace mk {
+
+RenderEngine::RenderEngine(size_t bufferFrames, double sampleRate, size_t queueCapacity)
+	: _sampleRate(sampleRate)
+	, _period(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(bufferFrames / sampleRate)))
+	, _buffer(bufferFrames)
+	, _changes(queueCapacity)
+	, _stopping(false)
+	, _blockLogCapacity(0)
+{
+	resetStats();
+}
+
+RenderEngine::~RenderEngine() {
+	stop();
+}
+
+bool RenderEngine::set(double* parameter, double value) {
+	return _changes.push(ParameterChange{parameter, value});
+}
+
+void RenderEngine::enableBlockLog(size_t blocks) {
+	_blockLog.clear();
+	_blockLog.reserve(blocks);
+	_blockLogCapacity = blocks;
+}
+
+void RenderEngine::run(uint64_t blocks, bool paced) {
+	if (running()) {
+		std::cerr << "Render engine is already running" << std::endl;
+		return;
+	}
+
+	_stopping = false;
+	renderBlocks(blocks, paced);
+}
+
+void RenderEngine::start() {
+	if (running())
+		return;
+
+	_stopping = false;
+	_thread = std::thread(&RenderEngine::renderBlocks, this, UINT64_MAX, true);
+}
+
+void RenderEngine::stop() {
+	_stopping = true;
+	if (_thread.joinable()) {
+		_thread.join();
+	}
+}
+
+RenderStats RenderEngine::stats() const {
+	// counters are read first, so the average may include a block more
+	RenderStats stats;
+	stats.blocks = _blocks;
+	stats.deadlineMisses = _deadlineMisses;
+	stats.periodSeconds = std::chrono::duration<double>(_period).count();
+	stats.lastRenderSeconds = _lastRenderSeconds;
+	stats.averageRenderSeconds = stats.blocks ? _totalRenderSeconds / stats.blocks : 0.0;
+	stats.worstRenderSeconds = _worstRenderSeconds;
+	stats.worstLatencySeconds = _worstLatencySeconds;
+	return stats;
+}
+
+void RenderEngine::resetStats() {
+	_blocks = 0;
+	_deadlineMisses = 0;
+	_lastRenderSeconds = 0.0;
+	_totalRenderSeconds = 0.0;
+	_worstRenderSeconds = 0.0;
+	_worstLatencySeconds = 0.0;
+	_blockLog.clear();
+}
+
+void RenderEngine::renderBlocks(uint64_t count, bool paced) {
+	Clock::time_point due = Clock::now();
+	for (uint64_t i = 0; i < count && !_stopping; ++i) {
+		if (paced) {
+			// the device asks for the next buffer
+			std::this_thread::sleep_until(due);
+		}
+		else {
+			due = Clock::now();
+		}
+
+		renderBlock(due);
+
+		// after a missed deadline the device has glitched and asks for the
+		// next buffer at once, rather than for all the buffers it missed
+		due += _period;
+		if (paced) {
+			due = std::max(due, Clock::now());
+		}
+	}
+}
+
+void RenderEngine::renderBlock(Clock::time_point due) {
+	const Clock::time_point start = Clock::now();
+
+	ParameterChange change;
+	while (_changes.pop(change)) {
+		*change.parameter = change.value;
+	}
+
+	if (_callback) {
+		_callback(_buffer.data(), _buffer.size());
+	}
+	else {
+		std::fill(_buffer.begin(), _buffer.end(), 0.0f);
+	}
+
+	const Clock::time_point done = Clock::now();
+	const double renderSeconds = std::chrono::duration<double>(done - start).count();
+	const double latencySeconds = std::chrono::duration<double>(done - due).count();
+
+	_lastRenderSeconds = renderSeconds;
+	_totalRenderSeconds = _totalRenderSeconds + renderSeconds;
+	_worstRenderSeconds = std::max<double>(_worstRenderSeconds, renderSeconds);
+	_worstLatencySeconds = std::max<double>(_worstLatencySeconds, latencySeconds);
+	if (done > due + _period) {
+		++_deadlineMisses;
+	}
+	if (_blockLog.size() < _blockLogCapacity) {
+		_blockLog.push_back(static_cast<float>(renderSeconds));
+	}
+	++_blocks;
+
+	// the device consumes the block, outside of the measured render
+	if (_sink) {
+		_sink(_buffer.data(), _buffer.size());
+	}
+}
+
+} // namespace mk
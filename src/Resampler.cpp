@@ -0,0 +1,266 @@
+#include "Resampler.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+constexpr double PI = 3.141592653589793;
+
+// filter taps are processed in pairs of AVX registers, with independent sums
+constexpr size_t TAP_ALIGNMENT = 16;
+
+struct QualityPreset {
+	// fraction of the band kept intact
+	double passband;
+	// stopband attenuation in dB
+	double attenuation;
+};
+
+QualityPreset preset(mk::ResamplerQuality quality) {
+	switch (quality) {
+	case mk::ResamplerQuality::Fast:
+		return {0.85, 60.0};
+	case mk::ResamplerQuality::Best:
+		return {0.95, 120.0};
+	default:
+		return {0.90, 90.0};
+	}
+}
+
+uint64_t gcd(uint64_t a, uint64_t b) {
+	while (b) {
+		const uint64_t r = a % b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
+
+// Zeroth-order modified Bessel function of the first kind, for the Kaiser window
+double besselI0(double x) {
+	double sum = 1.0;
+	double term = 1.0;
+	for (int k = 1; k < 50; ++k) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+		if (term < sum * 1.0e-17)
+			break;
+	}
+	return sum;
+}
+
+double sinc(double x) {
+	return x == 0.0 ? 1.0 : ::sin(PI * x) / (PI * x);
+}
+
+// Inner product of count floats, count being a multiple of TAP_ALIGNMENT
+float dot(const float* a, const float* b, size_t count) {
+#if defined(MK_AVX2)
+	__m256 sum0 = _mm256_setzero_ps();
+	__m256 sum1 = _mm256_setzero_ps();
+	for (size_t i = 0; i < count; i += 16) {
+		sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+		sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+	}
+	const __m256 sum = _mm256_add_ps(sum0, sum1);
+	const __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+#elif defined(MK_SSE2)
+	__m128 sum0 = _mm_setzero_ps();
+	__m128 sum1 = _mm_setzero_ps();
+	__m128 sum2 = _mm_setzero_ps();
+	__m128 sum3 = _mm_setzero_ps();
+	for (size_t i = 0; i < count; i += 16) {
+		sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+		sum2 = _mm_add_ps(sum2, _mm_mul_ps(_mm_loadu_ps(a + i + 8), _mm_loadu_ps(b + i + 8)));
+		sum3 = _mm_add_ps(sum3, _mm_mul_ps(_mm_loadu_ps(a + i + 12), _mm_loadu_ps(b + i + 12)));
+	}
+	const __m128 half = _mm_add_ps(_mm_add_ps(sum0, sum1), _mm_add_ps(sum2, sum3));
+#endif
+
+#if defined(MK_SSE2)
+	const __m128 quarter = _mm_add_ps(half, _mm_movehl_ps(half, half));
+	return _mm_cvtss_f32(_mm_add_ss(quarter, _mm_shuffle_ps(quarter, quarter, 1)));
+#else
+	float sum = 0.0f;
+	for (size_t i = 0; i < count; ++i) {
+		sum += a[i] * b[i];
+	}
+	return sum;
+#endif
+}
+
+} // namespace
+
+namespace mk {
+
+constexpr uint32_t Resampler::MAX_PHASES;
+
+Resampler::Resampler(uint32_t inputRate, uint32_t outputRate, uint16_t channels, ResamplerQuality quality)
+	: _inputRate(std::max<uint32_t>(inputRate, 1))
+	, _outputRate(std::max<uint32_t>(outputRate, 1))
+	, _channels(std::max<uint16_t>(channels, 1))
+	, _historyCapacity(0)
+{
+	const uint64_t divisor = gcd(_inputRate, _outputRate);
+	_up = _outputRate / divisor;
+	_down = _inputRate / divisor;
+	_step = static_cast<size_t>(_down / _up);
+	_remainder = _down % _up;
+	_phases = static_cast<uint32_t>(std::min<uint64_t>(_up, MAX_PHASES));
+
+	// Kaiser window design: the transition band goes from the passband edge
+	// to the Nyquist frequency of the lower rate, in radians per input sample
+	const QualityPreset q = preset(quality);
+	const double band = std::min(1.0, static_cast<double>(_outputRate) / _inputRate);
+	const double transition = (1.0 - q.passband) * band * PI;
+	const double beta = 0.1102 * (q.attenuation - 8.7);
+	_taps = static_cast<size_t>(::ceil((q.attenuation - 7.95) / (2.285 * transition))) + 1;
+	_taps += _taps % 2;
+	_stride = (_taps + TAP_ALIGNMENT - 1) / TAP_ALIGNMENT * TAP_ALIGNMENT;
+
+	// each row interpolates at its fractional position between the input
+	// frames under the middle of the filter, and has unit gain at DC
+	const double cutoff = band * (1.0 + q.passband) / 2.0;
+	const double halfLength = _taps / 2.0;
+	const double windowScale = 1.0 / besselI0(beta);
+	_bank.assign((_phases + 1) * _stride, 0.0f);
+	for (uint32_t p = 0; p <= _phases; ++p) {
+		const double position = static_cast<double>(p) / _phases;
+		std::vector<double> row(_taps);
+		double sum = 0.0;
+		for (size_t k = 0; k < _taps; ++k) {
+			const double t = position + halfLength - 1.0 - k;
+			const double x = t / halfLength;
+			const double window = std::abs(x) < 1.0 ? besselI0(beta * ::sqrt(1.0 - x * x)) * windowScale : 0.0;
+			row[k] = cutoff * sinc(cutoff * t) * window;
+			sum += row[k];
+		}
+		for (size_t k = 0; k < _taps; ++k) {
+			_bank[p * _stride + k] = static_cast<float>(row[k] / sum);
+		}
+	}
+
+	reset();
+}
+
+size_t Resampler::maxOutputFrames(size_t inputFrames) const {
+	return static_cast<size_t>((inputFrames + _taps) * _up / _down) + 1;
+}
+
+uint64_t Resampler::outputFrames(uint64_t inputFrames) const {
+	return (inputFrames * _up + _down - 1) / _down;
+}
+
+void Resampler::reset() {
+	// the first output frame is centered on the first input frame
+	_historyFrames = 0;
+	_index = 0;
+	_phase = 0;
+	_inputFrames = 0;
+	_outputFrames = 0;
+	append(nullptr, _taps / 2 - 1, true);
+}
+
+size_t Resampler::process(const float* in, size_t inputFrames, float* out) {
+	_inputFrames += inputFrames;
+	if (_up == _down) {
+		std::copy(in, in + inputFrames * _channels, out);
+		_outputFrames += inputFrames;
+		return inputFrames;
+	}
+
+	append(in, inputFrames, false);
+	return produce(out, UINT64_MAX);
+}
+
+size_t Resampler::flush(float* out) {
+	if (_up == _down)
+		return 0;
+
+	// silence past the end fills the filters of the last output frames
+	append(nullptr, _taps / 2, true);
+	return produce(out, outputFrames(_inputFrames));
+}
+
+size_t Resampler::produce(float* out, uint64_t limit) {
+	size_t n = 0;
+	for (; _outputFrames < limit && _index + _taps <= _historyFrames; ++n, ++_outputFrames) {
+		for (uint16_t c = 0; c < _channels; ++c) {
+			const float* x = &_history[c * _historyCapacity + _index];
+			float sample;
+			if (_phases == _up) {
+				sample = dot(x, &_bank[_phase * _stride], _stride);
+			}
+			else {
+				// between the two nearest rows of a bank coarser than the ratio
+				const double position = static_cast<double>(_phase) * _phases / _up;
+				const size_t row = static_cast<size_t>(position);
+				const float weight = static_cast<float>(position - row);
+				const float a = dot(x, &_bank[row * _stride], _stride);
+				const float b = dot(x, &_bank[(row + 1) * _stride], _stride);
+				sample = a + weight * (b - a);
+			}
+			out[n * _channels + c] = sample;
+		}
+
+		// advance by _down / _up input frames without dividing
+		_index += _step;
+		_phase += _remainder;
+		if (_phase >= _up) {
+			_phase -= _up;
+			++_index;
+		}
+	}
+
+	// drop the frames no output needs anymore
+	const size_t consumed = std::min(_index, _historyFrames);
+	if (consumed > 0) {
+		for (uint16_t c = 0; c < _channels; ++c) {
+			float* h = &_history[c * _historyCapacity];
+			std::memmove(h, h + consumed, (_historyFrames - consumed) * sizeof(float));
+		}
+		_historyFrames -= consumed;
+		_index -= consumed;
+	}
+	return n;
+}
+
+void Resampler::append(const float* in, size_t frames, bool silence) {
+	// frames that a large step down skips entirely are never stored
+	const size_t skipped = _historyFrames == 0 ? std::min(_index, frames) : 0;
+	_index -= skipped;
+	frames -= skipped;
+	if (in) {
+		in += skipped * _channels;
+	}
+
+	// filters read up to a register past the last frame, as zero coefficients
+	const size_t needed = _historyFrames + frames + _stride;
+	if (needed > _historyCapacity) {
+		const size_t capacity = std::max(needed, 2 * _historyCapacity);
+		std::vector<float> history(_channels * capacity, 0.0f);
+		for (uint16_t c = 0; c < _channels && _historyFrames > 0; ++c) {
+			std::copy(&_history[c * _historyCapacity], &_history[c * _historyCapacity] + _historyFrames, &history[c * capacity]);
+		}
+		_history.swap(history);
+		_historyCapacity = capacity;
+	}
+
+	for (uint16_t c = 0; c < _channels; ++c) {
+		float* h = &_history[c * _historyCapacity + _historyFrames];
+		if (silence) {
+			std::fill(h, h + frames, 0.0f);
+		}
+		else {
+			for (size_t f = 0; f < frames; ++f) {
+				h[f] = in[f * _channels + c];
+			}
+		}
+	}
+	_historyFrames += frames;
+}
+
+} // namespace mk
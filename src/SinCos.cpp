@@ -0,0 +1,140 @@
+#include "SinCos.h"
+#include "SinCosKernels.h"
+#include <algorithm>
+
+namespace {
+
+using namespace mk::sincos;
+
+// Adding and subtracting 1.5 * 2^52 rounds doubles below 2^51 to the nearest integer
+constexpr double ROUND_MAGIC_DOUBLE = 6755399441055744.0;
+
+// phases reduced in double precision at once by sinCyclesRamp()
+constexpr size_t RAMP_CHUNK = 256;
+
+void sinCos(const float* phases, size_t count, float* sines, float* cosines, size_t i) {
+	for (; i < count; ++i) {
+		sinCosPhase(phases[i], sines ? sines + i : nullptr, cosines ? cosines + i : nullptr);
+	}
+}
+
+void sinQuadrants(const float* offsets, const float* quadrants, size_t count, float* out, size_t i) {
+	for (; i < count; ++i) {
+		sinCosQuadrant(offsets[i], static_cast<int32_t>(quadrants[i]), out + i, nullptr);
+	}
+}
+
+#if defined(MK_AVX2)
+
+size_t sinCosKernel(const float* phases, size_t count, float* sines, float* cosines) {
+	const __m256 magic = _mm256_set1_ps(ROUND_MAGIC);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m256 x = _mm256_loadu_ps(phases + i);
+		const __m256 q = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(4.0f)), magic), magic);
+		const __m256 f = _mm256_sub_ps(x, _mm256_mul_ps(q, _mm256_set1_ps(0.25f)));
+
+		// only the requested outputs are computed
+		__m256 s = _mm256_setzero_ps();
+		__m256 c = _mm256_setzero_ps();
+		sinCosQuadrant8(f, _mm256_cvtps_epi32(q), sines ? &s : nullptr, cosines ? &c : nullptr);
+		if (sines) {
+			_mm256_storeu_ps(sines + i, s);
+		}
+		if (cosines) {
+			_mm256_storeu_ps(cosines + i, c);
+		}
+	}
+	return i;
+}
+
+size_t sinQuadrantsKernel(const float* offsets, const float* quadrants, size_t count, float* out) {
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m256i q = _mm256_cvtps_epi32(_mm256_loadu_ps(quadrants + i));
+		__m256 s;
+		sinCosQuadrant8(_mm256_loadu_ps(offsets + i), q, &s, nullptr);
+		_mm256_storeu_ps(out + i, s);
+	}
+	return i;
+}
+
+#elif defined(MK_SSE2)
+
+size_t sinCosKernel(const float* phases, size_t count, float* sines, float* cosines) {
+	const __m128 magic = _mm_set1_ps(ROUND_MAGIC);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const __m128 x = _mm_loadu_ps(phases + i);
+		const __m128 q = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(4.0f)), magic), magic);
+		const __m128 f = _mm_sub_ps(x, _mm_mul_ps(q, _mm_set1_ps(0.25f)));
+
+		// only the requested outputs are computed
+		__m128 s = _mm_setzero_ps();
+		__m128 c = _mm_setzero_ps();
+		sinCosQuadrant4(f, _mm_cvtps_epi32(q), sines ? &s : nullptr, cosines ? &c : nullptr);
+		if (sines) {
+			_mm_storeu_ps(sines + i, s);
+		}
+		if (cosines) {
+			_mm_storeu_ps(cosines + i, c);
+		}
+	}
+	return i;
+}
+
+size_t sinQuadrantsKernel(const float* offsets, const float* quadrants, size_t count, float* out) {
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const __m128i q = _mm_cvtps_epi32(_mm_loadu_ps(quadrants + i));
+		__m128 s;
+		sinCosQuadrant4(_mm_loadu_ps(offsets + i), q, &s, nullptr);
+		_mm_storeu_ps(out + i, s);
+	}
+	return i;
+}
+
+#else
+
+size_t sinCosKernel(const float*, size_t, float*, float*) {
+	return 0;
+}
+
+size_t sinQuadrantsKernel(const float*, const float*, size_t, float*) {
+	return 0;
+}
+
+#endif
+
+} // namespace
+
+namespace mk {
+
+void sinCycles(const float* phases, size_t count, float* out) {
+	sinCos(phases, count, out, nullptr, sinCosKernel(phases, count, out, nullptr));
+}
+
+void sinCosCycles(const float* phases, size_t count, float* sines, float* cosines) {
+	sinCos(phases, count, sines, cosines, sinCosKernel(phases, count, sines, cosines));
+}
+
+void sinCyclesRamp(double start, double increment, size_t count, float* out) {
+	float offsets[RAMP_CHUNK];
+	float quadrants[RAMP_CHUNK];
+
+	for (size_t first = 0; first < count; first += RAMP_CHUNK) {
+		const size_t n = std::min(RAMP_CHUNK, count - first);
+
+		// split phases into quadrants and offsets before they're rounded to floats
+		for (size_t i = 0; i < n; ++i) {
+			const double x = start + (first + i) * increment;
+			const double q = (4.0 * x + ROUND_MAGIC_DOUBLE) - ROUND_MAGIC_DOUBLE;
+			offsets[i] = static_cast<float>(x - 0.25 * q);
+			quadrants[i] = static_cast<float>(q);
+		}
+
+		sinQuadrants(offsets, quadrants, n, out + first, sinQuadrantsKernel(offsets, quadrants, n, out + first));
+	}
+}
+
+} // namespace mk
@@ -1,21 +1,73 @@
 #include "Synthesis.h"
 #include "AIFF.h"
+#include "SinCos.h"
+#include <algorithm>
 #include <iostream>
 #include <cmath>
+#include <cstdio>
+#include <limits>
 
 namespace {
 
-constexpr float PI = 3.141592653589793;
-constexpr float PIx2 = 2.0 * PI;
+constexpr double PI = 3.141592653589793;
+constexpr double PIx2 = 2.0 * PI;
 constexpr double SILENCE = 1.0e-4; // ~-80dB
 constexpr double MAX_DURATION_SECONDS = 3600.0;
 
+// bytes of text formatted before they're written, and longest formatted line
+constexpr size_t TEXT_BLOCK_SIZE = 64 * 1024;
+constexpr size_t MAX_LINE_SIZE = 128;
+
+// Advances a position in [0;1) by a number of cycles
+// Wraps a position in cycles into [0;1), in both directions since negative
+// frequencies run through the cycle backwards. Tiny negative positions round
+// up to 1.0 once wrapped, which is the start of the next cycle.
+double wrapCycle(double cycle) {
+	cycle -= ::floor(cycle);
+	return cycle < 1.0 ? cycle : 0.0;
+}
+
+double advanceCycle(double cycle, double cycles) {
+	return wrapCycle(cycle + cycles);
+}
+
+// Exponential curve from one level to another, offset + base * ratio^x for x
+// in [0;1]: the offset places the curve's end nearest to it SILENCE away
+struct Curve {
+	double offset;
+	double base;
+	double ratio;
+};
+
+Curve exponentialCurve(double from, double to) {
+	const double max = std::abs(to - from) + SILENCE;
+	const double offset = std::min(from, to) - SILENCE;
+	if (from > to) {
+		return {offset, max, SILENCE / max};
+	}
+	return {offset, SILENCE, max / SILENCE};
+}
+
 }
 
 namespace mk {
 
+void AudioModule::render(float* out, size_t frames, double sampleRate) {
+	// times are computed from the frame count rather than accumulated,
+	// so they don't drift
+	for (size_t i = 0; i < frames; ++i) {
+		out[i] = static_cast<float>((*this)((_renderedFrames + i) / sampleRate));
+	}
+	_renderedFrames += frames;
+}
+
+void AudioModule::reset() {
+	_renderedFrames = 0;
+}
+
 SineWave::SineWave(double frequency)
 	: _frequency(frequency)
+	, _cycle(0.0)
 {
 }
 
@@ -23,12 +75,26 @@ double SineWave::operator()(double time) const {
 	return ::sin(_frequency * PIx2 * time);
 }
 
+void SineWave::render(float* out, size_t frames, double sampleRate) {
+	const double increment = _frequency / sampleRate;
+	sinCyclesRamp(_cycle, increment, frames, out);
+
+	_cycle = advanceCycle(_cycle, frames * increment);
+	_renderedFrames += frames;
+}
+
+void SineWave::reset() {
+	AudioModule::reset();
+	_cycle = 0.0;
+}
+
 SawWave::SawWave(double frequency)
 	: _frequency(frequency)
 	, _amplitude(1.0)
 	, _offset(0.0)
 	, _phase(0.0)
 	, _polarity(1.0)
+	, _cycle(0.0)
 {
 }
 
@@ -37,39 +103,203 @@ double SawWave::operator()(double time) const {
 	return _polarity * 2.0 * _amplitude * (_frequency * (time + _phase) - 0.5) + _offset;
 }
 
+void SawWave::render(float* out, size_t frames, double sampleRate) {
+	const double increment = _frequency / sampleRate;
+
+	// same as operator(): a ramp over each cycle shifted by the phase
+	const double gain = _polarity * 2.0 * _amplitude;
+	const double bias = gain * (_frequency * _phase - 0.5) + _offset;
+
+	double cycle = _cycle;
+	for (size_t i = 0; i < frames; ++i) {
+		out[i] = static_cast<float>(gain * cycle + bias);
+
+		cycle += increment;
+		if (cycle >= 1.0 || cycle < 0.0) {
+			cycle = wrapCycle(cycle);
+		}
+	}
+
+	// resynchronize with the exact position, like the sine's phase
+	_cycle = advanceCycle(_cycle, frames * increment);
+	_renderedFrames += frames;
+}
+
+void SawWave::reset() {
+	AudioModule::reset();
+	_cycle = 0.0;
+}
+
+constexpr size_t Envelope::NO_SUSTAIN;
+
+Envelope::Envelope(double startLevel, const std::vector<Breakpoint>& breakpoints, size_t sustain)
+	: _startLevel(startLevel)
+	, _breakpoints(breakpoints)
+	, _sustain(sustain)
+{
+	reset();
+}
+
+double Envelope::operator()(double time) const {
+	double from = _startLevel;
+	if (time <= 0)
+		return from;
+
+	for (size_t i = 0; i < _breakpoints.size(); ++i) {
+		const Breakpoint& breakpoint = _breakpoints[i];
+		if (time < breakpoint.duration) {
+			const Curve curve = exponentialCurve(from, breakpoint.level);
+			return curve.offset + curve.base * ::pow(curve.ratio, time / breakpoint.duration);
+		}
+
+		time -= breakpoint.duration;
+		from = breakpoint.level;
+		if (i == _sustain)
+			break;
+	}
+	return from;
+}
+
+void Envelope::render(float* out, size_t frames, double sampleRate) {
+	process<false>(out, frames, sampleRate);
+}
+
+void Envelope::apply(float* samples, size_t frames, double sampleRate) {
+	process<true>(samples, frames, sampleRate);
+}
+
+void Envelope::reset() {
+	AudioModule::reset();
+	_released = false;
+	restart(0, _startLevel);
+}
+
+void Envelope::trigger() {
+	_released = false;
+	restart(0, level());
+}
+
+void Envelope::release() {
+	if (_sustain >= _breakpoints.size() || _released)
+		return;
+
+	_released = true;
+	restart(_sustain + 1, level());
+}
+
+bool Envelope::finished() const {
+	return _segment >= _breakpoints.size();
+}
+
+double Envelope::level() const {
+	return _pending ? _from : _ramp._offset + _ramp._level;
+}
+
+void Envelope::restart(size_t segment, double from) {
+	_segment = segment;
+	_from = from;
+	_pending = true;
+}
+
+void Envelope::Ramp::start(double from, double to, uint64_t frames) {
+	if (frames == 0) {
+		_offset = 0.0;
+		_level = to;
+		_k = 1.0;
+	}
+	else {
+		const Curve curve = exponentialCurve(from, to);
+		_offset = curve.offset;
+		_level = curve.base;
+		_k = ::pow(curve.ratio, 1.0 / frames);
+	}
+	_remaining = frames;
+}
+
+template<bool Apply>
+void Envelope::process(float* samples, size_t frames, double sampleRate) {
+	for (size_t i = 0; i < frames;) {
+		if (_pending) {
+			_pending = false;
+			if (_segment < _breakpoints.size()) {
+				const Breakpoint& breakpoint = _breakpoints[_segment];
+				const double duration = std::max(0.0, breakpoint.duration) * sampleRate;
+				_ramp.start(_from, breakpoint.level, static_cast<uint64_t>(duration + 0.5));
+			}
+			else {
+				// finished: hold the last level
+				_ramp.start(_from, _from, 0);
+			}
+		}
+
+		// a segment that ended moves on to the next breakpoint,
+		// unless it reached the sustain breakpoint
+		const bool holding = _segment == _sustain && !_released;
+		if (_ramp._remaining == 0 && _segment < _breakpoints.size() && !holding) {
+			restart(_segment + 1, _breakpoints[_segment].level);
+			continue;
+		}
+
+		const size_t n = _ramp._remaining == 0 ? frames - i : static_cast<size_t>(std::min<uint64_t>(_ramp._remaining, frames - i));
+		const double offset = _ramp._offset;
+		const double k = _ramp._k;
+		double level = _ramp._level;
+		for (size_t j = i; j < i + n; ++j) {
+			if (Apply) {
+				samples[j] *= static_cast<float>(offset + level);
+			}
+			else {
+				samples[j] = static_cast<float>(offset + level);
+			}
+			level *= k;
+		}
+		i += n;
+
+		if (_ramp._remaining != 0) {
+			_ramp._remaining -= n;
+			_ramp._level = level;
+			if (_ramp._remaining == 0) {
+				// land exactly on the breakpoint, without the recurrence's rounding
+				_ramp.start(_breakpoints[_segment].level, _breakpoints[_segment].level, 0);
+			}
+		}
+	}
+	_renderedFrames += frames;
+}
+
 ADEnvelope::ADEnvelope(double startLevel,
 					   double peakLevel,
 					   double endLevel,
 					   double attackDuration,
 					   double decayDuration)
-	: _startLevel(startLevel)
-	, _peakLevel(peakLevel)
-	, _endLevel(endLevel)
-	, _attackDuration(attackDuration)
-	, _decayDuration(decayDuration)
+	: Envelope(startLevel, {{peakLevel, attackDuration}, {endLevel, decayDuration}})
 {
 }
 
-double ADEnvelope::operator()(double time) const {
-	if (time <= 0)
-		return _startLevel;
-	if (time >= _attackDuration + _decayDuration)
-		return _endLevel;
-
-	return 0.0;
+ADSREnvelope::ADSREnvelope(double attackDuration,
+						   double decayDuration,
+						   double sustainLevel,
+						   double releaseDuration,
+						   double peakLevel)
+	: Envelope(0.0, {{peakLevel, attackDuration}, {sustainLevel, decayDuration}, {0.0, releaseDuration}}, 1)
+{
 }
 
-void exponentialEnvelope(std::ostream& out,
-						 double startTime,
-						 double endTime,
-						 double startLevel,
-						 double endLevel,
-						 double sampleRate)
+ExponentialEnvelope::ExponentialEnvelope(double startTime,
+										 double endTime,
+										 double startLevel,
+										 double endLevel,
+										 double sampleRate)
+	: _startTime(startTime)
+	, _dt(0.0)
+	, _level(0.0)
+	, _k(1.0)
+	, _offset(0.0)
+	, _size(0)
 {
 	const auto duration = endTime - startTime;
 	if (duration <= 0 ||
 		duration > MAX_DURATION_SECONDS ||
-		sampleRate > SAMPLE_RATE_192K ||
 		sampleRate <= 0.0)
 		return;
 
@@ -77,32 +307,69 @@ void exponentialEnvelope(std::ostream& out,
 		std::cerr << "Warning: start level and end level are the same" << std::endl;
 	}
 
+	// offset values so that the minumum value coincides with the starting level
+	const Curve curve = exponentialCurve(startLevel, endLevel);
 	const double samples = duration * sampleRate;
-	const double dt = 1.0 / sampleRate;
-	const double max = ::abs(endLevel - startLevel) + SILENCE;
-
-	double level, ratio;
-	if (startLevel > endLevel) {
-		// decay envelope
-		level = max;
-		ratio = SILENCE / max;
-	}
-	else {
-		// attack envelope
-		level = SILENCE;
-		ratio = max / SILENCE;
+	_dt = 1.0 / sampleRate;
+	_level = curve.base;
+	_k = ::pow(curve.ratio, 1.0 / samples);
+	_offset = curve.offset;
+
+	// samples + 1 points to cover entire sample range
+	_size = static_cast<size_t>(::ceil(samples)) + 1;
+}
+
+size_t ExponentialEnvelope::fill(float* out, size_t count) const {
+	count = std::min(count, _size);
+
+	double level = _level;
+	for (size_t i = 0; i < count; ++i, level *= _k) {
+		out[i] = static_cast<float>(level + _offset);
 	}
+	return count;
+}
 
-	const double k = ::pow(ratio, 1.0 / samples);
-	double t = startTime;
-	// offset values so that the minumum value coincides with the starting level
-	const double offset = std::min(startLevel, endLevel) - SILENCE;
+ExponentialEnvelope exponentialEnvelope(double startTime,
+										double endTime,
+										double startLevel,
+										double endLevel,
+										double sampleRate)
+{
+	return ExponentialEnvelope(startTime, endTime, startLevel, endLevel, sampleRate);
+}
+
+size_t exponentialEnvelope(float* out,
+						   size_t count,
+						   double startTime,
+						   double endTime,
+						   double startLevel,
+						   double endLevel,
+						   double sampleRate)
+{
+	return ExponentialEnvelope(startTime, endTime, startLevel, endLevel, sampleRate).fill(out, count);
+}
+
+void exponentialEnvelope(std::ostream& out,
+						 double startTime,
+						 double endTime,
+						 double startLevel,
+						 double endLevel,
+						 double sampleRate)
+{
+	// digits beyond max_digits10 add nothing to doubles
+	const int precision = static_cast<int>(std::min<std::streamsize>(out.precision(), std::numeric_limits<double>::max_digits10));
 
-	// iterate samples + 1 times to cover entire sample range
-	const size_t sampleCount = ::ceil(samples);
-	for (size_t i = 0; i <= sampleCount; t += dt, ++i, level *= k) {
-		out << t << '\t' << level + offset << std::endl;
+	// lines are formatted into a block that is written once full
+	std::vector<char> block(TEXT_BLOCK_SIZE);
+	size_t used = 0;
+	for (const EnvelopePoint point : exponentialEnvelope(startTime, endTime, startLevel, endLevel, sampleRate)) {
+		if (block.size() - used < MAX_LINE_SIZE) {
+			out.write(block.data(), used);
+			used = 0;
+		}
+		used += snprintf(block.data() + used, MAX_LINE_SIZE, "%.*g\t%.*g\n", precision, point.time, precision, point.level);
 	}
+	out.write(block.data(), used);
 }
 
 } // namespace mk
@@ -0,0 +1,82 @@
+#include "ThreadPool.h"
+
+namespace mk {
+
+ThreadPool::ThreadPool(size_t threads)
+	: _task(nullptr)
+	, _count(0)
+	, _next(0)
+	, _generation(0)
+	, _busy(0)
+	, _stop(false)
+{
+	// hardware_concurrency() may be unknown, in which case it's 0
+	for (size_t i = 1; i < threads; ++i) {
+		_workers.emplace_back(&ThreadPool::work, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_wake.notify_all();
+	for (auto& worker : _workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t)>& task) {
+	if (_workers.empty() || count <= 1) {
+		for (size_t i = 0; i < count; ++i) {
+			task(i);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_task = &task;
+		_count = count;
+		_next = 0;
+		_busy = _workers.size();
+		++_generation;
+	}
+	_wake.notify_all();
+
+	runTasks();
+
+	// the task must outlive every worker that may still read it
+	std::unique_lock<std::mutex> lock(_mutex);
+	_done.wait(lock, [this] { return _busy == 0; });
+	_task = nullptr;
+}
+
+void ThreadPool::runTasks() {
+	for (size_t i = _next++; i < _count; i = _next++) {
+		(*_task)(i);
+	}
+}
+
+void ThreadPool::work() {
+	uint64_t generation = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wake.wait(lock, [&] { return _stop || _generation != generation; });
+			if (_stop)
+				return;
+			generation = _generation;
+		}
+
+		runTasks();
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (--_busy == 0) {
+			_done.notify_one();
+		}
+	}
+}
+
+} // namespace mk
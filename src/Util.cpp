@@ -1,23 +1,32 @@
 #include "Util.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+#include <algorithm>
 #include <fstream>
 #include <sndfile.h>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <vector>
 #include <cmath>
 
 namespace {
 
+// frames read, processed and written at once
+constexpr sf_count_t BLOCK_FRAMES = 4096;
+
 struct SNDFILE_RAII {
 	SNDFILE_RAII(const std::string& filePath)
-		: file(sf_open(filePath.c_str(), SFM_READ, &info))
-		, samples(static_cast<size_t>(info.channels))
+		: info()
+		, file(sf_open(filePath.c_str(), SFM_READ, &info))
+		, samples(BLOCK_FRAMES * std::max(info.channels, 1))
 	{
 	}
 
 	SNDFILE_RAII(const std::string& filePath, const SF_INFO& other)
 		: info(other)
 		, file(sf_open(filePath.c_str(), SFM_WRITE, &info))
-		, samples(static_cast<size_t>(info.channels))
+		, samples(BLOCK_FRAMES * std::max(info.channels, 1))
 	{
 	}
 
@@ -28,13 +37,15 @@ struct SNDFILE_RAII {
 	bool valid() const { return file != nullptr; }
 	
 	const char* error() const { return sf_strerror(file); }
-	
-	bool fetchNextFrame() {
-		return sf_read_float(file, &samples[0], info.channels) == info.channels;
+
+	/// Reads up to frames frames, at most BLOCK_FRAMES, into samples.
+	/// Returns the number of frames read, which is 0 at the end of the file.
+	sf_count_t readBlock(sf_count_t frames) {
+		return sf_readf_float(file, &samples[0], std::min(frames, BLOCK_FRAMES));
 	}
 
-	bool writeFrame(const std::vector<float>& s) {
-		return s.size() == samples.size() && sf_write_float(file, &s[0], info.channels) == info.channels;
+	bool writeBlock(const float* s, sf_count_t frames) {
+		return sf_writef_float(file, s, frames) == frames;
 	}
 
 	SF_INFO info;
@@ -42,15 +53,333 @@ struct SNDFILE_RAII {
 	std::vector<float> samples;
 };
 
-std::pair<double, double> constPowerPanPos(double position) {
-	mk::clamp(position, -1.0, 1.0);
-	constexpr double SQRT_2_OVER_2 = 0.707106781186548;
-	constexpr double PI_OVER_2 = 1.570796326794897;
-	const double pos = position * PI_OVER_2;
-	const double angle = pos * 0.5;
-	const double s = ::sin(angle);
-	const double c = ::cos(angle);
-	return std::make_pair(SQRT_2_OVER_2 * (s - c), SQRT_2_OVER_2 * (s + c));
+/// Reads the frames of a file converted to another sample rate
+struct ResampledReader {
+	ResampledReader(SNDFILE_RAII& in, uint32_t sampleRate)
+		: file(in)
+		, resampler(static_cast<uint32_t>(in.info.samplerate), sampleRate, static_cast<uint16_t>(in.info.channels))
+		, output(std::max(resampler.maxOutputFrames(BLOCK_FRAMES), resampler.maxOutputFrames(resampler.taps())) * in.info.channels)
+		, samples(BLOCK_FRAMES * in.info.channels)
+		, position(0)
+		, available(0)
+		, flushed(false)
+	{
+	}
+
+	/// Returns the number of frames after conversion
+	sf_count_t frames() const {
+		return static_cast<sf_count_t>(resampler.outputFrames(file.info.frames));
+	}
+
+	/// Reads up to frames converted frames, at most BLOCK_FRAMES, into samples,
+	/// like SNDFILE_RAII::readBlock()
+	sf_count_t readBlock(sf_count_t frames) {
+		const size_t channels = static_cast<size_t>(file.info.channels);
+		float* out = &samples[0];
+		frames = std::min(frames, BLOCK_FRAMES);
+		sf_count_t done = 0;
+		while (done < frames) {
+			// convert the next block of input once all converted frames are read
+			if (position == available) {
+				if (flushed)
+					break;
+
+				position = 0;
+				const sf_count_t n = file.readBlock(BLOCK_FRAMES);
+				if (n > 0) {
+					available = resampler.process(&file.samples[0], static_cast<size_t>(n), &output[0]);
+				}
+				else {
+					available = resampler.flush(&output[0]);
+					flushed = true;
+				}
+				continue;
+			}
+
+			const size_t n = std::min(available - position, static_cast<size_t>(frames - done));
+			std::copy(&output[position * channels], &output[(position + n) * channels], out + done * channels);
+			position += n;
+			done += n;
+		}
+		return done;
+	}
+
+	SNDFILE_RAII& file;
+	mk::Resampler resampler;
+	std::vector<float> output;
+	std::vector<float> samples;
+	size_t position;
+	size_t available;
+	bool flushed;
+};
+
+/// Input of a mix, read a block at a time
+struct MixSource {
+	MixSource()
+		: frames(0)
+		, amplitude(1.0)
+		, direct(false)
+	{
+	}
+
+	sf_count_t readBlock(sf_count_t count) {
+		return resampled ? resampled->readBlock(count) : file->readBlock(count);
+	}
+
+	const float* samples() const {
+		return resampled ? &resampled->samples[0] : &file->samples[0];
+	}
+
+	std::unique_ptr<SNDFILE_RAII> file;
+	std::unique_ptr<ResampledReader> resampled;
+
+	// frames after conversion to the output sample rate
+	sf_count_t frames;
+
+	std::vector<uint16_t> channelMap;
+	double amplitude;
+
+	// true if each channel maps to the output channel of the same index
+	bool direct;
+};
+
+/// Adds count samples times gain to sums, in float
+void accumulate(float* sums, const float* samples, size_t count, double gain) {
+	const float g = static_cast<float>(gain);
+	size_t i = 0;
+
+#if defined(MK_AVX2)
+	const __m256 g8 = _mm256_set1_ps(g);
+	for (; i + 8 <= count; i += 8) {
+		_mm256_storeu_ps(sums + i, _mm256_add_ps(_mm256_loadu_ps(sums + i), _mm256_mul_ps(g8, _mm256_loadu_ps(samples + i))));
+	}
+#elif defined(MK_SSE2)
+	const __m128 g4 = _mm_set1_ps(g);
+	for (; i + 4 <= count; i += 4) {
+		_mm_storeu_ps(sums + i, _mm_add_ps(_mm_loadu_ps(sums + i), _mm_mul_ps(g4, _mm_loadu_ps(samples + i))));
+	}
+#endif
+
+	for (; i < count; ++i) {
+		sums[i] += g * samples[i];
+	}
+}
+
+/// Adds count samples times gain to sums, in double
+void accumulate(double* sums, const float* samples, size_t count, double gain) {
+	size_t i = 0;
+
+#if defined(MK_AVX2)
+	const __m256d g4 = _mm256_set1_pd(gain);
+	for (; i + 4 <= count; i += 4) {
+		const __m256d s = _mm256_cvtps_pd(_mm_loadu_ps(samples + i));
+		_mm256_storeu_pd(sums + i, _mm256_add_pd(_mm256_loadu_pd(sums + i), _mm256_mul_pd(g4, s)));
+	}
+#elif defined(MK_SSE2)
+	const __m128d g2 = _mm_set1_pd(gain);
+	for (; i + 4 <= count; i += 4) {
+		const __m128 s = _mm_loadu_ps(samples + i);
+		const __m128d low = _mm_cvtps_pd(s);
+		const __m128d high = _mm_cvtps_pd(_mm_movehl_ps(s, s));
+		_mm_storeu_pd(sums + i, _mm_add_pd(_mm_loadu_pd(sums + i), _mm_mul_pd(g2, low)));
+		_mm_storeu_pd(sums + i + 2, _mm_add_pd(_mm_loadu_pd(sums + i + 2), _mm_mul_pd(g2, high)));
+	}
+#endif
+
+	for (; i < count; ++i) {
+		sums[i] += gain * samples[i];
+	}
+}
+
+/// Clamps count sums to [-1;1] into samples. The maximum and minimum
+/// instructions return their second operand when either one is NaN, so NaNs
+/// go through like with clamp().
+void store(const float* sums, size_t count, float* samples) {
+	size_t i = 0;
+
+#if defined(MK_AVX2)
+	const __m256 low = _mm256_set1_ps(-1.0f);
+	const __m256 high = _mm256_set1_ps(1.0f);
+	for (; i + 8 <= count; i += 8) {
+		_mm256_storeu_ps(samples + i, _mm256_min_ps(high, _mm256_max_ps(low, _mm256_loadu_ps(sums + i))));
+	}
+#elif defined(MK_SSE2)
+	const __m128 low = _mm_set1_ps(-1.0f);
+	const __m128 high = _mm_set1_ps(1.0f);
+	for (; i + 4 <= count; i += 4) {
+		_mm_storeu_ps(samples + i, _mm_min_ps(high, _mm_max_ps(low, _mm_loadu_ps(sums + i))));
+	}
+#endif
+
+	for (; i < count; ++i) {
+		samples[i] = mk::clamp(sums[i], -1.0f, 1.0f);
+	}
+}
+
+void store(const double* sums, size_t count, float* samples) {
+	size_t i = 0;
+
+#if defined(MK_AVX2)
+	const __m256d low = _mm256_set1_pd(-1.0);
+	const __m256d high = _mm256_set1_pd(1.0);
+	for (; i + 4 <= count; i += 4) {
+		_mm_storeu_ps(samples + i, _mm256_cvtpd_ps(_mm256_min_pd(high, _mm256_max_pd(low, _mm256_loadu_pd(sums + i)))));
+	}
+#elif defined(MK_SSE2)
+	const __m128d low = _mm_set1_pd(-1.0);
+	const __m128d high = _mm_set1_pd(1.0);
+	for (; i + 4 <= count; i += 4) {
+		const __m128 first = _mm_cvtpd_ps(_mm_min_pd(high, _mm_max_pd(low, _mm_loadu_pd(sums + i))));
+		const __m128 second = _mm_cvtpd_ps(_mm_min_pd(high, _mm_max_pd(low, _mm_loadu_pd(sums + i + 2))));
+		_mm_storeu_ps(samples + i, _mm_movelh_ps(first, second));
+	}
+#endif
+
+	for (; i < count; ++i) {
+		samples[i] = static_cast<float>(mk::clamp(sums[i], -1.0, 1.0));
+	}
+}
+
+/// Mixes the sources into the output file, summing samples as T
+template<typename T>
+bool mixSources(const std::vector<mk::MixInput>& inputs,
+				std::vector<MixSource>& sources,
+				SNDFILE_RAII& out,
+				sf_count_t frames) {
+	const size_t channels = static_cast<size_t>(out.info.channels);
+	std::vector<T> sums(BLOCK_FRAMES * channels);
+
+	for (sf_count_t i = 0; i < frames;) {
+		const sf_count_t n = std::min(frames - i, BLOCK_FRAMES);
+		std::fill(sums.begin(), sums.begin() + n * channels, T(0));
+
+		for (size_t s = 0; s < sources.size(); ++s) {
+			MixSource& source = sources[s];
+
+			// inputs that ended are silent
+			const sf_count_t count = std::min(n, std::max<sf_count_t>(source.frames - i, 0));
+			if (count == 0)
+				continue;
+
+			if (source.readBlock(count) != count) {
+				std::cerr << "Failed to read audio frame @ pos " << i << " of input file: " << inputs[s].filePath << std::endl;
+				std::cerr << "Error: " << source.file->error() << std::endl;
+				return false;
+			}
+
+			const float* samples = source.samples();
+			if (source.direct) {
+				accumulate(&sums[0], samples, count * channels, source.amplitude);
+				continue;
+			}
+
+			const size_t sourceChannels = source.channelMap.size();
+			const T gain = static_cast<T>(source.amplitude);
+			for (sf_count_t k = 0; k < count; ++k) {
+				const float* frame = samples + k * sourceChannels;
+				T* sum = &sums[k * channels];
+				for (size_t j = 0; j < sourceChannels; ++j) {
+					sum[source.channelMap[j]] += gain * frame[j];
+				}
+			}
+		}
+
+		store(&sums[0], n * channels, &out.samples[0]);
+		if (!out.writeBlock(&out.samples[0], n)) {
+			std::cerr << "Failed to write audio frames @ pos " << i << std::endl;
+			std::cerr << "Error: " << out.error() << std::endl;
+			return false;
+		}
+		i += n;
+	}
+
+	return true;
+}
+
+/// Builds the peak index of frames [first;first + frames) of a file
+bool indexFrames(SNDFILE_RAII& f, sf_count_t first, sf_count_t frames, mk::PeakIndex& index) {
+	if (sf_seek(f.file, first, SEEK_SET) != first) {
+		std::cerr << "Failed to seek to audio frame @ pos " << first << std::endl;
+		std::cerr << "Error: " << f.error() << std::endl;
+		return false;
+	}
+
+	index.reset(static_cast<uint16_t>(f.info.channels));
+	for (sf_count_t i = 0; i < frames;) {
+		const sf_count_t n = f.readBlock(frames - i);
+		if (n <= 0) {
+			std::cerr << "Failed to read audio frame @ pos " << first + i << std::endl;
+			std::cerr << "Error: " << f.error() << std::endl;
+			return false;
+		}
+
+		index.add(&f.samples[0], n);
+		i += n;
+	}
+	index.finish();
+	return true;
+}
+
+// smallest range of frames indexed by a thread
+constexpr sf_count_t MIN_RANGE_FRAMES = 1024 * mk::PeakIndex::BLOCK_FRAMES;
+
+/// Loads the peak index of an audio file, or reads the file to build it and
+/// save it. The index is a cache, so failing to save it isn't an error.
+///
+/// With a thread pool, the file is split in ranges of whole index blocks,
+/// a few per thread, each read through its own handle. The indexes of the
+/// ranges are combined in order, so the index is the same as when it's built
+/// by a single thread.
+bool readPeakIndex(const std::string& filePath, mk::PeakIndex& index, mk::ThreadPool* pool) {
+	// the key is read first, so the index of a file changing while it's read
+	// is stale
+	mk::FileKey key;
+	const bool keyed = key.read(filePath);
+	if (keyed && index.load(mk::PeakIndex::sidecarPath(filePath), key))
+		return true;
+
+	SNDFILE_RAII f(filePath);
+	if (!f.valid()) {
+		std::cerr << "Failed to open input file: " << filePath << std::endl;
+		return false;
+	}
+
+	const sf_count_t frames = f.info.frames;
+	const size_t ranges = pool ? std::min<size_t>(4 * pool->size(), static_cast<size_t>(frames / MIN_RANGE_FRAMES)) : 1;
+	if (ranges < 2) {
+		if (!indexFrames(f, 0, frames, index))
+			return false;
+	}
+	else {
+		const sf_count_t blocks = (frames + mk::PeakIndex::BLOCK_FRAMES - 1) / mk::PeakIndex::BLOCK_FRAMES;
+		const sf_count_t rangeFrames = (blocks + ranges - 1) / ranges * mk::PeakIndex::BLOCK_FRAMES;
+
+		std::vector<mk::PeakIndex> parts(ranges);
+		std::vector<char> indexed(ranges, 0);
+		pool->run(ranges, [&](size_t i) {
+			const sf_count_t first = i * rangeFrames;
+			if (first >= frames)
+				return;
+
+			SNDFILE_RAII part(filePath);
+			indexed[i] = part.valid() && indexFrames(part, first, std::min(rangeFrames, frames - first), parts[i]);
+		});
+
+		index.reset(static_cast<uint16_t>(f.info.channels));
+		for (size_t i = 0; i < ranges && static_cast<sf_count_t>(i * rangeFrames) < frames; ++i) {
+			if (!indexed[i]) {
+				std::cerr << "Failed to index input file: " << filePath << std::endl;
+				return false;
+			}
+			index.add(parts[i]);
+		}
+		index.finish();
+	}
+
+	if (keyed) {
+		index.save(mk::PeakIndex::sidecarPath(filePath), key);
+	}
+	return true;
 }
 
 } // namespace
@@ -58,7 +387,7 @@ std::pair<double, double> constPowerPanPos(double position) {
 namespace mk {
 
 double amplitudeToLoudness(double amplitude) {
-	return 20.0 * ::log10f(clamp(::abs(amplitude), 1.0e-4, 1.0));
+	return 20.0 * ::log10f(clamp(std::abs(amplitude), 1.0e-4, 1.0));
 }
 
 double loudnessToAmplitude(double loudness) {
@@ -98,81 +427,79 @@ bool audioToText(const std::string& audioFilePath, const std::string& textFilePa
 	o.precision(std::numeric_limits<double>::max_digits10);
 
 	// iterate audio file's frames
-	for (sf_count_t i = 0; i < f.info.frames; ++i) {
-		if(!f.fetchNextFrame()) {
+	for (sf_count_t i = 0; i < f.info.frames;) {
+		const sf_count_t n = f.readBlock(f.info.frames - i);
+		if (n <= 0) {
 			std::cerr << "Failed to read audio frame @ pos " << i << std::endl;
 			std::cerr << "Error: " << f.error() << std::endl;
 			return false;
 		}
 
-		o << i << '\t';
+		const float* frame = &f.samples[0];
+		for (sf_count_t k = 0; k < n; ++k, frame += f.info.channels) {
+			o << i + k << '\t';
 
-		// iterate audio frame's samples
-		for (auto j = 0; j < f.info.channels; ++j) {
-			o << f.samples[j] << '\t';
+			// iterate audio frame's samples
+			for (auto j = 0; j < f.info.channels; ++j) {
+				o << frame[j] << '\t';
+			}
+			o << '\n';
 		}
-		o << '\n';
+		i += n;
 	}
 
 	return true;
 }
 
-bool scanMax(const std::string& inputFilePath, SampleInfo& max) {
-	// open audio file in read mode
-	SNDFILE_RAII f(inputFilePath);
-	if (!f.valid()) {
-		std::cerr << "Failed to open input file: " << inputFilePath << std::endl;
+bool scanMax(const std::string& inputFilePath, SampleInfo& max, ThreadPool* pool) {
+	PeakIndex index;
+	if (!readPeakIndex(inputFilePath, index, pool))
 		return false;
-	}
-
-	max.amplitude = 0.0;
-	for (sf_count_t i = 0; i < f.info.frames; ++i) {
-		if(!f.fetchNextFrame()) {
-			std::cerr << "Failed to read audio frame @ pos " << i << std::endl;
-			std::cerr << "Error: " << f.error() << std::endl;
-			return false;
-		}
-
-		for (auto j = 0; j < f.info.channels; ++j) {
-			if (::abs(max.amplitude) < ::abs(f.samples[j])) {
-				max.amplitude = f.samples[j];
-				max.frame = i;
-				max.channel = j;
-			}
-		}
-	}
 
+	max.amplitude = index.peakAmplitude();
+	max.frame = static_cast<uint32_t>(index.peakFrame());
+	max.channel = index.peakChannel();
 	return true;
 }
 
-bool normalize(const std::string& inputFilePath, const std::string& outputFilePath, float peakLoudness) {
-	if (inputFilePath == outputFilePath) {
-		std::cerr << "Input and output file can't be the same: " << inputFilePath << std::endl;
-		return false;
+SampleInfo scanMax(const float* samples, size_t frames, uint16_t channels) {
+	SampleInfo max;
+	const size_t peak = frames > 0 ? findPeak(samples, frames * channels) : 0;
+	if (frames > 0 && std::abs(samples[peak]) > 0.0f) {
+		max.amplitude = samples[peak];
+		max.frame = static_cast<uint32_t>(peak / channels);
+		max.channel = static_cast<uint16_t>(peak % channels);
 	}
+	return max;
+}
 
-	if (peakLoudness > 0.0) {
-		std::cerr << "Peak value is out of range: " << peakLoudness << ", max peak value is 0 dB" << std::endl;
+bool waveformOverview(const std::string& inputFilePath,
+					  uint16_t channel,
+					  size_t width,
+					  std::vector<PeakBlock>& overview,
+					  ThreadPool* pool) {
+	PeakIndex index;
+	if (!readPeakIndex(inputFilePath, index, pool))
 		return false;
-	}
-
-	const float peakAmplitude = clamp(loudnessToAmplitude(peakLoudness), 0.0, 1.0);
 
-	if (std::isnan(peakAmplitude)) {
-		std::cerr << "Peak amplitude is too small" << std::endl;
+	if (channel >= index.channels()) {
+		std::cerr << "Input file '" << inputFilePath << "' has " << index.channels() << " channel(s), no channel " << channel << std::endl;
 		return false;
 	}
 
-	// get input file's peak amplitude
-	SampleInfo max;
-	if (!scanMax(inputFilePath, max)) {
-		std::cerr << "Failed to scan input file: " << inputFilePath << std::endl;
+	overview = index.overview(channel, 0, index.frames(), width);
+	return true;
+}
+
+bool process(const std::string& inputFilePath,
+			 const std::string& outputFilePath,
+			 Pipeline& pipeline,
+			 ThreadPool* pool) {
+	if (inputFilePath == outputFilePath) {
+		std::cerr << "Input and output file can't be the same: " << inputFilePath << std::endl;
 		return false;
 	}
 
-	// calculate gain factor
-	const double gain = ::abs(peakAmplitude / max.amplitude);
-
 	// open input file
 	SNDFILE_RAII in(inputFilePath);
 	if (!in.valid()) {
@@ -180,53 +507,67 @@ bool normalize(const std::string& inputFilePath, const std::string& outputFilePa
 		return false;
 	}
 
-	// open output file in write mode
-	SNDFILE_RAII out(outputFilePath, in.info);
-	if (!out.valid()) {
-		std::cerr << "Failed to open output file: " << outputFilePath << std::endl;
-		std::cerr << "Error: " << out.error() << std::endl;
+	const uint16_t channels = static_cast<uint16_t>(in.info.channels);
+	if (!pipeline.prepare(channels, static_cast<uint32_t>(in.info.samplerate))) {
+		std::cerr << "Can't process input file: " << inputFilePath << std::endl;
 		return false;
 	}
 
-	for (sf_count_t i = 0; i < in.info.frames; ++i) {
-		if(!in.fetchNextFrame()) {
-			std::cerr << "Failed to read audio frame @ pos " << i << std::endl;
-			std::cerr << "Error: " << in.error() << std::endl;
-			return false;
-		}
+	// feed the input of each analyzing stage to it, the stages before it
+	// being ready to process. The input of the first stage is the input file,
+	// summarized by its peak index, which is built while it's read if need be.
+	for (size_t s = 0; s < pipeline.size(); ++s) {
+		if (!pipeline.stage(s).analyzes())
+			continue;
+
+		FileKey key;
+		PeakIndex index;
+		const bool keyed = s == 0 && key.read(inputFilePath);
+		if (keyed && index.load(PeakIndex::sidecarPath(inputFilePath), key) && pipeline.stage(s).analyze(index))
+			continue;
 
-		// normalize audio frame
-		for (auto j = 0; j < in.info.channels; ++j) {
-			in.samples[j] *= gain;
+		// with threads, the index is built in parallel instead
+		if (s == 0 && pool && readPeakIndex(inputFilePath, index, pool) && pipeline.stage(s).analyze(index))
+			continue;
+
+		if (s == 0) {
+			index.reset(channels);
 		}
 
-		if (!out.writeFrame(in.samples)) {
-			std::cerr << "Failed to write audio frame @ pos " << i << std::endl;
-			std::cerr << "Error: " << out.error() << std::endl;
+		if (sf_seek(in.file, 0, SEEK_SET) != 0) {
+			std::cerr << "Failed to rewind input file: " << inputFilePath << std::endl;
+			std::cerr << "Error: " << in.error() << std::endl;
 			return false;
 		}
-	}
 
-	return true;
-}
+		pipeline.rewind();
+		for (sf_count_t i = 0; i < in.info.frames;) {
+			const sf_count_t n = in.readBlock(in.info.frames - i);
+			if (n <= 0) {
+				std::cerr << "Failed to read audio frame @ pos " << i << std::endl;
+				std::cerr << "Error: " << in.error() << std::endl;
+				return false;
+			}
 
-bool amplify(const std::string& inputFilePath, const std::string& outputFilePath, float gain) {
-	if (inputFilePath == outputFilePath) {
-		std::cerr << "Input and output file can't be the same: " << inputFilePath << std::endl;
-		return false;
-	}
+			if (s == 0) {
+				index.add(&in.samples[0], n);
+			}
 
-	const double ratio = loudnessToAmplitude(gain);
-	if (std::isnan(ratio)) {
-		std::cerr << "Gain factor is too small" << std::endl;
-		return false;
-	}
+			pipeline.process(&in.samples[0], n, channels, 0, s);
+			pipeline.stage(s).analyze(&in.samples[0], n, channels);
+			i += n;
+		}
 
-	// open input file
-	SNDFILE_RAII in(inputFilePath);
-	if (!in.valid()) {
-		std::cerr << "Failed to open input file: " << inputFilePath << std::endl;
-		return false;
+		if (keyed) {
+			index.finish();
+			index.save(PeakIndex::sidecarPath(inputFilePath), key);
+		}
+
+		if (sf_seek(in.file, 0, SEEK_SET) != 0) {
+			std::cerr << "Failed to rewind input file: " << inputFilePath << std::endl;
+			std::cerr << "Error: " << in.error() << std::endl;
+			return false;
+		}
 	}
 
 	// open output file in write mode
@@ -237,34 +578,67 @@ bool amplify(const std::string& inputFilePath, const std::string& outputFilePath
 		return false;
 	}
 
-	for (sf_count_t i = 0; i < in.info.frames; ++i) {
-		if(!in.fetchNextFrame()) {
+	pipeline.rewind();
+	for (sf_count_t i = 0; i < in.info.frames;) {
+		const sf_count_t n = in.readBlock(in.info.frames - i);
+		if (n <= 0) {
 			std::cerr << "Failed to read audio frame @ pos " << i << std::endl;
 			std::cerr << "Error: " << in.error() << std::endl;
 			return false;
 		}
 
-		// apply gain to audio frame while avoiding dynamic range overflow
-		for (auto j = 0; j < in.info.channels; ++j) {
-			in.samples[j] = clamp(ratio * in.samples[j], -1.0, 1.0);
-		}
+		pipeline.process(&in.samples[0], n, channels);
 
-		if(!out.writeFrame(in.samples)) {
-			std::cerr << "Failed to write audio frame @ pos " << i << std::endl;
+		if (!out.writeBlock(&in.samples[0], n)) {
+			std::cerr << "Failed to write audio frames @ pos " << i << std::endl;
 			std::cerr << "Error: " << out.error() << std::endl;
 			return false;
 		}
+		i += n;
 	}
 
 	return true;
 }
 
+bool normalize(const std::string& inputFilePath, const std::string& outputFilePath, float peakLoudness, ThreadPool* pool) {
+	Pipeline pipeline;
+	pipeline.normalize(peakLoudness);
+	return process(inputFilePath, outputFilePath, pipeline, pool);
+}
+
+bool amplify(const std::string& inputFilePath, const std::string& outputFilePath, float gain) {
+	// clamp to avoid dynamic range overflow
+	Pipeline pipeline;
+	pipeline.gain(gain).clamp();
+	return process(inputFilePath, outputFilePath, pipeline);
+}
+
+bool amplify(const std::string& inputFilePath, const std::string& outputFilePath, const Automation& gain) {
+	Pipeline pipeline;
+	pipeline.gain(gain).clamp();
+	return process(inputFilePath, outputFilePath, pipeline);
+}
+
 bool invertPhase(const std::string& inputFilePath, const std::string& outputFilePath) {
+	Pipeline pipeline;
+	pipeline.invert();
+	return process(inputFilePath, outputFilePath, pipeline);
+}
+
+bool resample(const std::string& inputFilePath,
+			  const std::string& outputFilePath,
+			  uint32_t sampleRate,
+			  ResamplerQuality quality) {
 	if (inputFilePath == outputFilePath) {
 		std::cerr << "Input and output file can't be the same: " << inputFilePath << std::endl;
 		return false;
 	}
 
+	if (sampleRate == 0) {
+		std::cerr << "Sample rate must be positive" << std::endl;
+		return false;
+	}
+
 	// open input file
 	SNDFILE_RAII in(inputFilePath);
 	if (!in.valid()) {
@@ -273,130 +647,116 @@ bool invertPhase(const std::string& inputFilePath, const std::string& outputFile
 	}
 
 	// open output file in write mode
-	SNDFILE_RAII out(outputFilePath, in.info);
+	SF_INFO outInfo = in.info;
+	outInfo.samplerate = static_cast<int>(sampleRate);
+	SNDFILE_RAII out(outputFilePath, outInfo);
 	if (!out.valid()) {
 		std::cerr << "Failed to open output file: " << outputFilePath << std::endl;
 		std::cerr << "Error: " << out.error() << std::endl;
 		return false;
 	}
 
-	for (sf_count_t i = 0; i < in.info.frames; ++i) {
-		if(!in.fetchNextFrame()) {
+	Resampler resampler(static_cast<uint32_t>(in.info.samplerate), sampleRate, static_cast<uint16_t>(in.info.channels), quality);
+	std::vector<float> output(std::max(resampler.maxOutputFrames(BLOCK_FRAMES), resampler.maxOutputFrames(resampler.taps())) * in.info.channels);
+
+	for (sf_count_t i = 0; i < in.info.frames;) {
+		const sf_count_t n = in.readBlock(in.info.frames - i);
+		if (n <= 0) {
 			std::cerr << "Failed to read audio frame @ pos " << i << std::endl;
 			std::cerr << "Error: " << in.error() << std::endl;
 			return false;
 		}
+		i += n;
 
-		// apply gain to audio frame while avoiding dynamic range overflow
-		for (auto j = 0; j < in.info.channels; ++j) {
-			in.samples[j] *= -1.0;
-		}
-
-		if(!out.writeFrame(in.samples)) {
-			std::cerr << "Failed to write audio frame @ pos " << i << std::endl;
+		const sf_count_t converted = static_cast<sf_count_t>(resampler.process(&in.samples[0], static_cast<size_t>(n), &output[0]));
+		if (!out.writeBlock(&output[0], converted)) {
+			std::cerr << "Failed to write audio frames @ pos " << i << std::endl;
 			std::cerr << "Error: " << out.error() << std::endl;
 			return false;
 		}
 	}
 
-	return true;
-}
-
-bool mix(const std::string& inputFilePath1,
-		 const std::string& inputFilePath2,
-		 const std::string& outputFilePath,
-		 double gain1,
-		 double gain2) {
-	if (inputFilePath1 == inputFilePath2) {
-		std::cerr << "Input files can't be the same: " << inputFilePath1 << std::endl;
+	const sf_count_t converted = static_cast<sf_count_t>(resampler.flush(&output[0]));
+	if (!out.writeBlock(&output[0], converted)) {
+		std::cerr << "Failed to write audio frames" << std::endl;
+		std::cerr << "Error: " << out.error() << std::endl;
 		return false;
 	}
 
-	// open 1st input file in read mode
-	SNDFILE_RAII in1(inputFilePath1);
-	if (!in1.valid()) {
-		std::cerr << "Failed to open input file: " << inputFilePath1 << std::endl;
-		return false;
-	}
+	return true;
+}
 
-	// open 2nd input file in read mode
-	SNDFILE_RAII in2(inputFilePath2);
-	if (!in2.valid()) {
-		std::cerr << "Failed to open input file: " << inputFilePath2 << std::endl;
-		return false;
-	}
+MixInput::MixInput(const std::string& filePath, double gain)
+	: filePath(filePath)
+	, gain(gain)
+{
+}
 
-	if (in1.info.samplerate != in2.info.samplerate ||
-		in1.info.format     != in2.info.format) {
-		std::cerr << "Format error: can only mix audio files with matching sample rate and bit depth" << std::endl;
+bool mix(const std::vector<MixInput>& inputs,
+		 const std::string& outputFilePath,
+		 MixPrecision precision) {
+	if (inputs.empty()) {
+		std::cerr << "No input files to mix" << std::endl;
 		return false;
 	}
 
-	// open output file in write mode
-	SF_INFO outInfo = in1.info;
-	outInfo.channels = std::max(in1.info.channels, in2.info.channels);
-	outInfo.frames = std::max(in1.info.frames, in2.info.frames);
-
-	SNDFILE_RAII out(outputFilePath, outInfo);
-	if (!out.valid()) {
-		std::cerr << "Failed to open output file: " << outputFilePath << std::endl;
-		std::cerr << "Error: " << out.error() << std::endl;
-		return false;
-	}
+	std::vector<MixSource> sources(inputs.size());
+	SF_INFO outInfo = SF_INFO();
+	for (size_t i = 0; i < inputs.size(); ++i) {
+		const MixInput& input = inputs[i];
+		MixSource& source = sources[i];
 
-	for (sf_count_t i = 0; i < outInfo.frames; ++i) {
-		if(!in1.fetchNextFrame()) {
-			std::cerr << "Failed to read audio frame @ pos " << i << std::endl;
-			std::cerr << "Error: " << in1.error() << std::endl;
+		// open input file in read mode
+		source.file.reset(new SNDFILE_RAII(input.filePath));
+		SNDFILE_RAII& in = *source.file;
+		if (!in.valid()) {
+			std::cerr << "Failed to open input file: " << input.filePath << std::endl;
 			return false;
 		}
 
-		if(!in2.fetchNextFrame()) {
-			std::cerr << "Failed to read audio frame @ pos " << i << std::endl;
-			std::cerr << "Error: " << in2.error() << std::endl;
+		if (i == 0) {
+			outInfo = in.info;
+			outInfo.channels = 0;
+			outInfo.frames = 0;
+		}
+		else if (in.info.format != outInfo.format) {
+			std::cerr << "Format error: can only mix audio files with matching bit depth: " << input.filePath << std::endl;
 			return false;
 		}
 
-		// normalize audio frame
-		for (auto j = 0; j < out.info.channels; ++j) {
-			const float s1 = j < in1.samples.size() ? in1.samples[j] : 0.0f;
-			const float s2 = j < in2.samples.size() ? in2.samples[j] : 0.0f;
-			out.samples[j] = clamp(loudnessToAmplitude(gain1) * s1 + loudnessToAmplitude(gain2) * s2, -1.0, 1.0);
+		// convert the input file to the sample rate of the 1st
+		if (in.info.samplerate != outInfo.samplerate) {
+			source.resampled.reset(new ResampledReader(in, static_cast<uint32_t>(outInfo.samplerate)));
 		}
+		source.frames = source.resampled ? source.resampled->frames() : in.info.frames;
 
-		if(!out.writeFrame(out.samples)) {
-			std::cerr << "Failed to write audio frame @ pos " << i << std::endl;
-			std::cerr << "Error: " << out.error() << std::endl;
+		source.channelMap = input.channelMap;
+		if (source.channelMap.empty()) {
+			for (int j = 0; j < in.info.channels; ++j) {
+				source.channelMap.push_back(static_cast<uint16_t>(j));
+			}
+		}
+		else if (source.channelMap.size() != static_cast<size_t>(in.info.channels)) {
+			std::cerr << "Channel map of input file '" << input.filePath << "' has " << source.channelMap.size()
+					  << " channel(s), the file has " << in.info.channels << std::endl;
 			return false;
 		}
-	}
-
-	return true;
-}
 
-bool panStereoFile(const std::string& inputFilePath,
-				   const std::string& outputFilePath,
-				   double position) {
-	if (inputFilePath == outputFilePath) {
-		std::cerr << "Input and output files can't be the same: " << inputFilePath << std::endl;
-		return false;
+		source.amplitude = loudnessToAmplitude(input.gain);
+		outInfo.channels = std::max<int>(outInfo.channels, *std::max_element(source.channelMap.begin(), source.channelMap.end()) + 1);
+		outInfo.frames = std::max(outInfo.frames, source.frames);
 	}
 
-	// open 1st input file in read mode
-	SNDFILE_RAII in(inputFilePath);
-	if (!in.valid()) {
-		std::cerr << "Failed to open input file: " << inputFilePath << std::endl;
-		return false;
-	}
-
-	// make sure input file is stereo
-	if (in.info.channels != 2) {
-		std::cerr << "Input file '" << inputFilePath << "' has " << in.info.channels << " channel(s), you must pass a stereo input file" << std::endl;
-		return false;
+	// inputs whose channels map to the same output channels are accumulated
+	// as contiguous samples
+	for (auto& source : sources) {
+		source.direct = static_cast<int>(source.channelMap.size()) == outInfo.channels;
+		for (size_t j = 0; j < source.channelMap.size(); ++j) {
+			source.direct = source.direct && source.channelMap[j] == j;
+		}
 	}
 
 	// open output file in write mode
-	SF_INFO outInfo = in.info;
 	SNDFILE_RAII out(outputFilePath, outInfo);
 	if (!out.valid()) {
 		std::cerr << "Failed to open output file: " << outputFilePath << std::endl;
@@ -404,26 +764,38 @@ bool panStereoFile(const std::string& inputFilePath,
 		return false;
 	}
 
-	const auto pannedStereoField = constPowerPanPos(position);
-	for (sf_count_t i = 0; i < outInfo.frames; ++i) {
-		if(!in.fetchNextFrame()) {
-			std::cerr << "Failed to read audio frame @ pos " << i << std::endl;
-			std::cerr << "Error: " << in.error() << std::endl;
-			return false;
-		}
-
-		// pan audio sample using constant power
-		in.samples[0] *= pannedStereoField.first;
-		in.samples[1] *= pannedStereoField.second;
+	return precision == MixPrecision::Double
+		? mixSources<double>(inputs, sources, out, outInfo.frames)
+		: mixSources<float>(inputs, sources, out, outInfo.frames);
+}
 
-		if(!out.writeFrame(in.samples)) {
-			std::cerr << "Failed to write audio frame @ pos " << i << std::endl;
-			std::cerr << "Error: " << out.error() << std::endl;
-			return false;
-		}
+bool mix(const std::string& inputFilePath1,
+		 const std::string& inputFilePath2,
+		 const std::string& outputFilePath,
+		 double gain1,
+		 double gain2) {
+	if (inputFilePath1 == inputFilePath2) {
+		std::cerr << "Input files can't be the same: " << inputFilePath1 << std::endl;
+		return false;
 	}
 
-	return true;
+	return mix({ MixInput(inputFilePath1, gain1), MixInput(inputFilePath2, gain2) }, outputFilePath, MixPrecision::Double);
+}
+
+bool panStereoFile(const std::string& inputFilePath,
+				   const std::string& outputFilePath,
+				   double position) {
+	Pipeline pipeline;
+	pipeline.pan(position);
+	return process(inputFilePath, outputFilePath, pipeline);
+}
+
+bool panStereoFile(const std::string& inputFilePath,
+				   const std::string& outputFilePath,
+				   const Automation& positions) {
+	Pipeline pipeline;
+	pipeline.pan(positions);
+	return process(inputFilePath, outputFilePath, pipeline);
 }
 
 } // namespace mk
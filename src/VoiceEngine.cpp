@@ -0,0 +1,282 @@
+#include "VoiceEngine.h"
+#include "SinCosKernels.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// voices rendered by each SIMD pass
+#if defined(MK_AVX2)
+constexpr size_t LANES = 8;
+#elif defined(MK_SSE2)
+constexpr size_t LANES = 4;
+#else
+constexpr size_t LANES = 1;
+#endif
+
+// Frames rendered by a pass before phases are resynchronized with their
+// double-precision values, which bounds the drift of single-precision phases
+constexpr size_t PASS_FRAMES = 64;
+
+// Shortest ramp of a stolen voice to its new amplitude, in seconds, so that
+// stealing a voice doesn't click even without attack
+constexpr double STEAL_RAMP = 0.005;
+
+size_t roundUp(size_t n, size_t multiple) {
+	return (n + multiple - 1) / multiple * multiple;
+}
+
+} // namespace
+
+namespace mk {
+
+VoiceEngine::VoiceEngine(size_t maxVoices, double sampleRate)
+	: _maxVoices(maxVoices)
+	, _sampleRate(sampleRate)
+	, _attackFrames(0)
+	, _releaseFrames(0)
+	, _active(0)
+	, _started(0)
+	, _phase(roundUp(maxVoices, LANES))
+	, _increment(_phase.size())
+	, _level(_phase.size())
+	, _delta(_phase.size())
+	, _cycle(maxVoices)
+	, _cycleIncrement(maxVoices)
+	, _amplitude(maxVoices)
+	, _remaining(maxVoices)
+	, _stage(maxVoices)
+	, _tag(maxVoices)
+	, _order(maxVoices)
+	, _lanes(PASS_FRAMES * LANES)
+{
+}
+
+void VoiceEngine::setEnvelope(double attack, double release) {
+	_attackFrames = static_cast<size_t>(std::max(0.0, attack) * _sampleRate + 0.5);
+	_releaseFrames = static_cast<size_t>(std::max(0.0, release) * _sampleRate + 0.5);
+}
+
+void VoiceEngine::noteOn(const Note& note, float velocity) {
+	start(note.frequency(), velocity, note.key());
+}
+
+void VoiceEngine::noteOff(const Note& note) {
+	release(note.key());
+}
+
+void VoiceEngine::start(double frequency, float amplitude, uint32_t tag) {
+	if (_maxVoices == 0)
+		return;
+
+	const size_t i = allocate();
+	_tag[i] = tag;
+	_order[i] = _started++;
+	_cycleIncrement[i] = frequency / _sampleRate;
+	_increment[i] = static_cast<float>(_cycleIncrement[i]);
+	_amplitude[i] = amplitude;
+
+	// ramp from the current level, which is only non-zero for stolen voices
+	size_t attackFrames = _attackFrames;
+	if (_level[i] != 0.0f) {
+		attackFrames = std::max(attackFrames, static_cast<size_t>(STEAL_RAMP * _sampleRate + 0.5));
+	}
+	if (attackFrames == 0) {
+		_stage[i] = Sustain;
+		_level[i] = amplitude;
+		_delta[i] = 0.0f;
+	}
+	else {
+		_stage[i] = Attack;
+		_remaining[i] = static_cast<uint32_t>(attackFrames);
+		_delta[i] = (amplitude - _level[i]) / attackFrames;
+	}
+}
+
+void VoiceEngine::release(uint32_t tag) {
+	for (size_t i = 0; i < _active;) {
+		// a voice freed at once is replaced by the last active voice
+		if (_tag[i] == tag && _stage[i] != Release && !releaseVoice(i))
+			continue;
+		++i;
+	}
+}
+
+void VoiceEngine::releaseAll() {
+	for (size_t i = 0; i < _active;) {
+		if (_stage[i] != Release && !releaseVoice(i))
+			continue;
+		++i;
+	}
+}
+
+void VoiceEngine::render(float* out, size_t frames) {
+	for (size_t first = 0; first < frames;) {
+		// envelope stages only change between passes
+		size_t n = std::min(frames - first, PASS_FRAMES);
+		for (size_t i = 0; i < _active; ++i) {
+			if (_stage[i] != Sustain) {
+				n = std::min<size_t>(n, _remaining[i]);
+			}
+		}
+
+		renderVoices(out + first, n);
+		advanceStages(n);
+		first += n;
+	}
+}
+
+size_t VoiceEngine::allocate() {
+	if (_active < _maxVoices) {
+		const size_t i = _active++;
+		_cycle[i] = 0.0;
+		_phase[i] = 0.0f;
+		_level[i] = 0.0f;
+		return i;
+	}
+
+	// steal the quietest released voice, or else the oldest one
+	size_t stolen = std::numeric_limits<size_t>::max();
+	for (size_t i = 0; i < _active; ++i) {
+		if (_stage[i] == Release && (stolen == std::numeric_limits<size_t>::max() || _level[i] < _level[stolen])) {
+			stolen = i;
+		}
+	}
+	if (stolen == std::numeric_limits<size_t>::max()) {
+		stolen = std::min_element(_order.begin(), _order.begin() + _active) - _order.begin();
+	}
+	return stolen;
+}
+
+bool VoiceEngine::releaseVoice(size_t i) {
+	if (_releaseFrames == 0) {
+		free(i);
+		return false;
+	}
+
+	_stage[i] = Release;
+	_remaining[i] = static_cast<uint32_t>(_releaseFrames);
+	_delta[i] = -_level[i] / _releaseFrames;
+	return true;
+}
+
+void VoiceEngine::advanceStages(size_t frames) {
+	for (size_t i = 0; i < _active;) {
+		// resynchronize the single-precision phase
+		_cycle[i] += frames * _cycleIncrement[i];
+		_cycle[i] -= ::floor(_cycle[i]);
+		_phase[i] = static_cast<float>(_cycle[i]);
+
+		if (_stage[i] != Sustain) {
+			_remaining[i] -= static_cast<uint32_t>(frames);
+			if (_remaining[i] == 0) {
+				if (_stage[i] == Release) {
+					free(i);
+					continue;
+				}
+
+				// land exactly on the sustain level
+				_stage[i] = Sustain;
+				_level[i] = _amplitude[i];
+				_delta[i] = 0.0f;
+			}
+		}
+		++i;
+	}
+}
+
+void VoiceEngine::free(size_t i) {
+	const size_t last = --_active;
+	if (i != last) {
+		_phase[i] = _phase[last];
+		_increment[i] = _increment[last];
+		_level[i] = _level[last];
+		_delta[i] = _delta[last];
+		_cycle[i] = _cycle[last];
+		_cycleIncrement[i] = _cycleIncrement[last];
+		_amplitude[i] = _amplitude[last];
+		_remaining[i] = _remaining[last];
+		_stage[i] = _stage[last];
+		_tag[i] = _tag[last];
+		_order[i] = _order[last];
+	}
+
+	// padding voices must stay silent
+	_phase[last] = 0.0f;
+	_increment[last] = 0.0f;
+	_level[last] = 0.0f;
+	_delta[last] = 0.0f;
+}
+
+void VoiceEngine::renderVoices(float* out, size_t frames) {
+	std::fill(_lanes.begin(), _lanes.begin() + frames * LANES, 0.0f);
+
+	// each pass keeps a register of voices in flight across all frames
+	// and adds their samples to per-lane sums
+	for (size_t v = 0; v < _active; v += LANES) {
+#if defined(MK_AVX2)
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 increment = _mm256_loadu_ps(&_increment[v]);
+		const __m256 delta = _mm256_loadu_ps(&_delta[v]);
+		__m256 phase = _mm256_loadu_ps(&_phase[v]);
+		__m256 level = _mm256_loadu_ps(&_level[v]);
+
+		for (size_t f = 0; f < frames; ++f) {
+			const __m256 s = _mm256_mul_ps(level, sincos::sinPhase8(phase));
+			_mm256_storeu_ps(&_lanes[f * LANES], _mm256_add_ps(_mm256_loadu_ps(&_lanes[f * LANES]), s));
+
+			phase = _mm256_add_ps(phase, increment);
+			phase = _mm256_sub_ps(phase, _mm256_and_ps(_mm256_cmp_ps(phase, one, _CMP_GE_OQ), one));
+			level = _mm256_add_ps(level, delta);
+		}
+
+		_mm256_storeu_ps(&_phase[v], phase);
+		_mm256_storeu_ps(&_level[v], level);
+#elif defined(MK_SSE2)
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 increment = _mm_loadu_ps(&_increment[v]);
+		const __m128 delta = _mm_loadu_ps(&_delta[v]);
+		__m128 phase = _mm_loadu_ps(&_phase[v]);
+		__m128 level = _mm_loadu_ps(&_level[v]);
+
+		for (size_t f = 0; f < frames; ++f) {
+			const __m128 s = _mm_mul_ps(level, sincos::sinPhase4(phase));
+			_mm_storeu_ps(&_lanes[f * LANES], _mm_add_ps(_mm_loadu_ps(&_lanes[f * LANES]), s));
+
+			phase = _mm_add_ps(phase, increment);
+			phase = _mm_sub_ps(phase, _mm_and_ps(_mm_cmpge_ps(phase, one), one));
+			level = _mm_add_ps(level, delta);
+		}
+
+		_mm_storeu_ps(&_phase[v], phase);
+		_mm_storeu_ps(&_level[v], level);
+#else
+		float phase = _phase[v];
+		float level = _level[v];
+
+		for (size_t f = 0; f < frames; ++f) {
+			float s;
+			sincos::sinCosPhase(phase, &s, nullptr);
+			_lanes[f] += level * s;
+
+			phase += _increment[v];
+			phase -= phase >= 1.0f ? 1.0f : 0.0f;
+			level += _delta[v];
+		}
+
+		_phase[v] = phase;
+		_level[v] = level;
+#endif
+	}
+
+	for (size_t f = 0; f < frames; ++f) {
+		float sum = 0.0f;
+		for (size_t l = 0; l < LANES; ++l) {
+			sum += _lanes[f * LANES + l];
+		}
+		out[f] = sum;
+	}
+}
+
+} // namespace mk
@@ -0,0 +1,214 @@
+#include "WAV.h"
+#include <iostream>
+
+/*
+WAVE File Format
+Byte order: Little-endian
+
+RIFF chunk (mandatory, 12 bytes):
+  0      4 bytes  "RIFF"             // "RF64" for files larger than 4 GiB
+  4      4 bytes  <File size - 8>    // 0xFFFFFFFF in RF64 files
+  8      4 bytes  "WAVE"
+
+JUNK chunk (36 bytes), reserves room for the RF64 ds64 chunk:
+  0      4 bytes  "JUNK"             // "ds64" in RF64 files
+  4      4 bytes  <Chunk size>       // (=28)
+  8     28 bytes  <Zeros>
+
+ds64 chunk (RF64 only, 36 bytes):
+  0      4 bytes  "ds64"
+  4      4 bytes  <Chunk size>       // (=28)
+  8      8 bytes  <File size - 8>
+ 16      8 bytes  <data chunk size>
+ 24      8 bytes  <Number of frames>
+ 32      4 bytes  <Table length>     // (=0)
+
+fmt chunk (mandatory, 24 bytes):
+  0      4 bytes  "fmt "
+  4      4 bytes  <Chunk size>       // (=16)
+  8      2 bytes  <Format tag>       // 1 = PCM, 3 = IEEE float
+ 10      2 bytes  <Number of channels(c)>
+ 12      4 bytes  <Sample rate>
+ 16      4 bytes  <Bytes per second>
+ 20      2 bytes  <Bytes per frame>
+ 22      2 bytes  <bits/samples(b)>
+
+data chunk (mandatory):
+  0      4 bytes  "data"
+  4      4 bytes  <Chunk size(x)>    // 0xFFFFFFFF in RF64 files
+  8     (x)bytes  <Sample data>      // padded to an even size
+*/
+
+namespace {
+
+const char* ID_RIFF = "RIFF";
+const char* ID_RF64 = "RF64";
+const char* ID_WAVE = "WAVE";
+const char* ID_JUNK = "JUNK";
+const char* ID_DS64 = "ds64";
+const char* ID_FORMAT = "fmt ";
+const char* ID_DATA = "data";
+
+constexpr uint16_t FORMAT_PCM = 1;
+constexpr uint16_t FORMAT_IEEE_FLOAT = 3;
+
+constexpr uint32_t DS64_CHUNK_SIZE = 28;
+constexpr uint32_t FORMAT_CHUNK_SIZE = 16;
+
+constexpr uint64_t HEADER_SIZE = 80;
+
+// 32-bit sizes that don't fit are replaced by this value in RF64 files
+constexpr uint32_t RF64_SIZE = 0xFFFFFFFF;
+
+void write16(std::ostream& o, uint16_t n) {
+	const char b[] { static_cast<char>(n), static_cast<char>(n >> 8) };
+	o.write(b, sizeof(b));
+}
+
+void write32(std::ostream& o, uint32_t n) {
+	write16(o, static_cast<uint16_t>(n));
+	write16(o, static_cast<uint16_t>(n >> 16));
+}
+
+void write64(std::ostream& o, uint64_t n) {
+	write32(o, static_cast<uint32_t>(n));
+	write32(o, static_cast<uint32_t>(n >> 32));
+}
+
+void writeRIFF(std::ostream& o, uint64_t riffSize)
+{
+	if (riffSize <= UINT32_MAX) {
+		o << ID_RIFF;
+		write32(o, static_cast<uint32_t>(riffSize));
+	}
+	else {
+		o << ID_RF64;
+		write32(o, RF64_SIZE);
+	}
+	o << ID_WAVE;
+}
+
+void writeJUNK(std::ostream& o)
+{
+	o << ID_JUNK;
+	write32(o, DS64_CHUNK_SIZE);
+	for (size_t i = 0; i < DS64_CHUNK_SIZE; ++i) {
+		o.put(0);
+	}
+}
+
+void writeDS64(std::ostream& o, uint64_t riffSize, uint64_t dataChunkSize, uint64_t frames)
+{
+	o << ID_DS64;
+	write32(o, DS64_CHUNK_SIZE);
+	write64(o, riffSize);
+	write64(o, dataChunkSize);
+	write64(o, frames);
+	write32(o, 0);
+}
+
+void writeFormat(std::ostream& o,
+				 uint16_t channels,
+				 uint16_t sampleBitDepth,
+				 double sampleRate,
+				 bool floatingPoint)
+{
+	const uint16_t frameSize = channels * (sampleBitDepth / 8);
+	const uint32_t rate = static_cast<uint32_t>(sampleRate);
+
+	o << ID_FORMAT;
+	write32(o, FORMAT_CHUNK_SIZE);
+	write16(o, floatingPoint ? FORMAT_IEEE_FLOAT : FORMAT_PCM);
+	write16(o, channels);
+	write32(o, rate);
+	write32(o, rate * frameSize);
+	write16(o, frameSize);
+	write16(o, sampleBitDepth);
+}
+
+void writeData(std::ostream& o, uint64_t dataChunkSize)
+{
+	o << ID_DATA;
+	write32(o, dataChunkSize <= UINT32_MAX ? static_cast<uint32_t>(dataChunkSize) : RF64_SIZE);
+}
+
+} // namespace
+
+namespace mk {
+
+WAV::WAV(const std::string& filePath, BitDepth bitDepth, uint16_t channels, double sampleRate)
+	: PcmWriter(filePath, bitDepth, channels, sampleRate)
+{
+	if (!isOpen())
+		return;
+
+	// write RIFF, JUNK, fmt and data chunks beforehand, sizes are patched on close
+	writeHeader();
+}
+
+WAV::WAV(std::ostream& out, BitDepth bitDepth, uint16_t channels, double sampleRate, uint64_t frames)
+	: PcmWriter(out, bitDepth, channels, sampleRate, frames)
+{
+	// the declared frame count gives the final sizes, the header is never rewritten
+	writeHeader();
+}
+
+WAV::~WAV() {
+	if (!isOpen())
+		return;
+
+	finish();
+
+	// chunks are padded to an even size
+	if (dataSize() & 1) {
+		_f.put(0);
+	}
+
+	if (streaming()) {
+		_f.flush();
+		return;
+	}
+
+	// rewind stream and write the header again with the final sizes
+	_f.seekp(0);
+	writeHeader();
+}
+
+void WAV::writeHeader() {
+	const uint64_t dataChunkSize = totalFrames() * _channels * (bitsPerSample(_bitDepth) / 8);
+	const uint64_t riffSize = HEADER_SIZE - 8 + dataChunkSize + (dataChunkSize & 1);
+
+	writeRIFF(_f, riffSize);
+
+	// too large for 32-bit sizes: the file is RF64
+	// and the actual sizes are stored in the ds64 chunk
+	if (riffSize <= UINT32_MAX) {
+		writeJUNK(_f);
+	}
+	else {
+		writeDS64(_f, riffSize, dataChunkSize, totalFrames());
+	}
+
+	writeFormat(_f, _channels, bitsPerSample(_bitDepth), _sampleRate, isFloatingPoint(_bitDepth));
+	writeData(_f, riffSize <= UINT32_MAX ? dataChunkSize : RF64_SIZE);
+}
+
+void WAV::encode(const float* samples, size_t count, uint8_t* out) const {
+	if (_bitDepth == BitDepth::BitDepth8) {
+		encodePCM8Unsigned(samples, count, out);
+	}
+	else {
+		encodeSamples(samples, count, _bitDepth, ByteOrder::LittleEndian, out);
+	}
+}
+
+void WAV::encode(const double* samples, size_t count, uint8_t* out) const {
+	if (_bitDepth == BitDepth::BitDepth8) {
+		encodePCM8Unsigned(samples, count, out);
+	}
+	else {
+		encodeSamples(samples, count, _bitDepth, ByteOrder::LittleEndian, out);
+	}
+}
+
+} // namespace mk
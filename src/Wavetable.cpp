@@ -0,0 +1,240 @@
+#include "Wavetable.h"
+#include "Note.h"
+#include "Util.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr double PI = 3.141592653589793;
+constexpr double PIx2 = 2.0 * PI;
+
+// highest harmonic a table can hold
+constexpr size_t MAX_HARMONICS = mk::Wavetable::SIZE / 2 - 1;
+
+// Reads a table at a position in samples, interpolating linearly
+inline float linear(const float* table, double position) {
+	const size_t i = static_cast<size_t>(position);
+	const float t = static_cast<float>(position - i);
+	return table[i] + t * (table[i + 1] - table[i]);
+}
+
+// Reads a table at a position in samples, with a Catmull-Rom spline
+// through the two samples on each side
+inline float cubic(const float* table, double position) {
+	const size_t i = static_cast<size_t>(position);
+	const float t = static_cast<float>(position - i);
+	const float* y = table + i;
+	const float y0 = y[-1];
+	const float y1 = y[0];
+	const float y2 = y[1];
+	const float y3 = y[2];
+
+	const float a = 0.5f * (y3 - y0) + 1.5f * (y1 - y2);
+	const float b = y0 - 2.5f * y1 + 2.0f * y2 - 0.5f * y3;
+	const float c = 0.5f * (y2 - y0);
+	return ((a * t + b) * t + c) * t + y1;
+}
+
+// Wraps a position in cycles into [0;1), in both directions since negative
+// frequencies run through the cycle backwards. Tiny negative positions round
+// up to 1.0 once wrapped, which is the start of the next cycle.
+inline double wrap(double cycle) {
+	cycle -= ::floor(cycle);
+	return cycle < 1.0 ? cycle : 0.0;
+}
+
+template<float (*Read)(const float*, double)>
+void renderTable(const float* table, double cycle, double increment, float amplitude, float* out, size_t frames) {
+	const double size = static_cast<double>(mk::Wavetable::SIZE);
+	for (size_t i = 0; i < frames; ++i) {
+		out[i] = amplitude * Read(table, cycle * size);
+
+		cycle += increment;
+		if (cycle >= 1.0 || cycle < 0.0) {
+			cycle = wrap(cycle);
+		}
+	}
+}
+
+} // namespace
+
+namespace mk {
+
+constexpr size_t Wavetable::SIZE;
+constexpr size_t Wavetable::OCTAVES;
+
+Wavetable::Wavetable(Waveform waveform, double sampleRate)
+	: _sampleRate(sampleRate)
+{
+	std::vector<double> sines(MAX_HARMONICS + 1);
+	for (size_t k = 1; k <= MAX_HARMONICS; ++k) {
+		switch (waveform) {
+			case Waveform::Sine:
+			sines[k] = k == 1 ? 1.0 : 0.0;
+			break;
+
+			case Waveform::Saw:
+			sines[k] = -2.0 / (PI * k);
+			break;
+
+			case Waveform::Square:
+			sines[k] = k % 2 ? 4.0 / (PI * k) : 0.0;
+			break;
+
+			case Waveform::Triangle:
+			sines[k] = k % 2 ? (k % 4 == 1 ? 8.0 : -8.0) / (PI * PI * k * k) : 0.0;
+			break;
+		}
+	}
+	build(std::vector<double>(MAX_HARMONICS + 1), sines);
+
+	// band-limiting overshoots the ideal waveform (Gibbs phenomenon),
+	// scale all tables by the peak of the one with the most harmonics
+	float peak = 0.0f;
+	for (size_t i = 0; i < SIZE; ++i) {
+		peak = std::max(peak, std::abs(table(0)[i]));
+	}
+	for (auto& t : _tables) {
+		for (auto& sample : t) {
+			sample /= peak;
+		}
+	}
+}
+
+Wavetable::Wavetable(const std::vector<double>& harmonics, double sampleRate)
+	: _sampleRate(sampleRate)
+{
+	std::vector<double> sines(1);
+	sines.insert(sines.end(), harmonics.begin(), harmonics.end());
+	sines.resize(std::min(sines.size(), MAX_HARMONICS + 1));
+	build(std::vector<double>(sines.size()), sines);
+}
+
+Wavetable::Wavetable(const float* cycle, size_t size, double sampleRate)
+	: _sampleRate(sampleRate)
+{
+	// a table of the sine over one cycle turns the transform into lookups
+	std::vector<double> sine(size);
+	for (size_t i = 0; i < size; ++i) {
+		sine[i] = ::sin(PIx2 * i / size);
+	}
+
+	const size_t harmonics = std::min(size > 0 ? (size - 1) / 2 : 0, MAX_HARMONICS);
+	std::vector<double> cosines(harmonics + 1);
+	std::vector<double> sines(harmonics + 1);
+	for (size_t k = 1; k <= harmonics; ++k) {
+		for (size_t i = 0; i < size; ++i) {
+			const size_t phase = (k * i) % size;
+			cosines[k] += cycle[i] * sine[(phase + size / 4) % size];
+			sines[k] += cycle[i] * sine[phase];
+		}
+		cosines[k] *= 2.0 / size;
+		sines[k] *= 2.0 / size;
+	}
+
+	build(cosines, sines);
+
+	// the DC offset is kept as is
+	double dc = 0.0;
+	for (size_t i = 0; i < size; ++i) {
+		dc += cycle[i];
+	}
+	dc /= std::max<size_t>(size, 1);
+	for (auto& t : _tables) {
+		for (auto& sample : t) {
+			sample += static_cast<float>(dc);
+		}
+	}
+}
+
+size_t Wavetable::octave(double frequency) const {
+	// octave n covers [f0 * 2^n; f0 * 2^(n + 1)) where f0 is the frequency of
+	// key 0, negative frequencies reading the table of their magnitude
+	const double octaves = ::log2(std::abs(frequency) / Note::min().frequency());
+	return !(octaves > 0.0) ? 0 : std::min(static_cast<size_t>(octaves), OCTAVES - 1);
+}
+
+void Wavetable::build(const std::vector<double>& cosines, const std::vector<double>& sines) {
+	const double nyquist = _sampleRate / 2.0;
+	const size_t count = std::min(cosines.size(), sines.size());
+
+	// one period of the sine, which the harmonics are read from
+	std::vector<double> sine(SIZE);
+	for (size_t i = 0; i < SIZE; ++i) {
+		sine[i] = ::sin(PIx2 * i / SIZE);
+	}
+
+	// octaves are built from the highest one, which has the fewest harmonics,
+	// each adding its extra harmonics to a copy of the octave above
+	std::vector<double> sum(SIZE);
+	size_t harmonics = 0;
+	for (size_t octave = OCTAVES; octave-- > 0;) {
+		// the highest frequency read from this table is the next octave's first
+		const double maxFrequency = Note::min().frequency() * ::exp2(octave + 1.0);
+		const size_t octaveHarmonics = clamp<size_t>(static_cast<size_t>(nyquist / maxFrequency), 1, count > 0 ? count - 1 : 0);
+
+		for (size_t k = harmonics + 1; k <= octaveHarmonics; ++k) {
+			if (cosines[k] == 0.0 && sines[k] == 0.0)
+				continue;
+
+			for (size_t i = 0; i < SIZE; ++i) {
+				const size_t phase = (k * i) % SIZE;
+				sum[i] += cosines[k] * sine[(phase + SIZE / 4) % SIZE] + sines[k] * sine[phase];
+			}
+		}
+		harmonics = std::max(harmonics, octaveHarmonics);
+		_harmonics[octave] = harmonics;
+
+		// copy with wrapped guard samples around the cycle
+		std::vector<float>& table = _tables[octave];
+		table.resize(SIZE + 3);
+		table[0] = static_cast<float>(sum[SIZE - 1]);
+		for (size_t i = 0; i < SIZE; ++i) {
+			table[i + 1] = static_cast<float>(sum[i]);
+		}
+		table[SIZE + 1] = table[1];
+		table[SIZE + 2] = table[2];
+	}
+}
+
+WavetableOscillator::WavetableOscillator(const Wavetable& wavetable, double frequency)
+	: _wavetable(&wavetable)
+	, _frequency(frequency)
+	, _amplitude(1.0)
+	, _interpolation(Interpolation::Linear)
+	, _cycle(0.0)
+{
+}
+
+double WavetableOscillator::operator()(double time) const {
+	const double cycle = wrap(_frequency * time);
+
+	const float* table = _wavetable->table(_wavetable->octave(_frequency));
+	const double position = cycle * Wavetable::SIZE;
+	return _amplitude * (_interpolation == Interpolation::Cubic ? cubic(table, position) : linear(table, position));
+}
+
+void WavetableOscillator::render(float* out, size_t frames, double sampleRate) {
+	const double increment = _frequency / sampleRate;
+	const float* table = _wavetable->table(_wavetable->octave(_frequency));
+	const float amplitude = static_cast<float>(_amplitude);
+
+	if (_interpolation == Interpolation::Cubic) {
+		renderTable<cubic>(table, _cycle, increment, amplitude, out, frames);
+	}
+	else {
+		renderTable<linear>(table, _cycle, increment, amplitude, out, frames);
+	}
+
+	// resynchronize with the exact position, like the sine's phase
+	_cycle = wrap(_cycle + frames * increment);
+	_renderedFrames += frames;
+}
+
+void WavetableOscillator::reset() {
+	AudioModule::reset();
+	_cycle = 0.0;
+}
+
+} // namespace mk
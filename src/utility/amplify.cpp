@@ -1,12 +1,24 @@
 #include "Util.h"
+#include <cstring>
 #include <iostream>
 
 int main(int argc, char* argv[]) {
-	if (argc != 4) {
+	const bool automated = argc >= 2 && strcmp(argv[1], "--automation") == 0;
+	if (argc != (automated ? 5 : 4)) {
 		std::cerr << "Missing parameters. Usage: " << argv[0] << " <input audio file path> <output audio file path> <gain factor in dB>" << std::endl;
+		std::cerr << "   or: " << argv[0] << " --automation <input audio file path> <output audio file path> <time:dB,... or breakpoints file path>" << std::endl;
 		return 1;
 	}
 
+	if (automated) {
+		// breakpoints in seconds, ramping gains linearly in dB, e.g. a fade in
+		// of 2 seconds: 0:-inf,2:0
+		mk::Automation gain;
+		if (!gain.read(argv[4]))
+			return 1;
+		return !mk::amplify(argv[2], argv[3], gain);
+	}
+
 	const std::string inputFilePath(argv[1]);
 	const std::string outputFilePath(argv[2]);
 	char* end;
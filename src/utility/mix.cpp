@@ -1,9 +1,100 @@
 #include "Util.h"
+#include <cstring>
 #include <iostream>
 
+namespace {
+
+void printUsage(const char* program) {
+	std::cerr << "Usage: " << program << " <1st input audio file path> <2nd input audio file path> <output audio file path> [gain1 [gain2]]" << std::endl;
+	std::cerr << "   or: " << program << " [--double] -o <output audio file path> <input audio file path> [-g <dB>] [-m <channel map>]..." << std::endl;
+	std::cerr << "Options following an input file apply to it:" << std::endl;
+	std::cerr << "  -g <dB>             gain" << std::endl;
+	std::cerr << "  -m <channel map>    output channel of each channel, from 0, e.g. '1' or '1,0'" << std::endl;
+	std::cerr << "  --double            sum samples in double precision" << std::endl;
+}
+
+bool parseGain(const char* value, double& gain) {
+	char* end;
+	gain = strtod(value, &end);
+	if (value == end) {
+		std::cerr << "Incorrect gain value: '" << value << "', pass a value in dB" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+/// Parses a comma separated list of output channels
+bool parseChannelMap(const char* value, std::vector<uint16_t>& channelMap) {
+	channelMap.clear();
+	const char* p = value;
+	for (;;) {
+		char* end;
+		const long channel = strtol(p, &end, 10);
+		if (p == end || channel < 0 || channel > 1023) {
+			std::cerr << "Incorrect channel map: '" << value << "'" << std::endl;
+			return false;
+		}
+		channelMap.push_back(static_cast<uint16_t>(channel));
+		if (*end == '\0')
+			return true;
+		if (*end != ',') {
+			std::cerr << "Incorrect channel map: '" << value << "'" << std::endl;
+			return false;
+		}
+		p = end + 1;
+	}
+}
+
+int mixFiles(int argc, char* argv[]) {
+	std::string outputFilePath;
+	std::vector<mk::MixInput> inputs;
+	mk::MixPrecision precision = mk::MixPrecision::Float;
+
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--double") == 0) {
+			precision = mk::MixPrecision::Double;
+		}
+		else if (strcmp(argv[i], "-o") == 0 && hasValue) {
+			outputFilePath = argv[++i];
+		}
+		else if ((strcmp(argv[i], "-g") == 0 || strcmp(argv[i], "-m") == 0) && hasValue) {
+			if (inputs.empty()) {
+				std::cerr << argv[i] << " must follow an input file" << std::endl;
+				return 1;
+			}
+			if (argv[i][1] == 'g' ? !parseGain(argv[i + 1], inputs.back().gain) : !parseChannelMap(argv[i + 1], inputs.back().channelMap))
+				return 1;
+			++i;
+		}
+		else if (argv[i][0] == '-') {
+			std::cerr << "Unknown option or missing value: '" << argv[i] << "'" << std::endl;
+			printUsage(argv[0]);
+			return 1;
+		}
+		else {
+			inputs.push_back(mk::MixInput(argv[i]));
+		}
+	}
+
+	if (outputFilePath.empty() || inputs.empty()) {
+		std::cerr << "Missing parameters. ";
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	return !mk::mix(inputs, outputFilePath, precision);
+}
+
+} // namespace
+
 int main(int argc, char* argv[]) {
+	if (argc >= 2 && argv[1][0] == '-')
+		return mixFiles(argc, argv);
+
 	if (argc < 4) {
-		std::cerr << "Missing parameters. Usage: " << argv[0] << " <1st input audio file path> <2nd input audio file path> <output audio file path>" << std::endl;
+		std::cerr << "Missing parameters. ";
+		printUsage(argv[0]);
 		return 1;
 	}
 
@@ -14,23 +105,11 @@ int main(int argc, char* argv[]) {
 	double gain1 = 0.0;
 	double gain2 = 0.0;
 
-	if (argc >= 5) {
-		char* end;
-		gain1 = strtod(argv[4], &end);
-		if (argv[4] == end) {
-			std::cerr << "Incorrect gain value: '" << argv[4] << "', pass a value in dB" << std::endl;
-			return 1;
-		}
-	}
+	if (argc >= 5 && !parseGain(argv[4], gain1))
+		return 1;
 
-	if (argc >= 6) {
-		char* end;
-		gain2 = strtod(argv[5], &end);
-		if (argv[5] == end) {
-			std::cerr << "Incorrect gain value: '" << argv[5] << "', pass a value in dB" << std::endl;
-			return 1;
-		}
-	}
+	if (argc >= 6 && !parseGain(argv[5], gain2))
+		return 1;
 
 	return !mk::mix(inputFilePath1, inputFilePath2, outputFilePath, gain1, gain2);
 }
@@ -0,0 +1,116 @@
+#include "Batch.h"
+#include "ThreadPool.h"
+#include "Util.h"
+#include <cstring>
+#include <glob.h>
+#include <iostream>
+
+namespace {
+
+void printUsage(const char* program) {
+	std::cerr << "Usage: " << program << " [--threads <count>] <output directory> <operation> <input audio file path or pattern>..." << std::endl;
+	std::cerr << "Operations:" << std::endl;
+	std::cerr << "  normalize <dB>      normalize each file to a peak value, 0 dB at most" << std::endl;
+	std::cerr << "  album <dB>          normalize all files with one gain, bringing their loudest peak to a value" << std::endl;
+	std::cerr << "  amplify <dB>        amplify each file" << std::endl;
+	std::cerr << "  invert              invert the phase of each file" << std::endl;
+	std::cerr << "  pan <position>      pan each stereo file, from -1 (left) to 1 (right)" << std::endl;
+	std::cerr << "Patterns such as 'masters/*.aiff' are expanded, so they may be quoted." << std::endl;
+}
+
+/// Appends the files matching a pattern, or the path itself if it's not one
+void expand(const char* pattern, std::vector<std::string>& paths) {
+	glob_t matches;
+	if (strpbrk(pattern, "*?[") && ::glob(pattern, 0, nullptr, &matches) == 0) {
+		for (size_t i = 0; i < matches.gl_pathc; ++i) {
+			paths.push_back(matches.gl_pathv[i]);
+		}
+		globfree(&matches);
+	}
+	else {
+		paths.push_back(pattern);
+	}
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+	int arg = 1;
+	size_t threads = std::thread::hardware_concurrency();
+	if (arg + 1 < argc && strcmp(argv[arg], "--threads") == 0) {
+		char* end;
+		const long count = strtol(argv[arg + 1], &end, 10);
+		if (argv[arg + 1] == end || count <= 0) {
+			std::cerr << "Incorrect thread count: '" << argv[arg + 1] << "'" << std::endl;
+			return 1;
+		}
+		threads = static_cast<size_t>(count);
+		arg += 2;
+	}
+
+	if (argc - arg < 3) {
+		std::cerr << "Missing parameters. ";
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	const std::string outputDirectory(argv[arg++]);
+	const std::string operation(argv[arg++]);
+
+	// operations taking a value
+	double value = 0.0;
+	if (operation == "normalize" || operation == "album" || operation == "amplify" || operation == "pan") {
+		char* end;
+		value = strtod(argv[arg], &end);
+		if (argv[arg] == end) {
+			std::cerr << "Incorrect value for " << operation << ": '" << argv[arg] << "'" << std::endl;
+			return 1;
+		}
+		++arg;
+	}
+	else if (operation != "invert") {
+		std::cerr << "Unknown operation: '" << operation << "'" << std::endl;
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	std::vector<std::string> inputFilePaths;
+	for (; arg < argc; ++arg) {
+		expand(argv[arg], inputFilePaths);
+	}
+	if (inputFilePaths.empty()) {
+		std::cerr << "No input files" << std::endl;
+		return 1;
+	}
+
+	mk::ThreadPool pool(threads);
+	mk::BatchReport report;
+	if (operation == "album") {
+		report = mk::normalizeAlbum(inputFilePaths, outputDirectory, static_cast<float>(value), pool);
+	}
+	else {
+		mk::FileOperation fileOperation;
+		if (operation == "normalize") {
+			fileOperation = [value](const std::string& in, const std::string& out) { return mk::normalize(in, out, static_cast<float>(value)); };
+		}
+		else if (operation == "amplify") {
+			fileOperation = [value](const std::string& in, const std::string& out) { return mk::amplify(in, out, static_cast<float>(value)); };
+		}
+		else if (operation == "invert") {
+			fileOperation = [](const std::string& in, const std::string& out) { return mk::invertPhase(in, out); };
+		}
+		else {
+			fileOperation = [value](const std::string& in, const std::string& out) { return mk::panStereoFile(in, out, value); };
+		}
+		report = mk::processBatch(inputFilePaths, outputDirectory, fileOperation, pool);
+	}
+
+	for (const auto& failure : report.failures) {
+		std::cerr << "Failed: " << failure << std::endl;
+	}
+	std::cout << "Processed " << report.succeeded << " of " << inputFilePaths.size() << " file(s), "
+			  << report.bytes / 1.0e6 << " MB in " << report.seconds << " s on " << pool.size() << " thread(s): "
+			  << report.megabytesPerSecond() << " MB/s, " << (report.seconds > 0.0 ? report.succeeded / report.seconds : 0.0) << " files/s" << std::endl;
+
+	return report.failures.empty() ? 0 : 1;
+}
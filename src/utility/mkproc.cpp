@@ -0,0 +1,105 @@
+#include "ThreadPool.h"
+#include "Util.h"
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+void printUsage(const char* program) {
+	std::cerr << "Usage: " << program << " <input audio file path> <output audio file path> <stage>..." << std::endl;
+	std::cerr << "Stages, applied in order:" << std::endl;
+	std::cerr << "  --gain <dB>         amplify" << std::endl;
+	std::cerr << "  --gain-automation <time:dB,... or breakpoints file path>" << std::endl;
+	std::cerr << "                      amplify, ramping between gains at times in seconds" << std::endl;
+	std::cerr << "  --clamp             limit samples to [-1;1]" << std::endl;
+	std::cerr << "  --invert            invert phase" << std::endl;
+	std::cerr << "  --pan <position>    pan a stereo file, from -1 (left) to 1 (right)" << std::endl;
+	std::cerr << "  --pan-automation <time:position,... or breakpoints file path>" << std::endl;
+	std::cerr << "                      pan a stereo file, ramping between positions" << std::endl;
+	std::cerr << "  --normalize <dB>    normalize to a peak value, 0 dB at most" << std::endl;
+}
+
+/// Parses the value of the option at argv[i]
+bool parseValue(int argc, char* argv[], int i, double& value) {
+	if (i + 1 >= argc) {
+		std::cerr << "Missing value for " << argv[i] << std::endl;
+		return false;
+	}
+
+	char* end;
+	value = strtod(argv[i + 1], &end);
+	if (argv[i + 1] == end) {
+		std::cerr << "Incorrect value for " << argv[i] << ": '" << argv[i + 1] << "'" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+/// Parses the breakpoints of the option at argv[i], or reads them from the
+/// file it names
+bool parseAutomation(int argc, char* argv[], int i, mk::Automation& automation) {
+	if (i + 1 >= argc) {
+		std::cerr << "Missing breakpoints for " << argv[i] << std::endl;
+		return false;
+	}
+	return automation.read(argv[i + 1]);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+	if (argc < 4) {
+		std::cerr << "Missing parameters. ";
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	const std::string inputFilePath(argv[1]);
+	const std::string outputFilePath(argv[2]);
+
+	mk::Pipeline pipeline;
+	for (int i = 3; i < argc; ++i) {
+		double value;
+		mk::Automation automation;
+		if (strcmp(argv[i], "--gain") == 0) {
+			if (!parseValue(argc, argv, i++, value))
+				return 1;
+			pipeline.gain(value);
+		}
+		else if (strcmp(argv[i], "--gain-automation") == 0) {
+			if (!parseAutomation(argc, argv, i++, automation))
+				return 1;
+			pipeline.gain(automation);
+		}
+		else if (strcmp(argv[i], "--clamp") == 0) {
+			pipeline.clamp();
+		}
+		else if (strcmp(argv[i], "--invert") == 0) {
+			pipeline.invert();
+		}
+		else if (strcmp(argv[i], "--pan") == 0) {
+			if (!parseValue(argc, argv, i++, value))
+				return 1;
+			pipeline.pan(value);
+		}
+		else if (strcmp(argv[i], "--pan-automation") == 0) {
+			if (!parseAutomation(argc, argv, i++, automation))
+				return 1;
+			pipeline.pan(automation);
+		}
+		else if (strcmp(argv[i], "--normalize") == 0) {
+			if (!parseValue(argc, argv, i++, value))
+				return 1;
+			pipeline.normalize(value);
+		}
+		else {
+			std::cerr << "Unknown stage: '" << argv[i] << "'" << std::endl;
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	// a normalizing first stage scans the input file on all cores
+	mk::ThreadPool pool;
+	return !mk::process(inputFilePath, outputFilePath, pipeline, &pool);
+}
@@ -1,3 +1,4 @@
+#include "ThreadPool.h"
 #include "Util.h"
 #include <iostream>
 
@@ -16,5 +17,7 @@ int main(int argc, char* argv[]) {
 		return 1;
 	}
 
-	return !mk::normalize(inputFilePath, outputFilePath, peak);
+	// scan the input file on all cores
+	mk::ThreadPool pool;
+	return !mk::normalize(inputFilePath, outputFilePath, peak, &pool);
 }
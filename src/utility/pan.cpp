@@ -1,4 +1,5 @@
 #include "Util.h"
+#include <cstring>
 #include <iostream>
 
 const std::string& commandHelp = "Pans a stereo file into a stereo field position using constant power.";
@@ -25,11 +26,22 @@ void printHelp(int argc, char** argv) {
 int main(int argc, char* argv[]) {
 //	printHelp(argc, argv);
 
-	if (argc != 4) {
+	const bool automated = argc >= 2 && strcmp(argv[1], "--automation") == 0;
+	if (argc != (automated ? 5 : 4)) {
 		std::cerr << "Missing parameters. Usage: " << argv[0] << " <input audio file path> <output audio file path> <pan position>" << std::endl;
+		std::cerr << "   or: " << argv[0] << " --automation <input audio file path> <output audio file path> <time:position,... or breakpoints file path>" << std::endl;
 		return 1;
 	}
 
+	if (automated) {
+		// breakpoints in seconds, e.g. a sweep from left to right over 4
+		// seconds: 0:-1,4:1
+		mk::Automation positions;
+		if (!positions.read(argv[4]))
+			return 1;
+		return !mk::panStereoFile(argv[2], argv[3], positions);
+	}
+
 	const std::string inputFilePath(argv[1]);
 	const std::string outputFilePath(argv[2]);
 
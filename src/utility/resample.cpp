@@ -0,0 +1,36 @@
+#include "Util.h"
+#include <cstring>
+#include <iostream>
+
+int main(int argc, char* argv[]) {
+	if (argc < 4) {
+		std::cerr << "Missing parameters. Usage: " << argv[0] << " <input audio file path> <output audio file path> <sample rate> [fast | medium | best]" << std::endl;
+		return 1;
+	}
+
+	const std::string inputFilePath(argv[1]);
+	const std::string outputFilePath(argv[2]);
+
+	char* end;
+	const long sampleRate = strtol(argv[3], &end, 10);
+	if (argv[3] == end || sampleRate <= 0 || sampleRate > 768000) {
+		std::cerr << "Incorrect sample rate: '" << argv[3] << "', pass a value in Hz" << std::endl;
+		return 1;
+	}
+
+	mk::ResamplerQuality quality = mk::ResamplerQuality::Medium;
+	if (argc >= 5) {
+		if (strcmp(argv[4], "fast") == 0) {
+			quality = mk::ResamplerQuality::Fast;
+		}
+		else if (strcmp(argv[4], "best") == 0) {
+			quality = mk::ResamplerQuality::Best;
+		}
+		else if (strcmp(argv[4], "medium") != 0) {
+			std::cerr << "Incorrect quality: '" << argv[4] << "', pass fast, medium or best" << std::endl;
+			return 1;
+		}
+	}
+
+	return !mk::resample(inputFilePath, outputFilePath, static_cast<uint32_t>(sampleRate), quality);
+}
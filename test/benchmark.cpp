@@ -0,0 +1,587 @@
+#include "AIFF.h"
+#include "Combinators.h"
+#include "PeakIndex.h"
+#include "Pipeline.h"
+#include "RenderEngine.h"
+#include "Resampler.h"
+#include "SinCos.h"
+#include "Synthesis.h"
+#include "VoiceEngine.h"
+#include "Wavetable.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+using namespace mk;
+
+namespace {
+
+const char* BENCHMARK_FILE = "benchmark.aiff";
+
+// seconds of audio rendered by each write benchmark
+constexpr double DURATION = 60.0;
+
+// frames handed to the writer in each block
+constexpr size_t BLOCK_FRAMES = 4096;
+
+// results of benchmarked loops end up here so they aren't optimized away
+volatile double sink;
+
+double secondsSince(const chrono::steady_clock::time_point& start) {
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+// Measures AIFF write throughput in MB/s (of encoded PCM data) for the
+// block API and for the per-sample stream operator
+void benchmarkAIFFWrite() {
+	const BitDepth depths[] { BitDepth::BitDepth16, BitDepth::BitDepth24 };
+	const uint16_t channelCounts[] { 1, 2, 8 };
+	const double sampleRate = SAMPLE_RATE_48K;
+	const size_t frames = static_cast<size_t>(DURATION * sampleRate);
+
+	cout << "AIFF write throughput (" << DURATION << " s @ " << sampleRate << " Hz)" << endl;
+	cout << "Depth\tChannels\tBlock MB/s\tAsync MB/s\tSample MB/s" << endl;
+
+	for (auto depth : depths) {
+		for (auto channels : channelCounts) {
+			// a block of interleaved samples sweeping the full dynamic range
+			vector<float> block(BLOCK_FRAMES * channels);
+			for (size_t i = 0; i < block.size(); ++i) {
+				block[i] = 2.0f * i / block.size() - 1.0f;
+			}
+
+			const double megabytes = frames * channels * (bitsPerSample(depth) / 8) / 1.0e6;
+
+			double blockSeconds;
+			{
+				const auto start = chrono::steady_clock::now();
+				AIFF aiff(BENCHMARK_FILE, depth, channels, sampleRate);
+				for (size_t i = 0; i < frames; i += BLOCK_FRAMES) {
+					aiff.write(block.data(), std::min(BLOCK_FRAMES, frames - i));
+				}
+				aiff.flush();
+				blockSeconds = secondsSince(start);
+			}
+
+			double asyncSeconds;
+			{
+				const auto start = chrono::steady_clock::now();
+				AIFF aiff(BENCHMARK_FILE, depth, channels, sampleRate);
+				aiff.enableAsync();
+				for (size_t i = 0; i < frames; i += BLOCK_FRAMES) {
+					aiff.write(block.data(), std::min(BLOCK_FRAMES, frames - i));
+				}
+				aiff.flush();
+				asyncSeconds = secondsSince(start);
+			}
+
+			double sampleSeconds;
+			{
+				const auto start = chrono::steady_clock::now();
+				AIFF aiff(BENCHMARK_FILE, depth, channels, sampleRate);
+				for (size_t i = 0; i < frames * channels; ++i) {
+					aiff << block[i % block.size()];
+				}
+				aiff.flush();
+				sampleSeconds = secondsSince(start);
+			}
+
+			cout << bitsPerSample(depth) << "\t" << channels << "\t\t"
+				 << megabytes / blockSeconds << "\t\t"
+				 << megabytes / asyncSeconds << "\t\t"
+				 << megabytes / sampleSeconds << endl;
+		}
+	}
+
+	remove(BENCHMARK_FILE);
+}
+
+// Measures oscillator throughput in millions of samples per second when
+// sampling operator() per sample and when rendering blocks
+void benchmarkRender() {
+	const double sampleRate = SAMPLE_RATE_48K;
+	const size_t frames = static_cast<size_t>(DURATION * sampleRate);
+	vector<float> block(BLOCK_FRAMES);
+
+	SineWave sine(440.0);
+	SawWave saw(440.0);
+
+	const Wavetable sawTable(Waveform::Saw, sampleRate);
+	WavetableOscillator linearSaw(sawTable, 440.0);
+	WavetableOscillator cubicSaw(sawTable, 440.0);
+	cubicSaw._interpolation = Interpolation::Cubic;
+
+	// ramping over the whole duration
+	ADEnvelope envelope(0.0, 1.0, 0.0, DURATION / 2, DURATION / 2);
+
+	AudioModule* modules[] { &sine, &saw, &linearSaw, &cubicSaw, &envelope };
+	const char* names[] { "Sine", "Saw", "Table saw (linear)", "Table saw (cubic)", "AD envelope" };
+
+	cout << "Oscillator throughput (" << DURATION << " s @ " << sampleRate << " Hz)" << endl;
+	cout << "Module\tSample MS/s\tBlock MS/s" << endl;
+
+	for (size_t m = 0; m < 5; ++m) {
+		AudioModule& module = *modules[m];
+
+		double sum = 0.0;
+
+		const auto sampleStart = chrono::steady_clock::now();
+		const double dt = 1.0 / sampleRate;
+		double t = 0.0;
+		for (size_t i = 0; i < frames; ++i, t += dt) {
+			sum += module(t);
+		}
+		const double sampleSeconds = secondsSince(sampleStart);
+
+		const auto blockStart = chrono::steady_clock::now();
+		for (size_t i = 0; i < frames; i += BLOCK_FRAMES) {
+			module.render(block.data(), std::min(BLOCK_FRAMES, frames - i), sampleRate);
+			sum += block[0];
+		}
+		const double blockSeconds = secondsSince(blockStart);
+
+		sink = sum;
+
+		cout << names[m] << "\t" << frames / sampleSeconds / 1.0e6 << "\t\t"
+			 << frames / blockSeconds / 1.0e6 << endl;
+	}
+}
+
+// Measures sine throughput in millions of samples per second for std::sin
+// and the vectorized kernels
+void benchmarkSinCos() {
+	const size_t count = 4096;
+	const size_t repeats = 2000;
+	const double PIx2 = 2.0 * 3.141592653589793;
+
+	vector<float> phases(count);
+	for (size_t i = 0; i < count; ++i) {
+		phases[i] = -2.0f + 4.0f * i / count;
+	}
+	vector<float> sines(count);
+	vector<float> cosines(count);
+
+	cout << "Sine throughput (" << MK_SINCOS_PRECISION << "-bit kernels, max error " << SINCOS_MAX_ERROR << ")" << endl;
+	cout << "std::sin MS/s\tsinCycles MS/s\tsinCosCycles MS/s\tsinCyclesRamp MS/s" << endl;
+
+	double sum = 0.0;
+
+	auto start = chrono::steady_clock::now();
+	for (size_t r = 0; r < repeats; ++r) {
+		for (size_t i = 0; i < count; ++i) {
+			sines[i] = static_cast<float>(::sin(PIx2 * phases[i]));
+		}
+		sum += sines[r % count];
+	}
+	const double stdSeconds = secondsSince(start);
+
+	start = chrono::steady_clock::now();
+	for (size_t r = 0; r < repeats; ++r) {
+		sinCycles(phases.data(), count, sines.data());
+		sum += sines[r % count];
+	}
+	const double sinSeconds = secondsSince(start);
+
+	start = chrono::steady_clock::now();
+	for (size_t r = 0; r < repeats; ++r) {
+		sinCosCycles(phases.data(), count, sines.data(), cosines.data());
+		sum += cosines[r % count];
+	}
+	const double sinCosSeconds = secondsSince(start);
+
+	start = chrono::steady_clock::now();
+	for (size_t r = 0; r < repeats; ++r) {
+		sinCyclesRamp(0.1 * r, 0.01, count, sines.data());
+		sum += sines[r % count];
+	}
+	const double rampSeconds = secondsSince(start);
+
+	sink = sum;
+
+	const double samples = count * repeats / 1.0e6;
+	cout << samples / stdSeconds << "\t\t" << samples / sinSeconds << "\t\t"
+		 << samples / sinCosSeconds << "\t\t\t" << samples / rampSeconds << endl;
+}
+
+// Measures how many voice-samples per second the voice engine renders,
+// compared with summing separate SineWave modules
+void benchmarkVoices() {
+	const double sampleRate = SAMPLE_RATE_48K;
+	const size_t frames = static_cast<size_t>(sampleRate);
+	const size_t voiceCounts[] { 16, 256, 4096 };
+	vector<float> block(BLOCK_FRAMES);
+	vector<float> mix(BLOCK_FRAMES);
+
+	cout << "Voice throughput (1 s @ " << sampleRate << " Hz)" << endl;
+	cout << "Voices\tEngine MS/s\tModules MS/s" << endl;
+
+	for (auto voices : voiceCounts) {
+		VoiceEngine engine(voices, sampleRate);
+		vector<SineWave> modules;
+		for (size_t v = 0; v < voices; ++v) {
+			// partials of a 55 Hz tone, folded below 20 KHz
+			const double frequency = 55.0 * (1 + v % 360);
+			engine.start(frequency, 1.0f / voices, static_cast<uint32_t>(v));
+			modules.emplace_back(frequency);
+		}
+
+		double sum = 0.0;
+
+		auto start = chrono::steady_clock::now();
+		for (size_t i = 0; i < frames; i += BLOCK_FRAMES) {
+			engine.render(block.data(), std::min(BLOCK_FRAMES, frames - i));
+			sum += block[0];
+		}
+		const double engineSeconds = secondsSince(start);
+
+		start = chrono::steady_clock::now();
+		for (size_t i = 0; i < frames; i += BLOCK_FRAMES) {
+			const size_t n = std::min(BLOCK_FRAMES, frames - i);
+			std::fill(mix.begin(), mix.end(), 0.0f);
+			for (auto& module : modules) {
+				module.render(block.data(), n, sampleRate);
+				for (size_t j = 0; j < n; ++j) {
+					mix[j] += block[j] / voices;
+				}
+			}
+			sum += mix[0];
+		}
+		const double moduleSeconds = secondsSince(start);
+
+		sink = sum;
+
+		const double samples = voices * frames / 1.0e6;
+		cout << voices << "\t" << samples / engineSeconds << "\t\t" << samples / moduleSeconds << endl;
+	}
+}
+
+// Runtime graph nodes combining two modules through virtual calls
+struct RuntimeMul : public AudioModule {
+	RuntimeMul(AudioModule& a, AudioModule& b) : _a(a), _b(b), _scratch(BLOCK_FRAMES) {}
+
+	double operator()(double time) const override { return _a(time) * _b(time); }
+
+	void render(float* out, size_t frames, double sampleRate) override {
+		_a.render(out, frames, sampleRate);
+		_b.render(_scratch.data(), frames, sampleRate);
+		for (size_t i = 0; i < frames; ++i) {
+			out[i] *= _scratch[i];
+		}
+	}
+
+	AudioModule& _a;
+	AudioModule& _b;
+	vector<float> _scratch;
+};
+
+struct RuntimeSum : public RuntimeMul {
+	RuntimeSum(AudioModule& a, AudioModule& b) : RuntimeMul(a, b) {}
+
+	double operator()(double time) const override { return _a(time) + _b(time); }
+
+	void render(float* out, size_t frames, double sampleRate) override {
+		_a.render(out, frames, sampleRate);
+		_b.render(_scratch.data(), frames, sampleRate);
+		for (size_t i = 0; i < frames; ++i) {
+			out[i] += _scratch[i];
+		}
+	}
+};
+
+// Measures the throughput of a 5-node chain, envelope * (sine + saw), in
+// millions of samples per second, composed at runtime and at compile time
+void benchmarkCombinators() {
+	const double sampleRate = SAMPLE_RATE_48K;
+	const size_t frames = static_cast<size_t>(DURATION * sampleRate);
+	vector<float> block(BLOCK_FRAMES);
+
+	ADEnvelope envelope(0.0, 1.0, 0.0, DURATION / 2, DURATION / 2);
+	SineWave sine(440.0);
+	SawWave saw(220.0);
+	RuntimeSum sum(sine, saw);
+	RuntimeMul runtimeChain(envelope, sum);
+
+	Mul<ADEnvelope, Sum<SineWave, SawWave>> staticChain(envelope, Sum<SineWave, SawWave>(440.0, 220.0));
+
+	AudioModule* chains[] { &runtimeChain, &staticChain };
+	const char* names[] { "Virtual", "Static" };
+
+	cout << "Chain throughput (" << DURATION << " s @ " << sampleRate << " Hz)" << endl;
+	cout << "Chain\tSample MS/s\tBlock MS/s" << endl;
+
+	for (size_t c = 0; c < 2; ++c) {
+		double sum = 0.0;
+
+		const auto sampleStart = chrono::steady_clock::now();
+		const double dt = 1.0 / sampleRate;
+		double t = 0.0;
+		if (c == 0) {
+			for (size_t i = 0; i < frames; ++i, t += dt) {
+				sum += runtimeChain(t);
+			}
+		}
+		else {
+			// called on the concrete type, as code composing modules statically does
+			for (size_t i = 0; i < frames; ++i, t += dt) {
+				sum += staticChain.Mul<ADEnvelope, Sum<SineWave, SawWave>>::operator()(t);
+			}
+		}
+		const double sampleSeconds = secondsSince(sampleStart);
+
+		const auto blockStart = chrono::steady_clock::now();
+		for (size_t i = 0; i < frames; i += BLOCK_FRAMES) {
+			chains[c]->render(block.data(), std::min(BLOCK_FRAMES, frames - i), sampleRate);
+			sum += block[0];
+		}
+		const double blockSeconds = secondsSince(blockStart);
+
+		sink = sum;
+
+		cout << names[c] << "\t" << frames / sampleSeconds / 1.0e6 << "\t\t"
+			 << frames / blockSeconds / 1.0e6 << endl;
+	}
+}
+
+// Measures render times and deadline misses of a 64-voice engine driven by
+// the simulated device clock for a second, at several buffer sizes
+void benchmarkRenderEngine() {
+	const double sampleRate = SAMPLE_RATE_48K;
+	const size_t bufferSizes[] { 32, 64, 256, 1024 };
+
+	cout << "Render engine, 64 voices @ " << sampleRate << " Hz" << endl;
+	cout << "Buffer\tPeriod us\tAverage us\tWorst us\tWorst latency us\tMisses" << endl;
+
+	for (auto frames : bufferSizes) {
+		VoiceEngine voices(64, sampleRate);
+		for (int i = 0; i < 64; ++i) {
+			voices.start(110.0 * (i + 1), 1.0f / 64, i);
+		}
+
+		RenderEngine engine(frames, sampleRate);
+		engine.setCallback([&](float* out, size_t n) { voices.render(out, n); });
+		engine.run(static_cast<uint64_t>(sampleRate / frames));
+
+		const RenderStats stats = engine.stats();
+		cout << frames << "\t" << stats.periodSeconds * 1.0e6 << "\t\t"
+			 << stats.averageRenderSeconds * 1.0e6 << "\t\t"
+			 << stats.worstRenderSeconds * 1.0e6 << "\t\t"
+			 << stats.worstLatencySeconds * 1.0e6 << "\t\t\t"
+			 << stats.deadlineMisses << endl;
+	}
+}
+
+// Measures stereo resampling throughput from 44.1 kHz to 48 kHz and back,
+// in millions of input frames per second, for each quality
+void benchmarkResampler() {
+	const size_t frames = 10 * 44100;
+	vector<float> input(2 * frames);
+	for (size_t i = 0; i < input.size(); ++i) {
+		input[i] = static_cast<float>(::sin(0.01 * i));
+	}
+
+	const ResamplerQuality qualities[] { ResamplerQuality::Fast, ResamplerQuality::Medium, ResamplerQuality::Best };
+	const char* names[] { "Fast", "Medium", "Best" };
+
+	cout << "Resampler throughput (stereo)" << endl;
+	cout << "Quality\tTaps\t44.1k>48k MF/s\t48k>44.1k MF/s" << endl;
+
+	for (size_t q = 0; q < 3; ++q) {
+		Resampler up(44100, 48000, 2, qualities[q]);
+		Resampler down(48000, 44100, 2, qualities[q]);
+		vector<float> output(2 * up.maxOutputFrames(BLOCK_FRAMES));
+		double sum = 0.0;
+
+		auto start = chrono::steady_clock::now();
+		for (size_t i = 0; i < frames; i += BLOCK_FRAMES) {
+			const size_t n = up.process(&input[2 * i], std::min(BLOCK_FRAMES, frames - i), output.data());
+			sum += output[n / 2];
+		}
+		const double upSeconds = secondsSince(start);
+
+		start = chrono::steady_clock::now();
+		for (size_t i = 0; i < frames; i += BLOCK_FRAMES) {
+			const size_t n = down.process(&input[2 * i], std::min(BLOCK_FRAMES, frames - i), output.data());
+			sum += output[n / 2];
+		}
+		const double downSeconds = secondsSince(start);
+		sink = sum;
+
+		cout << names[q] << "\t" << up.taps() << "/" << down.taps() << "\t"
+			 << frames / upSeconds / 1.0e6 << "\t\t" << frames / downSeconds / 1.0e6 << endl;
+	}
+}
+
+// Measures envelope output in millions of points per second, as text with a
+// flush per line, as buffered text, and into a buffer or a range
+void benchmarkEnvelopeOutput() {
+	const double sampleRate = SAMPLE_RATE_48K;
+	const double duration = 20.0;
+	const auto points = exponentialEnvelope(0.0, duration, 1.0, 0.0, sampleRate);
+
+	cout << "Envelope output (" << duration << " s @ " << sampleRate << " Hz)" << endl;
+	cout << "Flushed text MP/s\tText MP/s\tBuffer MP/s\tRange MP/s" << endl;
+
+	double flushedSeconds;
+	{
+		ofstream o(BENCHMARK_FILE);
+		const auto start = chrono::steady_clock::now();
+		for (const EnvelopePoint point : points) {
+			o << point.time << '\t' << point.level << endl;
+		}
+		flushedSeconds = secondsSince(start);
+	}
+
+	double textSeconds;
+	{
+		ofstream o(BENCHMARK_FILE);
+		const auto start = chrono::steady_clock::now();
+		exponentialEnvelope(o, 0.0, duration, 1.0, 0.0, sampleRate);
+		o.flush();
+		textSeconds = secondsSince(start);
+	}
+
+	vector<float> levels(points.size());
+	auto start = chrono::steady_clock::now();
+	exponentialEnvelope(levels.data(), levels.size(), 0.0, duration, 1.0, 0.0, sampleRate);
+	const double bufferSeconds = secondsSince(start);
+
+	double sum = levels.back();
+	start = chrono::steady_clock::now();
+	for (const EnvelopePoint point : points) {
+		sum += point.level;
+	}
+	const double rangeSeconds = secondsSince(start);
+	sink = sum;
+
+	const double megapoints = points.size() / 1.0e6;
+	cout << megapoints / flushedSeconds << "\t\t\t" << megapoints / textSeconds << "\t\t"
+		 << megapoints / bufferSeconds << "\t\t" << megapoints / rangeSeconds << endl;
+
+	remove(BENCHMARK_FILE);
+}
+
+// Measures the peak search in GB/s of samples, with a branch per sample as
+// scanMax() used to and with the vectorized kernel, on signals whose peaks
+// are rare (random), absent (silent) or everywhere (clipped)
+void benchmarkPeakScan() {
+	const size_t count = 16 * 1024 * 1024;
+	const int passes = 8;
+	vector<float> random(count);
+	uint32_t seed = 1;
+	for (size_t i = 0; i < count; ++i) {
+		seed = seed * 1664525u + 1013904223u;
+		random[i] = static_cast<float>((seed >> 8) / 16777216.0 - 0.5);
+	}
+	vector<float> silent(count, 0.0f);
+	vector<float> clipped(count);
+	for (size_t i = 0; i < count; ++i) {
+		clipped[i] = i % 3 ? 1.0f : -1.0f;
+	}
+
+	const vector<float>* signals[] { &random, &silent, &clipped };
+	const char* names[] { "Random", "Silent", "Clipped" };
+
+	cout << "Peak scan (" << count / (1024 * 1024) << "M samples)" << endl;
+	cout << "Signal	Branch GB/s	Kernel GB/s" << endl;
+
+	for (size_t s = 0; s < 3; ++s) {
+		const vector<float>& samples = *signals[s];
+		const double gigabytes = passes * count * sizeof(float) / 1.0e9;
+		size_t found = 0;
+
+		auto start = chrono::steady_clock::now();
+		for (int pass = 0; pass < passes; ++pass) {
+			float max = 0.0f;
+			size_t peak = 0;
+			for (size_t i = 0; i < count; ++i) {
+				if (std::abs(max) < std::abs(samples[i])) {
+					max = samples[i];
+					peak = i;
+				}
+			}
+			found += peak;
+		}
+		const double branchSeconds = secondsSince(start);
+
+		start = chrono::steady_clock::now();
+		for (int pass = 0; pass < passes; ++pass) {
+			found += findPeak(samples.data(), count);
+		}
+		const double kernelSeconds = secondsSince(start);
+		sink = found;
+
+		cout << names[s] << "	" << gigabytes / branchSeconds << "		" << gigabytes / kernelSeconds << endl;
+	}
+}
+
+void benchmarkAutomation() {
+	const uint32_t sampleRate = 48000;
+	const size_t frames = 60 * sampleRate;
+	vector<float> samples(2 * frames, 0.5f);
+
+	// a ramp per second, against evaluating the automation at each frame
+	Automation gain;
+	Automation positions;
+	for (int second = 0; second <= 60; ++second) {
+		gain.add(second, second % 2 ? -24.0 : 0.0);
+		positions.add(second, second % 2 ? -0.8 : 0.8);
+	}
+
+	cout << "Automation (" << frames / sampleRate << " s stereo at " << sampleRate << " Hz)" << endl;
+	cout << "Parameter	Per frame Mframes/s	Ramps Mframes/s" << endl;
+
+	auto start = chrono::steady_clock::now();
+	for (size_t i = 0; i < frames; ++i) {
+		const double ratio = pow(10.0, gain.valueAt(static_cast<double>(i) / sampleRate) / 20.0);
+		samples[2 * i] *= ratio;
+		samples[2 * i + 1] *= ratio;
+	}
+	const double gainFrameSeconds = secondsSince(start);
+
+	GainAutomationStage gainStage(gain);
+	gainStage.prepare(2, sampleRate);
+	start = chrono::steady_clock::now();
+	for (size_t i = 0; i < frames; i += BLOCK_FRAMES) {
+		gainStage.process(&samples[2 * i], min(BLOCK_FRAMES, frames - i), 2);
+	}
+	const double gainRampSeconds = secondsSince(start);
+
+	start = chrono::steady_clock::now();
+	for (size_t i = 0; i < frames; ++i) {
+		const double angle = positions.valueAt(static_cast<double>(i) / sampleRate) * M_PI / 4.0;
+		samples[2 * i] *= M_SQRT1_2 * (sin(angle) - cos(angle));
+		samples[2 * i + 1] *= M_SQRT1_2 * (sin(angle) + cos(angle));
+	}
+	const double panFrameSeconds = secondsSince(start);
+
+	PanAutomationStage panStage(positions);
+	panStage.prepare(2, sampleRate);
+	start = chrono::steady_clock::now();
+	for (size_t i = 0; i < frames; i += BLOCK_FRAMES) {
+		panStage.process(&samples[2 * i], min(BLOCK_FRAMES, frames - i), 2);
+	}
+	const double panRampSeconds = secondsSince(start);
+	sink = samples[frames];
+
+	cout << "Gain	" << frames / gainFrameSeconds / 1.0e6 << "			" << frames / gainRampSeconds / 1.0e6 << endl;
+	cout << "Pan	" << frames / panFrameSeconds / 1.0e6 << "			" << frames / panRampSeconds / 1.0e6 << endl;
+}
+
+int main(int argc, char* argv[]) {
+	benchmarkAIFFWrite();
+	benchmarkRender();
+	benchmarkSinCos();
+	benchmarkVoices();
+	benchmarkCombinators();
+	benchmarkRenderEngine();
+	benchmarkResampler();
+	benchmarkEnvelopeOutput();
+	benchmarkPeakScan();
+	benchmarkAutomation();
+}
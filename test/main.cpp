@@ -2,12 +2,35 @@
 #include "Scale.h"
 #include "Synthesis.h"
 #include "AIFF.h"
+#include "AIFFReader.h"
+#include "Batch.h"
+#include "Combinators.h"
 #include "IEEEExtended.h"
+#include "PatchGraph.h"
+#include "PeakIndex.h"
+#include "PCM.h"
+#include "Pipeline.h"
+#include "Resampler.h"
+#include "RenderEngine.h"
+#include "SinCos.h"
+#include "ThreadPool.h"
 #include "Util.h"
+#include "VoiceEngine.h"
+#include "WAV.h"
+#include "Wavetable.h"
+#include <sndfile.h>
 #include <iostream>
 #include <fstream>
+#include <limits>
 #include <vector>
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+#include <string>
+#include <thread>
 
 using namespace std;
 using namespace mk;
@@ -130,6 +153,35 @@ void exponentialEnvelopes() {
 		exponentialEnvelope(o, 0.0, 0.3, 1.0e-4, 1.0, sampleRate);
 		exponentialEnvelope(o, 0.3, 2.0, 1.0, 1.0e-4, sampleRate);
 	}
+	{
+		// buffers and ranges hold the same levels as the text output
+		const auto attack = exponentialEnvelope(0, 1, -1, 1, SAMPLE_RATE_22050);
+		assert(attack.size() == 22051);
+
+		std::vector<float> levels(attack.size() + 10);
+		assert(exponentialEnvelope(levels.data(), levels.size(), 0, 1, -1, 1, SAMPLE_RATE_22050) == attack.size());
+		assert(levels.front() == -1.0f && std::abs(levels[attack.size() - 1] - 1.0f) < 1.0e-6f);
+
+		std::ifstream text("attack.txt");
+		size_t i = 0;
+		for (const EnvelopePoint point : attack) {
+			assert(static_cast<float>(point.level) == levels[i]);
+			assert(std::abs(point.time - i / SAMPLE_RATE_22050) < 1.0e-12);
+
+			double time, level;
+			text >> time >> level;
+			assert(time == point.time && level == point.level);
+			++i;
+		}
+		assert(i == attack.size());
+		double extra;
+		assert(!(text >> extra));
+
+		// at any sample rate, and empty for invalid ranges
+		assert(exponentialEnvelope(0, 1, 0, 1, 1.0e6).size() == 1000001);
+		assert(exponentialEnvelope(1, 1, 0, 1, SAMPLE_RATE_44100).size() == 0);
+		assert(exponentialEnvelope(levels.data(), levels.size(), 0, 1, 0, 1, 0.0) == 0);
+	}
 }
 
 void writeSineWaveToFile()
@@ -162,6 +214,24 @@ void writeSineWaveToAIFF() {
 	}
 }
 
+void writeSineWaveBlocksToAIFF() {
+	const auto sampleRate = SAMPLE_RATE_48K;
+	const double frequency = 440.0;
+	const auto channels = 1;
+	const double duration = 1.0;
+
+	mk::AIFF aiff("synthesis/sine_440Hz@48KHz_blocks.aiff", BitDepth::BitDepth16, channels, sampleRate);
+
+	mk::SineWave sineWave(frequency);
+	std::vector<float> block(4096);
+	const size_t frames = static_cast<size_t>(duration * sampleRate);
+	for (size_t i = 0; i < frames; i += block.size()) {
+		const size_t n = std::min(block.size(), frames - i);
+		sineWave.render(block.data(), n, sampleRate);
+		aiff.write(block.data(), n);
+	}
+}
+
 void writeSawWaveToAIFF() {
 	const auto sampleRate = SAMPLE_RATE_48K;
 	const double frequency = 440.0;
@@ -188,6 +258,1398 @@ void writeSawWaveToAIFF() {
 	}
 }
 
+// Block writes and per-sample writes must produce identical files
+void writeAIFFBlocks() {
+	const BitDepth depths[] { BitDepth::BitDepth16, BitDepth::BitDepth24 };
+	const uint16_t channels = 3;
+	const size_t frames = 50000;
+
+	std::vector<double> samples(frames * channels);
+	for (size_t i = 0; i < samples.size(); ++i) {
+		samples[i] = 1.5 * ::sin(0.001 * i);
+	}
+
+	for (auto depth : depths) {
+		{
+			mk::AIFF aiff("synthesis/block.aiff", depth, channels, SAMPLE_RATE_44100);
+			aiff.write(samples.data(), frames / 2);
+			aiff.write(samples.data() + frames / 2 * channels, frames - frames / 2);
+		}
+		{
+			mk::AIFF aiff("synthesis/sample.aiff", depth, channels, SAMPLE_RATE_44100);
+			for (auto s : samples) {
+				aiff << s;
+			}
+		}
+
+		std::ifstream block("synthesis/block.aiff", std::ios::binary);
+		std::ifstream sample("synthesis/sample.aiff", std::ios::binary);
+		const std::string blockBytes((std::istreambuf_iterator<char>(block)), std::istreambuf_iterator<char>());
+		const std::string sampleBytes((std::istreambuf_iterator<char>(sample)), std::istreambuf_iterator<char>());
+		assert(blockBytes.size() == 54 + samples.size() * bitsPerSample(depth) / 8);
+		assert(blockBytes == sampleBytes);
+	}
+}
+
+// Vectorized PCM kernels must match the scalar quantizer bit by bit
+void encodePCMKernels() {
+	std::vector<double> samples { 0.0, -0.0, 1.0, -1.0, 1.5, -1.5, 1.0e9, -1.0e9,
+								  HUGE_VAL, -HUGE_VAL, 1.0 / 32767, -1.0 / 32767, 0.99999, -0.99999 };
+	uint32_t seed = 1;
+	while (samples.size() < 1003) {
+		seed = seed * 1664525 + 1013904223;
+		samples.push_back(2.5 * (seed / 4294967296.0) - 1.25);
+	}
+	const std::vector<float> floats(samples.begin(), samples.end());
+
+	std::vector<uint8_t> out16(samples.size() * 2), out16f(samples.size() * 2);
+	std::vector<uint8_t> out24(samples.size() * 3), out24f(samples.size() * 3);
+	encodePCM16BE(&samples[0], samples.size(), &out16[0]);
+	encodePCM16BE(&floats[0], floats.size(), &out16f[0]);
+	encodePCM24BE(&samples[0], samples.size(), &out24[0]);
+	encodePCM24BE(&floats[0], floats.size(), &out24f[0]);
+
+	for (size_t i = 0; i < samples.size(); ++i) {
+		const int32_t s = static_cast<int32_t>(32767 * clamp(samples[i], -1.0, 1.0));
+		assert(out16[2 * i] == static_cast<uint8_t>(s >> 8) && out16[2 * i + 1] == static_cast<uint8_t>(s));
+
+		const int32_t f = static_cast<int32_t>(32767 * clamp<double>(floats[i], -1.0, 1.0));
+		assert(out16f[2 * i] == static_cast<uint8_t>(f >> 8) && out16f[2 * i + 1] == static_cast<uint8_t>(f));
+	}
+
+	for (size_t i = 0; i < samples.size(); ++i) {
+		const int32_t s = static_cast<int32_t>(8388607 * clamp(samples[i], -1.0, 1.0));
+		assert(out24[3 * i] == static_cast<uint8_t>(s >> 16) &&
+			   out24[3 * i + 1] == static_cast<uint8_t>(s >> 8) &&
+			   out24[3 * i + 2] == static_cast<uint8_t>(s));
+
+		const int32_t f = static_cast<int32_t>(8388607 * clamp<double>(floats[i], -1.0, 1.0));
+		assert(out24f[3 * i] == static_cast<uint8_t>(f >> 16) &&
+			   out24f[3 * i + 1] == static_cast<uint8_t>(f >> 8) &&
+			   out24f[3 * i + 2] == static_cast<uint8_t>(f));
+	}
+}
+
+// Files written by mk::AIFF must decode to the quantized samples
+void readAIFF() {
+	const BitDepth depths[] { BitDepth::BitDepth16, BitDepth::BitDepth24 };
+	const uint16_t channels = 2;
+	const size_t frames = 12345;
+
+	std::vector<float> samples(frames * channels);
+	for (size_t i = 0; i < samples.size(); ++i) {
+		samples[i] = ::sin(0.01 * i);
+	}
+
+	for (auto depth : depths) {
+		{
+			mk::AIFF aiff("synthesis/read.aiff", depth, channels, SAMPLE_RATE_96K);
+			aiff.write(samples.data(), frames);
+		}
+
+		mk::AIFFReader reader("synthesis/read.aiff");
+		assert(reader.valid());
+		assert(reader.channels() == channels);
+		assert(reader.frames() == frames);
+		assert(reader.bitDepth() == depth);
+		assert(reader.sampleRate() == SAMPLE_RATE_96K);
+
+		const double scale = depth == BitDepth::BitDepth16 ? 32767.0 : 8388607.0;
+		const double norm = depth == BitDepth::BitDepth16 ? 32768.0 : 8388608.0;
+
+		// decode an unaligned range that runs past the last frame
+		std::vector<float> decoded(frames * channels);
+		const size_t first = 7;
+		assert(reader.read(first, frames, decoded.data()) == frames - first);
+		for (size_t i = 0; i < (frames - first) * channels; ++i) {
+			const int32_t s = static_cast<int32_t>(scale * samples[first * channels + i]);
+			assert(decoded[i] == static_cast<float>(s / norm));
+		}
+		assert(reader.read(frames, 1, decoded.data()) == 0);
+	}
+}
+
+// 8 and 32-bit integer files and AIFF-C floating-point files must round-trip
+void readAIFFFormats() {
+	const uint16_t channels = 3;
+	const size_t frames = 1001;
+
+	std::vector<double> samples(frames * channels);
+	for (size_t i = 0; i < samples.size(); ++i) {
+		samples[i] = 1.25 * ::sin(0.01 * i);
+	}
+
+	const BitDepth depths[] { BitDepth::BitDepth8, BitDepth::BitDepth32, BitDepth::Float32, BitDepth::Float64 };
+	for (auto depth : depths) {
+		{
+			mk::AIFF aiff("synthesis/formats.aiff", depth, channels, SAMPLE_RATE_48K);
+			aiff.write(samples.data(), frames);
+		}
+
+		mk::AIFFReader reader("synthesis/formats.aiff");
+		assert(reader.valid());
+		assert(reader.bitDepth() == depth);
+		assert(reader.frames() == frames);
+		assert(reader.sampleRate() == SAMPLE_RATE_48K);
+
+		std::vector<float> decoded(samples.size());
+		assert(reader.read(0, frames, decoded.data()) == frames);
+		for (size_t i = 0; i < samples.size(); ++i) {
+			switch (depth) {
+			case BitDepth::BitDepth8:
+				assert(decoded[i] == static_cast<int8_t>(127 * clamp(samples[i], -1.0, 1.0)) / 128.0f);
+			break;
+
+			case BitDepth::BitDepth32:
+				assert(std::abs(decoded[i] - clamp(samples[i], -1.0, 1.0)) < 1.0e-7);
+			break;
+
+			default:
+				// floating-point samples are neither clamped nor quantized
+				assert(decoded[i] == static_cast<float>(samples[i]));
+			break;
+			}
+		}
+	}
+}
+
+// WAV files store little-endian samples after an 80 byte header
+void writeWAV() {
+	const uint16_t channels = 2;
+	const size_t frames = 1001;
+
+	std::vector<float> samples(frames * channels);
+	for (size_t i = 0; i < samples.size(); ++i) {
+		samples[i] = ::sin(0.01 * i);
+	}
+
+	const BitDepth depths[] { BitDepth::BitDepth8, BitDepth::BitDepth16, BitDepth::BitDepth24, BitDepth::Float32 };
+	for (auto depth : depths) {
+		{
+			mk::WAV wav("synthesis/write.wav", depth, channels, SAMPLE_RATE_44100);
+			wav.write(samples.data(), frames - 1);
+			for (size_t i = 0; i < channels; ++i) {
+				wav << samples[(frames - 1) * channels + i];
+			}
+			assert(wav.frames() == frames);
+		}
+
+		std::ifstream f("synthesis/write.wav", std::ios::binary);
+		const std::string bytes((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+		const size_t dataSize = samples.size() * bitsPerSample(depth) / 8;
+		const auto read32 = [&bytes](size_t i) {
+			return static_cast<uint32_t>(static_cast<uint8_t>(bytes[i]) |
+										 static_cast<uint8_t>(bytes[i + 1]) << 8 |
+										 static_cast<uint8_t>(bytes[i + 2]) << 16 |
+										 static_cast<uint8_t>(bytes[i + 3]) << 24);
+		};
+
+		assert(bytes.size() == 80 + dataSize + (dataSize & 1));
+		assert(bytes.compare(0, 4, "RIFF") == 0 && bytes.compare(8, 4, "WAVE") == 0);
+		assert(read32(4) == bytes.size() - 8);
+		assert(bytes.compare(48, 4, "fmt ") == 0 && bytes.compare(72, 4, "data") == 0);
+		assert(read32(60) == 44100);
+		assert(read32(76) == dataSize);
+
+		std::vector<uint8_t> expected(dataSize);
+		if (depth == BitDepth::BitDepth8) {
+			encodePCM8Unsigned(samples.data(), samples.size(), expected.data());
+		}
+		else {
+			encodeSamples(samples.data(), samples.size(), depth, ByteOrder::LittleEndian, expected.data());
+		}
+		assert(bytes.compare(80, dataSize, std::string(expected.begin(), expected.end())) == 0);
+	}
+
+	// 16-bit little-endian samples are plain int16_t values on little-endian hosts
+	std::vector<int16_t> pcm(samples.size());
+	encodeSamples(samples.data(), samples.size(), BitDepth::BitDepth16, ByteOrder::LittleEndian,
+				  reinterpret_cast<uint8_t*>(pcm.data()));
+	const uint16_t one = 1;
+	if (*reinterpret_cast<const uint8_t*>(&one) == 1) {
+		for (size_t i = 0; i < samples.size(); ++i) {
+			assert(pcm[i] == static_cast<int16_t>(32767.0 * samples[i]));
+		}
+	}
+}
+
+// Writing on a background thread must produce the same file
+void writeAIFFAsync() {
+	const uint16_t channels = 2;
+	const size_t frames = 300000;
+
+	std::vector<float> samples(frames * channels);
+	for (size_t i = 0; i < samples.size(); ++i) {
+		samples[i] = ::sin(0.001 * i);
+	}
+
+	{
+		mk::AIFF aiff("synthesis/sync.aiff", BitDepth::BitDepth24, channels, SAMPLE_RATE_48K);
+		aiff.write(samples.data(), frames);
+	}
+
+	const size_t queueDepths[] { 1, 4 };
+	for (auto queueDepth : queueDepths) {
+		{
+			mk::AIFF aiff("synthesis/async.aiff", BitDepth::BitDepth24, channels, SAMPLE_RATE_48K);
+			aiff.enableAsync(queueDepth);
+			for (size_t i = 0; i < frames; i += 1000) {
+				aiff.write(samples.data() + i * channels, std::min<size_t>(1000, frames - i));
+			}
+		}
+
+		std::ifstream sync("synthesis/sync.aiff", std::ios::binary);
+		std::ifstream async("synthesis/async.aiff", std::ios::binary);
+		const std::string syncBytes((std::istreambuf_iterator<char>(sync)), std::istreambuf_iterator<char>());
+		const std::string asyncBytes((std::istreambuf_iterator<char>(async)), std::istreambuf_iterator<char>());
+		assert(syncBytes == asyncBytes);
+	}
+
+	// samples written one at a time go through the writer thread too
+	{
+		mk::AIFF aiff("synthesis/async_samples.aiff", BitDepth::BitDepth24, channels, SAMPLE_RATE_48K);
+		aiff.enableAsync();
+		for (auto sample : samples) {
+			aiff << sample;
+		}
+	}
+	std::ifstream sync("synthesis/sync.aiff", std::ios::binary);
+	std::ifstream async("synthesis/async_samples.aiff", std::ios::binary);
+	const std::string syncBytes((std::istreambuf_iterator<char>(sync)), std::istreambuf_iterator<char>());
+	const std::string asyncBytes((std::istreambuf_iterator<char>(async)), std::istreambuf_iterator<char>());
+	assert(syncBytes == asyncBytes);
+}
+
+// Block rendering must follow the per-sample signal without drifting
+void renderOscillators() {
+	const double sampleRate = SAMPLE_RATE_48K;
+	const size_t blockFrames = 1000;
+	const double PIx2 = 2.0 * 3.141592653589793;
+	std::vector<float> block(blockFrames);
+
+	// an hour of sine in blocks, checking the last one against absolute time
+	SineWave sine(440.0);
+	const size_t hour = static_cast<size_t>(3600 * sampleRate);
+	for (size_t i = 0; i < hour; i += blockFrames) {
+		sine.render(block.data(), blockFrames, sampleRate);
+		if (i == 0 || i + blockFrames >= hour) {
+			for (size_t j = 0; j < blockFrames; ++j) {
+				const double cycles = 440.0 * (i + j) / sampleRate;
+				assert(std::abs(block[j] - ::sin(PIx2 * (cycles - ::floor(cycles)))) < mk::SINCOS_MAX_ERROR);
+			}
+		}
+	}
+	assert(sine._renderedFrames == hour);
+
+	// blocks of different sizes render the same signal after a reset
+	sine.reset();
+	std::vector<float> whole(3 * blockFrames);
+	sine.render(whole.data(), whole.size(), sampleRate);
+	sine.reset();
+	sine.render(block.data(), 7, sampleRate);
+	for (size_t j = 0; j < 7; ++j) {
+		assert(block[j] == whole[j]);
+	}
+
+	SawWave saw(100.0);
+	saw._amplitude = 0.5;
+	saw._polarity = -1.0;
+	saw.render(whole.data(), whole.size(), sampleRate);
+	for (size_t j = 0; j < whole.size(); ++j) {
+		// skip the discontinuities, where rounding may pick either side
+		const double cycle = 100.0 * j / sampleRate;
+		if (cycle - ::floor(cycle) > 1.0e-9 && ::ceil(cycle) - cycle > 1.0e-9) {
+			assert(std::abs(whole[j] - saw(j / sampleRate)) < 1.0e-6);
+		}
+	}
+
+	// a negative frequency ramps down through the same range, block after block
+	SawWave down(-100.0);
+	down._amplitude = 0.5;
+	down.render(whole.data(), 7, sampleRate);
+	down.render(whole.data() + 7, whole.size() - 7, sampleRate);
+	for (size_t j = 0; j < whole.size(); ++j) {
+		const double cycles = -100.0 * j / sampleRate;
+		const double cycle = cycles - ::floor(cycles);
+		assert(whole[j] >= -0.5f && whole[j] <= 0.5f);
+		if (cycle > 1.0e-9 && 1.0 - cycle > 1.0e-9) {
+			assert(std::abs(whole[j] - (cycle - 0.5)) < 1.0e-6);
+		}
+	}
+
+	// modules without their own render() sample operator()
+	struct Ramp : public AudioModule {
+		double operator()(double time) const override { return time; }
+	} ramp;
+	ramp.render(block.data(), blockFrames, sampleRate);
+	ramp.render(block.data(), blockFrames, sampleRate);
+	assert(block[0] == static_cast<float>(blockFrames / sampleRate));
+}
+
+// Envelopes render their exponential segments on exact frames and
+// follow operator() until released
+void envelopes() {
+	const double sampleRate = SAMPLE_RATE_44100;
+
+	ADEnvelope ad(0.0, 1.0, 0.5, 0.01, 0.02);
+	std::vector<float> whole(2000);
+	ad.render(whole.data(), whole.size(), sampleRate);
+	assert(whole[0] == 0.0f && whole[441] == 1.0f && whole[441 + 882] == 0.5f && whole.back() == 0.5f);
+	assert(whole[440] < 1.0f && whole[442] < 1.0f && whole[1322] > 0.5f);
+	for (size_t i = 0; i < whole.size(); ++i) {
+		assert(std::abs(whole[i] - ad(i / sampleRate)) < 1.0e-6);
+	}
+	assert(ad.finished() && ad._renderedFrames == whole.size());
+
+	// blocks of any size render the same samples
+	ad.reset();
+	assert(!ad.finished() && ad.level() == 0.0);
+	std::vector<float> block(whole.size());
+	for (size_t first = 0, n = 1; first < block.size(); first += n, n += 7) {
+		ad.render(block.data() + first, std::min(n, block.size() - first), sampleRate);
+	}
+	assert(block == whole);
+
+	// ADSR holds its sustain level until released, then fades out
+	ADSREnvelope adsr(0.001, 0.002, 0.25, 0.005);
+	block.assign(1000, 0.0f);
+	adsr.render(block.data(), block.size(), sampleRate);
+	assert(block[0] == 0.0f && block[44] == 1.0f && block[44 + 88] == 0.25f && block.back() == 0.25f);
+	assert(!adsr.finished() && adsr(1.0) == 0.25);
+	adsr.release();
+	adsr.render(block.data(), block.size(), sampleRate);
+	assert(block[0] == 0.25f && block[100] < 0.25f && block[221] == 0.0f && block.back() == 0.0f);
+	assert(adsr.finished());
+
+	// retriggering during the decay ramps up again from the current level
+	adsr.reset();
+	adsr.render(block.data(), 60, sampleRate);
+	const float level = static_cast<float>(adsr.level());
+	assert(level < 1.0f && level > 0.25f);
+	adsr.trigger();
+	adsr.render(block.data(), 100, sampleRate);
+	assert(block[0] == level && block[1] > level && block[44] == 1.0f);
+
+	// applied as the gain of an oscillator
+	SineWave sine(440.0);
+	std::vector<float> tone(whole.size());
+	sine.render(tone.data(), tone.size(), sampleRate);
+	ad.reset();
+	ad.apply(tone.data(), tone.size(), sampleRate);
+	sine.reset();
+	sine.render(block.data(), tone.size(), sampleRate);
+	for (size_t i = 0; i < tone.size(); ++i) {
+		assert(tone[i] == block[i] * whole[i]);
+	}
+
+	// multi-segment breakpoints with an instant jump
+	Envelope steps(1.0, {{0.0, 0.001}, {0.8, 0.0}, {0.8, 0.001}, {0.1, 0.001}});
+	block.assign(200, 0.0f);
+	steps.render(block.data(), block.size(), sampleRate);
+	assert(block[0] == 1.0f && block[44] == 0.8f && block[88] == 0.8f && block[132] == 0.1f);
+	assert(block[43] < 0.01f && block[60] == 0.8f);
+	assert(steps.finished());
+}
+
+// Combinators render the same signal as their modules combined by hand
+void combinatorModules() {
+	const double sampleRate = SAMPLE_RATE_44100;
+	const size_t frames = 1000;
+
+	Mul<ADEnvelope, SineWave> voice(ADEnvelope(0.0, 1.0, 0.0, 0.005, 0.01), SineWave(440.0));
+	std::vector<float> out(frames);
+	voice.render(out.data(), 3, sampleRate);
+	voice.render(out.data() + 3, frames - 3, sampleRate);
+	assert(voice._renderedFrames == frames);
+	assert(std::get<1>(voice._modules)._renderedFrames == frames);
+
+	ADEnvelope envelope(0.0, 1.0, 0.0, 0.005, 0.01);
+	SineWave sine(440.0);
+	std::vector<float> expected(frames);
+	sine.render(expected.data(), frames, sampleRate);
+	envelope.apply(expected.data(), frames, sampleRate);
+	assert(out == expected);
+	assert(voice(0.002) == envelope(0.002) * sine(0.002));
+
+	// nested, with a runtime module plugged in by reference
+	SawWave saw(110.0);
+	AudioModule& runtimeSaw = saw;
+	Gain<Sum<SineWave, ModuleRef, Constant>> mix(Sum<SineWave, ModuleRef, Constant>(SineWave(440.0), runtimeSaw, Constant(0.25)), 0.5);
+	AudioModule& module = mix;
+	module.render(out.data(), frames, sampleRate);
+	assert(saw._renderedFrames == frames);
+
+	sine.reset();
+	saw.reset();
+	sine.render(expected.data(), frames, sampleRate);
+	std::vector<float> sawBlock(frames);
+	saw.render(sawBlock.data(), frames, sampleRate);
+	for (size_t i = 0; i < frames; ++i) {
+		assert(std::abs(out[i] - 0.5f * (expected[i] + sawBlock[i] + 0.25f)) < 1.0e-6f);
+	}
+	assert(std::abs(module(0.001) - 0.5 * (sine(0.001) + saw(0.001) + 0.25)) < 1.0e-12);
+
+	// resets reach every module
+	module.reset();
+	assert(mix._renderedFrames == 0 && saw._renderedFrames == 0);
+	assert(std::get<0>(mix._module._modules)._cycle == 0.0);
+}
+
+// Patch graphs render like modules combined by hand, reuse blocks along
+// chains and render levels in parallel
+void patchGraph() {
+	const double sampleRate = SAMPLE_RATE_44100;
+	const size_t frames = 1000;
+
+	// envelope * (sine + saw), and a module that doesn't reach the output
+	for (size_t threads : {1, 4}) {
+		ThreadPool pool(threads);
+		ADEnvelope envelope(0.0, 1.0, 0.0, 0.005, 0.01);
+		SineWave sine(440.0);
+		SawWave saw(110.0);
+		SineWave unused(1000.0);
+
+		PatchGraph graph(sampleRate, 64);
+		graph.setThreadPool(&pool);
+		const auto e = graph.addModule(envelope);
+		const auto sum = graph.addSum();
+		const auto product = graph.addProduct();
+		graph.connect(graph.addModule(sine), sum);
+		graph.connect(graph.addModule(saw), sum);
+		graph.connect(e, product);
+		graph.connect(sum, product);
+		graph.addModule(unused);
+		graph.setOutput(product);
+
+		std::vector<float> out(frames);
+		graph.render(out.data(), 10);
+		graph.render(out.data() + 10, frames - 10);
+		assert(graph.levelCount() == 3 && graph.bufferCount() == 4);
+		assert(unused._renderedFrames == 0);
+
+		std::vector<float> expected(frames), sawBlock(frames), envelopeBlock(frames);
+		envelope.reset();
+		sine.reset();
+		saw.reset();
+		envelope.render(envelopeBlock.data(), frames, sampleRate);
+		sine.render(expected.data(), frames, sampleRate);
+		saw.render(sawBlock.data(), frames, sampleRate);
+		for (size_t i = 0; i < frames; ++i) {
+			assert(out[i] == envelopeBlock[i] * (expected[i] + sawBlock[i]));
+		}
+	}
+
+	// a long chain only needs two blocks, whatever its length
+	SineWave sine(440.0);
+	PatchGraph chain(sampleRate);
+	auto node = chain.addModule(sine);
+	for (int i = 0; i < 10; ++i) {
+		const auto half = chain.addProcessor([](const float* const* inputs, size_t, float* out, size_t frames) {
+			for (size_t j = 0; j < frames; ++j) {
+				out[j] = 0.5f * inputs[0][j];
+			}
+		});
+		assert(chain.connect(node, half));
+		node = half;
+	}
+	chain.setOutput(node);
+	assert(chain.compile());
+	assert(chain.levelCount() == 11 && chain.bufferCount() == 2);
+
+	std::vector<float> out(frames), expected(frames);
+	chain.render(out.data(), frames);
+	sine.reset();
+	sine.render(expected.data(), frames, sampleRate);
+	for (size_t i = 0; i < frames; ++i) {
+		assert(out[i] == expected[i] / 1024.0f);
+	}
+
+	// invalid graphs render silence
+	PatchGraph cycle(sampleRate);
+	const auto a = cycle.addSum();
+	const auto b = cycle.addSum();
+	assert(cycle.connect(a, b) && cycle.connect(b, a));
+	assert(!cycle.connect(a, 7) && !chain.connect(node, 0));
+	cycle.setOutput(b);
+	assert(!cycle.compile());
+	out.assign(frames, 1.0f);
+	cycle.render(out.data(), frames);
+	assert(out == std::vector<float>(frames, 0.0f));
+
+	// thread pools run every task once
+	ThreadPool pool(3);
+	assert(pool.size() == 3);
+	std::vector<int> counts(1000);
+	for (int r = 0; r < 10; ++r) {
+		pool.run(counts.size(), [&](size_t i) { ++counts[i]; });
+	}
+	assert(counts == std::vector<int>(counts.size(), 10));
+}
+
+// Parameter changes reach modules between blocks, in order, and late
+// blocks count as deadline misses
+void renderEngine() {
+	const double sampleRate = SAMPLE_RATE_44100;
+	SawWave saw(100.0);
+	std::vector<double> frequencies;
+	frequencies.reserve(1000000);
+
+	RenderEngine engine(64, sampleRate, 16);
+	size_t sunk = 0;
+	engine.setCallback([&](float* out, size_t frames) {
+		frequencies.push_back(saw._frequency);
+		saw.render(out, frames, sampleRate);
+	});
+	engine.setSink([&](const float*, size_t frames) { sunk += frames; });
+
+	assert(engine.set(&saw._frequency, 200.0) && engine.set(&saw._amplitude, 0.5));
+	assert(saw._frequency == 100.0);
+	engine.run(2, false);
+	assert(frequencies == std::vector<double>(2, 200.0) && saw._amplitude == 0.5);
+	assert(sunk == 128 && saw._renderedFrames == 128);
+
+	// a full queue drops changes
+	for (int i = 1; i <= 16; ++i) {
+		assert(engine.set(&saw._frequency, i));
+	}
+	assert(!engine.set(&saw._frequency, 17.0));
+	engine.run(1, false);
+	assert(frequencies.back() == 16.0);
+
+	// changes from a control thread while the device thread renders
+	engine.start();
+	assert(engine.running());
+	std::thread control([&] {
+		for (int i = 1; i <= 1000; ++i) {
+			while (!engine.set(&saw._frequency, 1000.0 + i)) {
+				std::this_thread::yield();
+			}
+		}
+	});
+	control.join();
+
+	// changes queued before a block are applied when it starts
+	const uint64_t blocks = engine.stats().blocks;
+	while (engine.stats().blocks < blocks + 2) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	engine.stop();
+	assert(!engine.running() && saw._frequency == 2000.0);
+	for (size_t i = 3; i < frequencies.size(); ++i) {
+		assert(frequencies[i] >= frequencies[i - 1]);
+	}
+
+	RenderStats stats = engine.stats();
+	assert(stats.blocks == frequencies.size() && sunk == 64 * stats.blocks);
+	assert(std::abs(stats.periodSeconds - 64 / sampleRate) < 1.0e-6);
+	assert(stats.worstRenderSeconds >= stats.averageRenderSeconds && stats.worstLatencySeconds >= 0.0);
+
+	// blocks rendering slower than real time miss their deadline
+	engine.resetStats();
+	engine.enableBlockLog(4);
+	engine.setCallback([&](float* out, size_t frames) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		saw.render(out, frames, sampleRate);
+	});
+	engine.run(4);
+	stats = engine.stats();
+	assert(stats.blocks == 4 && stats.deadlineMisses == 4);
+	assert(engine.blockLog().size() == 4 && engine.blockLog()[0] >= 0.005f);
+	assert(stats.worstLatencySeconds >= 0.005);
+}
+
+// Sine and cosine kernels must stay within their documented error
+void sinCosKernels() {
+	const double PIx2 = 2.0 * 3.141592653589793;
+
+	// phases of all magnitudes, with odd counts to exercise scalar tails
+	std::vector<float> phases;
+	for (float x = 1.0e-6f; x < 1000.0f; x *= 1.0001f) {
+		phases.push_back(x);
+		phases.push_back(-x);
+	}
+	for (size_t i = 0; i <= 1000001; ++i) {
+		phases.push_back(-2.0f + 4.0f * i / 1000001);
+	}
+
+	std::vector<float> sines(phases.size());
+	std::vector<float> cosines(phases.size());
+	std::vector<float> sinesOnly(phases.size());
+	mk::sinCosCycles(phases.data(), phases.size(), sines.data(), cosines.data());
+	mk::sinCycles(phases.data(), phases.size(), sinesOnly.data());
+
+	double maxError = 0.0;
+	for (size_t i = 0; i < phases.size(); ++i) {
+		maxError = std::max(maxError, std::abs(sines[i] - ::sin(PIx2 * phases[i])));
+		maxError = std::max(maxError, std::abs(cosines[i] - ::cos(PIx2 * phases[i])));
+		assert(sines[i] == sinesOnly[i]);
+	}
+	std::cout << "sin/cos kernels max error: " << maxError << std::endl;
+	assert(maxError < mk::SINCOS_MAX_ERROR);
+
+	// ramps keep their precision however far they go
+	const double start = 0.3;
+	const double increment = 440.0 / SAMPLE_RATE_48K;
+	std::vector<float> ramp(10007);
+	for (double offset : { 0.0, 100000.0 }) {
+		mk::sinCyclesRamp(start + offset, increment, ramp.size(), ramp.data());
+		for (size_t i = 0; i < ramp.size(); ++i) {
+			assert(std::abs(ramp[i] - ::sin(PIx2 * (start + i * increment))) < mk::SINCOS_MAX_ERROR);
+		}
+	}
+}
+
+// The voice engine must sum its voices, follow their envelopes to the
+// sample and steal voices when its pool is full
+void voiceEngine() {
+	const double sampleRate = SAMPLE_RATE_48K;
+	const double PIx2 = 2.0 * 3.141592653589793;
+	std::vector<float> out(10000);
+
+	// voices without envelope sum up like separate sine waves,
+	// with more voices than SIMD lanes to exercise padding
+	VoiceEngine engine(16, sampleRate);
+	const Note notes[] { A4, C5, E5, G2, B_2, C8, Db3, D4, Eb6, E3, F1 };
+	for (auto note : notes) {
+		engine.noteOn(note, 0.05f);
+	}
+	assert(engine.activeVoices() == 11);
+	engine.render(out.data(), out.size());
+	for (size_t i = 0; i < out.size(); ++i) {
+		double expected = 0.0;
+		for (auto note : notes) {
+			const double cycles = static_cast<double>(note.frequency()) * i / sampleRate;
+			expected += 0.05 * ::sin(PIx2 * (cycles - ::floor(cycles)));
+		}
+		assert(std::abs(out[i] - expected) < 1.0e-5);
+	}
+
+	engine.noteOff(A4);
+	engine.noteOff(E5);
+	assert(engine.activeVoices() == 9);
+	engine.releaseAll();
+	assert(engine.activeVoices() == 0);
+	engine.render(out.data(), 100);
+	assert(out[0] == 0.0f && out[99] == 0.0f);
+
+	// released voices end on the exact frame
+	engine.setEnvelope(0.001, 0.002);
+	engine.noteOn(A4);
+	engine.render(out.data(), 48);
+	assert(std::abs(out[47]) > 0.0f);
+	engine.noteOff(A4);
+	engine.render(out.data(), 95);
+	assert(engine.activeVoices() == 1);
+	engine.render(out.data(), 1);
+	assert(engine.activeVoices() == 0);
+
+	// the peak level is reached at the end of the attack: with a frequency
+	// of a quarter of the sample rate, every fourth sample is a peak
+	engine.setEnvelope(100 / sampleRate, 0.0);
+	engine.start(sampleRate / 4.0, 0.5f, 1);
+	engine.render(out.data(), 105);
+	assert(std::abs(out[1] - 0.5f * 1 / 100) < 1.0e-6);
+	assert(std::abs(out[101] - 0.5f) < 1.0e-6);
+	engine.release(1);
+	assert(engine.activeVoices() == 0);
+
+	// stealing prefers released voices, then the oldest voice
+	VoiceEngine small(2, sampleRate);
+	small.setEnvelope(0.0, 1.0);
+	small.start(100.0, 1.0f, 1);
+	small.start(200.0, 1.0f, 2);
+	small.release(1);
+	small.start(300.0, 1.0f, 3);
+	small.start(400.0, 1.0f, 4);
+	assert(small.activeVoices() == 2);
+	small.release(1);
+	small.release(2);
+	small.render(out.data(), 10);
+	assert(std::abs(out[5]) > 0.0f);
+	small.release(3);
+	small.release(4);
+	small.render(out.data(), out.size());
+	assert(small.activeVoices() == 2);
+
+	// a voice stolen without attack still ramps from its level, over 5 ms
+	VoiceEngine single(1, sampleRate);
+	single.start(sampleRate / 4.0, 1.0f, 1);
+	single.render(out.data(), 4);
+	assert(std::abs(out[1] - 1.0f) < 1.0e-6);
+	single.start(sampleRate / 4.0, 0.25f, 2);
+	single.render(out.data(), 245);
+	assert(std::abs(out[1] - (1.0f - 0.75f / 240)) < 1.0e-5);
+	assert(std::abs(out[121] - (1.0f - 0.75f * 121 / 240)) < 1.0e-5);
+	assert(std::abs(out[241] - 0.25f) < 1.0e-5);
+}
+
+// Returns the amplitude of a frequency in a signal (Goertzel algorithm)
+double amplitudeAt(const std::vector<float>& signal, double frequency, double sampleRate) {
+	const double w = 2.0 * 3.141592653589793 * frequency / sampleRate;
+	double s1 = 0.0, s2 = 0.0;
+	for (auto x : signal) {
+		const double s0 = x + 2.0 * ::cos(w) * s1 - s2;
+		s2 = s1;
+		s1 = s0;
+	}
+	return 2.0 * ::sqrt(s1 * s1 + s2 * s2 - 2.0 * ::cos(w) * s1 * s2) / signal.size();
+}
+
+// Writes interleaved frames to an AIFF file through libsndfile, like the
+// file utilities read them, so they can read it back
+void writeSoundFile(const std::string& filePath, const float* samples, size_t frames, int channels, int sampleRate,
+					int format = SF_FORMAT_AIFF | SF_FORMAT_PCM_16) {
+	SF_INFO info = SF_INFO();
+	info.samplerate = sampleRate;
+	info.channels = channels;
+	info.format = format;
+	SNDFILE* file = sf_open(filePath.c_str(), SFM_WRITE, &info);
+	assert(file);
+	const sf_count_t written = sf_writef_float(file, samples, static_cast<sf_count_t>(frames));
+	assert(written == static_cast<sf_count_t>(frames));
+	sf_close(file);
+}
+
+// Reads all frames of a file written by the file utilities through libsndfile
+std::vector<float> readSoundFile(const std::string& filePath, SF_INFO& info) {
+	info = SF_INFO();
+	SNDFILE* file = sf_open(filePath.c_str(), SFM_READ, &info);
+	assert(file);
+	std::vector<float> samples(static_cast<size_t>(info.frames * info.channels));
+	const sf_count_t read = sf_readf_float(file, samples.data(), info.frames);
+	assert(read == info.frames);
+	sf_close(file);
+	return samples;
+}
+
+// Wavetable oscillators must not alias and must follow their waveform
+void wavetableOscillators() {
+	const double sampleRate = SAMPLE_RATE_48K;
+	const Wavetable saw(Waveform::Saw, sampleRate);
+
+	// no table holds harmonics above the Nyquist frequency for its octave
+	for (size_t octave = 0; octave < Wavetable::OCTAVES; ++octave) {
+		const double maxFrequency = Note::min().frequency() * ::exp2(octave + 1.0);
+		assert(saw.harmonics(octave) * maxFrequency <= sampleRate / 2 || saw.harmonics(octave) == 1);
+	}
+	assert(saw.octave(Note::min().frequency()) == 0);
+	assert(saw.octave(Note(127).frequency()) == Wavetable::OCTAVES - 1);
+
+	// the 10th harmonic of a 5.1 KHz saw (51 KHz) would fold back to 3 KHz
+	std::vector<float> signal(static_cast<size_t>(sampleRate));
+	WavetableOscillator oscillator(saw, 5100.0);
+	oscillator.render(signal.data(), signal.size(), sampleRate);
+	assert(amplitudeAt(signal, 5100.0, sampleRate) > 0.5);
+	assert(amplitudeAt(signal, 3000.0, sampleRate) < 1.0e-3);
+
+	SawWave naive(5100.0);
+	naive.render(signal.data(), signal.size(), sampleRate);
+	assert(amplitudeAt(signal, 3000.0, sampleRate) > 1.0e-2);
+
+	// cubic interpolation of a sine is more accurate than linear interpolation
+	const Wavetable sine(Waveform::Sine, sampleRate);
+	WavetableOscillator sineOscillator(sine, 997.0);
+	for (auto interpolation : { Interpolation::Linear, Interpolation::Cubic }) {
+		sineOscillator.reset();
+		sineOscillator._interpolation = interpolation;
+		sineOscillator.render(signal.data(), 1000, sampleRate);
+		double maxError = 0.0;
+		for (size_t i = 0; i < 1000; ++i) {
+			maxError = std::max(maxError, std::abs(signal[i] - ::sin(2.0 * 3.141592653589793 * 997.0 * i / sampleRate)));
+		}
+		assert(maxError < (interpolation == Interpolation::Cubic ? 1.0e-6 : 1.0e-5));
+	}
+
+	// user-defined cycles keep their band-limited harmonics and DC offset
+	std::vector<float> cycle(600);
+	for (size_t i = 0; i < cycle.size(); ++i) {
+		const double x = 2.0 * 3.141592653589793 * i / cycle.size();
+		cycle[i] = 0.1f + 0.5f * ::sin(x) + 0.25f * ::cos(3.0 * x);
+	}
+	const Wavetable custom(cycle.data(), cycle.size(), sampleRate);
+	for (size_t i = 0; i < Wavetable::SIZE; i += 16) {
+		const double x = 2.0 * 3.141592653589793 * i / Wavetable::SIZE;
+		assert(std::abs(custom.table(0)[i] - (0.1 + 0.5 * ::sin(x) + 0.25 * ::cos(3.0 * x))) < 1.0e-5);
+	}
+
+	const Wavetable harmonics({ 1.0, 0.0, 0.5 }, sampleRate);
+	assert(std::abs(harmonics.table(0)[Wavetable::SIZE / 4] - 0.5) < 1.0e-6);
+
+	// negative frequencies run through the table backwards, a sine upside down
+	assert(sine.octave(-997.0) == sine.octave(997.0));
+	WavetableOscillator backwards(sine, -997.0);
+	backwards.render(signal.data(), 1000, sampleRate);
+	backwards.render(signal.data() + 1000, 1000, sampleRate);
+	for (size_t i = 0; i < 2000; ++i) {
+		assert(std::abs(signal[i] + ::sin(2.0 * 3.141592653589793 * 997.0 * i / sampleRate)) < 1.0e-5);
+		assert(std::abs(backwards(i / sampleRate) + ::sin(2.0 * 3.141592653589793 * 997.0 * i / sampleRate)) < 1.0e-5);
+	}
+}
+
+// Output buffer that can't be rewound, like a pipe
+struct PipeBuffer : std::streambuf {
+	std::string bytes;
+
+	int_type overflow(int_type c) override {
+		if (c != traits_type::eof()) {
+			bytes.push_back(traits_type::to_char_type(c));
+		}
+		return c;
+	}
+
+	std::streamsize xsputn(const char* s, std::streamsize n) override {
+		bytes.append(s, n);
+		return n;
+	}
+};
+
+// Resamplers keep the band intact, remove aliases, stream in blocks of any
+// size and convert files for mix()
+void resampling() {
+	const ResamplerQuality qualities[] { ResamplerQuality::Fast, ResamplerQuality::Medium, ResamplerQuality::Best };
+	const double ripples[] { 1.0e-3, 3.2e-5, 1.0e-6 };
+	const double PIx2 = 2.0 * 3.141592653589793;
+
+	std::vector<float> input(44100);
+	for (size_t i = 0; i < input.size(); ++i) {
+		input[i] = static_cast<float>(0.5 * ::sin(PIx2 * 1000.0 * i / 44100.0));
+	}
+
+	for (size_t q = 0; q < 3; ++q) {
+		// 44.1 kHz to 48 kHz: the sine is interpolated exactly, away from the edges
+		Resampler up(44100, 48000, 1, qualities[q]);
+		std::vector<float> output(up.maxOutputFrames(input.size()) + up.maxOutputFrames(up.taps()));
+		size_t n = up.process(input.data(), input.size(), output.data());
+		n += up.flush(output.data() + n);
+		assert(n == 48000 && up.outputFrames(input.size()) == 48000);
+
+		double maxError = 0.0;
+		for (size_t i = up.taps(); i < n - up.taps(); ++i) {
+			maxError = std::max(maxError, std::abs(output[i] - 0.5 * ::sin(PIx2 * 1000.0 * i / 48000.0)));
+		}
+		assert(maxError < ripples[q] + 1.0e-6);
+
+		// blocks of any size convert to the same samples
+		up.reset();
+		std::vector<float> blocks(output.size());
+		size_t m = 0;
+		for (size_t first = 0, size = 1; first < input.size(); first += size, size = size * 3 + 1) {
+			const size_t frames = std::min(size, input.size() - first);
+			std::vector<float> block(up.maxOutputFrames(frames));
+			const size_t converted = up.process(input.data() + first, frames, block.data());
+			std::copy(block.begin(), block.begin() + converted, blocks.begin() + m);
+			m += converted;
+		}
+		m += up.flush(blocks.data() + m);
+		assert(m == n && std::equal(output.begin(), output.begin() + n, blocks.begin()));
+
+		// 48 kHz to 44.1 kHz: a tone above the new Nyquist frequency is removed
+		std::vector<float> high(48000);
+		for (size_t i = 0; i < high.size(); ++i) {
+			high[i] = static_cast<float>(::sin(PIx2 * 23000.0 * i / 48000.0));
+		}
+		Resampler down(48000, 44100, 1, qualities[q]);
+		std::vector<float> low(down.maxOutputFrames(high.size()) + down.maxOutputFrames(down.taps()));
+		n = down.process(high.data(), high.size(), low.data());
+		n += down.flush(low.data() + n);
+		assert(n == 44100);
+		low.assign(low.begin() + down.taps(), low.begin() + n - down.taps());
+		assert(amplitudeAt(low, 44100.0 - 23000.0, 44100.0) < 2.0 * ripples[q] + 1.0e-5);
+	}
+
+	// stereo at a ratio finer than the filter bank
+	Resampler fine(44100, 44101, 2);
+	std::vector<float> stereo(2 * input.size());
+	for (size_t i = 0; i < input.size(); ++i) {
+		stereo[2 * i] = input[i];
+		stereo[2 * i + 1] = -input[i];
+	}
+	std::vector<float> output(2 * (fine.maxOutputFrames(input.size()) + fine.maxOutputFrames(fine.taps())));
+	size_t n = fine.process(stereo.data(), input.size(), output.data());
+	n += fine.flush(output.data() + 2 * n);
+	assert(n == 44101);
+	for (size_t i = fine.taps(); i < n - fine.taps(); ++i) {
+		assert(std::abs(output[2 * i] - 0.5 * ::sin(PIx2 * 1000.0 * i / 44101.0)) < 1.0e-4);
+		assert(output[2 * i + 1] == -output[2 * i]);
+	}
+
+	// files at different rates are converted before they're mixed
+	writeSoundFile("synthesis/sine_1kHz@44100Hz.aiff", input.data(), input.size(), 1, 44100);
+	std::vector<float> sine(48000);
+	for (size_t i = 0; i < sine.size(); ++i) {
+		sine[i] = static_cast<float>(0.5 * ::sin(PIx2 * 1000.0 * i / 48000.0));
+	}
+	writeSoundFile("synthesis/sine_1kHz@48000Hz.aiff", sine.data(), sine.size(), 1, 48000);
+
+	assert(mk::resample("synthesis/sine_1kHz@44100Hz.aiff", "synthesis/sine_1kHz@48000Hz_resampled.aiff", 48000, ResamplerQuality::Best));
+	SF_INFO info;
+	const std::vector<float> resampled = readSoundFile("synthesis/sine_1kHz@48000Hz_resampled.aiff", info);
+	assert(info.samplerate == 48000 && info.frames == 48000);
+	assert(std::abs(amplitudeAt(resampled, 1000.0, 48000.0) - 0.5) < 0.01);
+
+	assert(mk::mix("synthesis/sine_1kHz@48000Hz.aiff", "synthesis/sine_1kHz@44100Hz.aiff", "synthesis/sine_1kHz_mix.aiff", -6.0, -6.0));
+	const std::vector<float> mixed = readSoundFile("synthesis/sine_1kHz_mix.aiff", info);
+	assert(info.samplerate == 48000 && info.frames == 48000);
+
+	// both sines are in phase: the mix has the amplitude of one
+	assert(std::abs(amplitudeAt(mixed, 1000.0, 48000.0) - 0.5) < 0.01);
+}
+
+void pipelines() {
+	const uint16_t channels = 2;
+	std::vector<float> input(2 * 4097);
+	for (size_t i = 0; i < input.size(); ++i) {
+		input[i] = static_cast<float>(0.5 * ::sin(0.01 * i));
+	}
+
+	// a chain of stages processes a block like the stages one after the other
+	Pipeline chain;
+	chain.gain(6.0).clamp().pan(0.2).invert();
+	assert(chain.size() == 4 && chain.prepare(channels, SAMPLE_RATE_48K));
+	std::vector<float> chained(input);
+	chain.process(chained.data(), chained.size() / channels, channels);
+
+	std::vector<float> staged(input);
+	GainStage(6.0).process(staged.data(), staged.size() / channels, channels);
+	ClampStage().process(staged.data(), staged.size() / channels, channels);
+	PanStage(0.2).process(staged.data(), staged.size() / channels, channels);
+	InvertStage().process(staged.data(), staged.size() / channels, channels);
+	assert(chained == staged);
+	assert(*std::max_element(chained.begin(), chained.end()) <= 1.0f);
+
+	// blocks of any size process to the same samples
+	std::vector<float> blocks(input);
+	for (size_t first = 0, size = 1; first < blocks.size() / channels; first += size, size = size * 3 + 1) {
+		const size_t frames = std::min(size, blocks.size() / channels - first);
+		chain.process(&blocks[first * channels], frames, channels);
+	}
+	assert(blocks == chained);
+
+	// panning needs stereo frames
+	Pipeline pan;
+	pan.pan(0.0);
+	assert(!pan.prepare(1, SAMPLE_RATE_48K) && pan.prepare(2, SAMPLE_RATE_48K));
+
+	// normalizing scales the peak of the analyzed input
+	Pipeline normalize;
+	normalize.gain(-6.0).normalize(-3.0);
+	assert(normalize.prepare(channels, SAMPLE_RATE_48K) && normalize.stage(1).analyzes());
+	std::vector<float> normalized(input);
+	normalize.process(normalized.data(), normalized.size() / channels, channels, 0, 1);
+	normalize.stage(1).analyze(normalized.data(), normalized.size() / channels, channels);
+	normalize.process(normalized.data(), normalized.size() / channels, channels, 1);
+	float peak = 0.0f;
+	for (float s : normalized) {
+		peak = std::max(peak, std::abs(s));
+	}
+	assert(std::abs(peak - loudnessToAmplitude(-3.0)) < 1.0e-6);
+
+	Pipeline loud;
+	loud.normalize(1.0);
+	assert(!loud.prepare(channels, SAMPLE_RATE_48K));
+}
+
+void automations() {
+	Automation fade;
+	assert(fade.parse("0:-60, 2.5:0\n3:0,3:-6") && fade.breakpoints().size() == 4);
+	assert(fade.valueAt(-1.0) == -60.0 && fade.valueAt(1.25) == -30.0 && fade.valueAt(2.75) == 0.0);
+	assert(fade.valueAt(3.0) == -6.0 && fade.valueAt(10.0) == -6.0);
+	assert(!fade.parse("1:0, 0:1") && !fade.parse("0:") && !fade.parse("") && fade.breakpoints().size() == 4);
+
+	// breakpoints are read from a file, or from the text itself
+	std::ofstream("synthesis/automation.txt") << "0:1\n2:3\n";
+	assert(fade.read("synthesis/automation.txt") && fade.breakpoints().size() == 2 && fade.valueAt(1.0) == 2.0);
+	assert(fade.read("0:-1, 1:1") && fade.valueAt(0.5) == 0.0);
+
+	// a gain ramp in dB, a jump and a linear fade out to silence
+	const uint32_t sampleRate = 1000;
+	const uint16_t channels = 2;
+	const size_t frames = 3000;
+	Automation gain;
+	gain.add(0.0, -40.0).add(1.0, 0.0).add(1.0, -6.0).add(2.5, -std::numeric_limits<double>::infinity());
+	Pipeline gainPipeline;
+	gainPipeline.gain(gain);
+	assert(gainPipeline.prepare(channels, sampleRate));
+
+	std::vector<float> ones(frames * channels, 1.0f);
+	std::vector<float> gains(ones);
+	for (size_t first = 0, size = 1; first < frames; first += size, size = size * 3 + 1) {
+		gainPipeline.process(&gains[first * channels], std::min(size, frames - first), channels);
+	}
+	for (size_t i = 0; i < frames; ++i) {
+		const double expected = i < 1000 ? loudnessToAmplitude(-40.0 + 40.0 * i / 1000)
+			: i < 2500 ? loudnessToAmplitude(-6.0) * (1.0 - (i - 1000) / 1500.0) : 0.0;
+		for (uint16_t j = 0; j < channels; ++j) {
+			assert(std::abs(gains[i * channels + j] - expected) < 1.0e-6);
+		}
+	}
+
+	// rewinding restarts the automation
+	std::vector<float> rewound(ones);
+	gainPipeline.rewind();
+	gainPipeline.process(rewound.data(), frames, channels);
+	for (size_t i = 0; i < rewound.size(); ++i) {
+		assert(std::abs(rewound[i] - gains[i]) < 1.0e-6);
+	}
+
+	// a pan from left to right, like panning each frame on its own, both
+	// within the error of the sine and cosine of their positions
+	const double tolerance = 1.0e-6 + 2.0 * SINCOS_MAX_ERROR;
+	Automation sweep;
+	sweep.add(0.0, -1.0).add(0.5, 1.0);
+	Pipeline panPipeline;
+	panPipeline.pan(sweep);
+	assert(panPipeline.prepare(channels, sampleRate));
+	std::vector<float> panned(ones);
+	panPipeline.process(panned.data(), frames, channels);
+	for (size_t i = 0; i < frames; ++i) {
+		float frame[] { 1.0f, 1.0f };
+		PanStage(std::min(-1.0 + i / 250.0, 1.0)).process(frame, 1, channels);
+		assert(std::abs(panned[i * channels] - frame[0]) < tolerance && std::abs(panned[i * channels + 1] - frame[1]) < tolerance);
+	}
+
+	Pipeline empty;
+	empty.gain(Automation());
+	assert(!empty.prepare(channels, sampleRate));
+
+	// a ramp to +inf dB would turn samples into NaNs
+	Pipeline infinite;
+	infinite.gain(Automation().add(0.0, 0.0).add(1.0, std::numeric_limits<double>::infinity()));
+	assert(!infinite.prepare(channels, sampleRate));
+	Pipeline notANumber;
+	notANumber.gain(Automation().add(0.0, std::numeric_limits<double>::quiet_NaN()));
+	assert(!notANumber.prepare(channels, sampleRate));
+
+	Pipeline outOfRange;
+	outOfRange.pan(Automation().add(0.0, 0.0).add(1.0, 1.5));
+	assert(!outOfRange.prepare(channels, sampleRate));
+	assert(!panPipeline.prepare(1, sampleRate));
+}
+
+std::string readFile(const std::string& filePath) {
+	std::ifstream f(filePath, std::ios::binary);
+	return std::string((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+}
+
+// index of the first sample of largest magnitude, as scanMax() finds it
+size_t findPeakReference(const float* samples, size_t count) {
+	size_t peak = 0;
+	float max = 0.0f;
+	for (size_t i = 0; i < count; ++i) {
+		if (max < std::abs(samples[i])) {
+			max = std::abs(samples[i]);
+			peak = i;
+		}
+	}
+	return peak;
+}
+
+void peakKernel() {
+	std::vector<float> samples(20011);
+	uint32_t seed = 3;
+	for (size_t i = 0; i < samples.size(); ++i) {
+		seed = seed * 1664525u + 1013904223u;
+		samples[i] = static_cast<float>((seed >> 8) / 16777216.0 - 0.5);
+	}
+
+	// every length, so the peak is found in vectors and in scalar tails
+	for (size_t count = 0; count < 100; ++count) {
+		assert(findPeak(samples.data(), count) == findPeakReference(samples.data(), count));
+	}
+	assert(findPeak(samples.data(), samples.size()) == findPeakReference(samples.data(), samples.size()));
+
+	// the first of equal peaks, whatever their signs or chunks
+	samples[15000] = 0.75f;
+	samples[9000] = -0.75f;
+	samples[9001] = 0.75f;
+	assert(findPeak(samples.data(), samples.size()) == 9000);
+	samples[19999] = -0.8f;
+	assert(findPeak(samples.data(), samples.size()) == 19999);
+
+	// NaNs are ignored
+	samples[5] = std::numeric_limits<float>::quiet_NaN();
+	samples[100] = std::numeric_limits<float>::quiet_NaN();
+	assert(findPeak(samples.data(), samples.size()) == 19999);
+
+	// silence peaks at the first sample
+	std::vector<float> silence(1001, 0.0f);
+	silence[10] = -0.0f;
+	assert(findPeak(silence.data(), silence.size()) == 0);
+
+	// interleaved frames locate the peak's frame and channel
+	const SampleInfo max = scanMax(samples.data() + 1, 6000, 3);
+	assert(max.frame == 8999 / 3 && max.channel == 8999 % 3 && max.amplitude == -0.75f);
+	assert(scanMax(silence.data(), 500, 2).amplitude == 0.0);
+}
+
+void peakIndexes() {
+	const uint16_t channels = 2;
+	const size_t frames = 100003;
+	std::vector<float> samples(frames * channels);
+	uint32_t seed = 1;
+	for (size_t i = 0; i < samples.size(); ++i) {
+		seed = seed * 1664525u + 1013904223u;
+		samples[i] = static_cast<float>((seed >> 8) / 16777216.0 - 0.5);
+	}
+	// the first of two equal peaks is found
+	samples[2 * 7777 + 1] = -0.9f;
+	samples[2 * 20000] = 0.9f;
+
+	PeakIndex index;
+	index.reset(channels);
+	for (size_t first = 0, size = 1; first < frames; first += size, size = size * 3 + 1) {
+		index.add(&samples[first * channels], std::min(size, frames - first));
+	}
+	index.finish();
+	assert(index.valid() && index.frames() == frames && index.channels() == channels);
+	assert(index.peakFrame() == 7777 && index.peakChannel() == 1 && index.peakAmplitude() == -0.9f);
+	assert(index.blocks(0) == (frames + PeakIndex::BLOCK_FRAMES - 1) / PeakIndex::BLOCK_FRAMES);
+	assert(index.blocks(index.levels() - 1) == 1);
+
+	// the top level summarizes each channel
+	for (uint16_t j = 0; j < channels; ++j) {
+		float min = 1.0f, max = -1.0f;
+		double squares = 0.0;
+		for (size_t i = 0; i < frames; ++i) {
+			min = std::min(min, samples[i * channels + j]);
+			max = std::max(max, samples[i * channels + j]);
+			squares += double(samples[i * channels + j]) * samples[i * channels + j];
+		}
+		const PeakBlock& top = index.block(index.levels() - 1, 0, j);
+		assert(top.min == min && top.max == max);
+		assert(std::abs(top.rms - std::sqrt(squares / frames)) < 1.0e-5);
+	}
+
+	// overview blocks cover the samples of their range
+	const std::vector<PeakBlock> overview = index.overview(1, 1000, 50000, 37);
+	assert(overview.size() == 37);
+	for (size_t b = 0; b < overview.size(); ++b) {
+		for (size_t i = 1000 + 50000 * b / 37; i < 1000 + 50000 * (b + 1) / 37; ++i) {
+			assert(overview[b].min <= samples[i * channels + 1] && samples[i * channels + 1] <= overview[b].max);
+		}
+	}
+
+	// indexes of consecutive ranges of whole blocks combine into the same
+	// index, the first of equal peaks in different ranges being kept
+	const size_t rangeFrames = 37 * PeakIndex::BLOCK_FRAMES;
+	PeakIndex combined;
+	combined.reset(channels);
+	for (size_t first = 0; first < frames; first += rangeFrames) {
+		PeakIndex range;
+		range.reset(channels);
+		range.add(&samples[first * channels], std::min(rangeFrames, frames - first));
+		range.finish();
+		combined.add(range);
+	}
+	combined.finish();
+	assert(combined.frames() == frames && combined.levels() == index.levels());
+	assert(combined.peakFrame() == 7777 && combined.peakChannel() == 1 && combined.peakAmplitude() == -0.9f);
+	for (size_t level = 0; level < index.levels(); ++level) {
+		assert(combined.blocks(level) == index.blocks(level));
+		for (size_t b = 0; b < index.blocks(level); ++b) {
+			for (uint16_t j = 0; j < channels; ++j) {
+				assert(combined.block(level, b, j).min == index.block(level, b, j).min);
+				assert(combined.block(level, b, j).max == index.block(level, b, j).max);
+				assert(combined.block(level, b, j).rms == index.block(level, b, j).rms);
+			}
+		}
+	}
+
+	// indexes load back only with the key they were saved with
+	{
+		std::ofstream("synthesis/peaks.dat") << "audio";
+	}
+	FileKey key;
+	assert(key.read("synthesis/peaks.dat") && key.size == 5);
+	assert(index.save("synthesis/peaks.dat.mkpk", key));
+
+	PeakIndex loaded;
+	assert(loaded.load("synthesis/peaks.dat.mkpk", key));
+	assert(loaded.frames() == frames && loaded.levels() == index.levels() && loaded.peakFrame() == 7777);
+	assert(loaded.block(0, 100, 1).max == index.block(0, 100, 1).max);
+
+	FileKey changed = key;
+	changed.hash ^= 1;
+	assert(!loaded.load("synthesis/peaks.dat.mkpk", changed) && !loaded.valid());
+
+	// so is a file rewritten with the same size, head and tail in the same
+	// second, or with its modification time set back like cp -p does
+	changed = key;
+	changed.mtime += 1;
+	assert(!loaded.load("synthesis/peaks.dat.mkpk", changed));
+	changed = key;
+	changed.ctime += 1;
+	assert(!loaded.load("synthesis/peaks.dat.mkpk", changed));
+
+	// a truncated index is rejected
+	const std::string saved = readFile("synthesis/peaks.dat.mkpk");
+	{
+		std::ofstream("synthesis/peaks.dat.mkpk", std::ios::binary) << saved.substr(0, saved.size() - 1);
+	}
+	assert(!loaded.load("synthesis/peaks.dat.mkpk", key));
+}
+
+void batches() {
+	assert(batchOutputPath("masters/song.aiff", "out") == "out/song.aiff");
+	assert(batchOutputPath("song.aiff", "out/") == "out/song.aiff");
+	assert(batchOutputPath("masters/song.aiff", "") == "song.aiff");
+
+	// inputs of 3, 1 and 2 KiB
+	const char* inputs[] { "synthesis/batch_a.dat", "synthesis/batch_b.dat", "synthesis/batch_c.dat" };
+	const size_t sizes[] { 3072, 1024, 2048 };
+	for (size_t i = 0; i < 3; ++i) {
+		std::ofstream(inputs[i], std::ios::binary) << std::string(sizes[i], 'x');
+	}
+
+	// a single thread runs files largest first, and failures don't stop it
+	ThreadPool pool(1);
+	std::vector<std::string> order;
+	const BatchReport report = processBatch({ inputs[0], inputs[1], inputs[2], "synthesis/batch_missing.dat" }, "out",
+		[&](const std::string& in, const std::string& out) {
+			order.push_back(in);
+			assert(out == batchOutputPath(in, "out"));
+			return in != inputs[2];
+		}, pool);
+	assert((order == std::vector<std::string>{ inputs[0], inputs[2], inputs[1], "synthesis/batch_missing.dat" }));
+	assert(report.succeeded == 3 && report.bytes == 3072 + 1024);
+	assert((report.failures == std::vector<std::string>{ inputs[2] }));
+
+	// outputs can't overwrite each other
+	ThreadPool threads(3);
+	std::atomic<int> calls(0);
+	const BatchReport duplicates = processBatch({ inputs[0], "elsewhere/batch_a.dat", inputs[1] }, "out",
+		[&](const std::string&, const std::string&) { ++calls; return true; }, threads);
+	assert(calls == 2 && duplicates.succeeded == 2);
+	assert((duplicates.failures == std::vector<std::string>{ "elsewhere/batch_a.dat" }));
+
+	// nor overwrite an input file, whatever the path to it
+	std::ofstream("batch_self.dat") << "x";
+	calls = 0;
+	const BatchReport overwrites = processBatch({ "batch_self.dat" }, ".",
+		[&](const std::string&, const std::string&) { ++calls; return true; }, threads);
+	assert((overwrites.failures == std::vector<std::string>{ "batch_self.dat" }));
+	const BatchReport subdirectory = processBatch({ inputs[1] }, "./synthesis",
+		[&](const std::string&, const std::string&) { ++calls; return true; }, threads);
+	assert((subdirectory.failures == std::vector<std::string>{ inputs[1] }));
+	assert(calls == 0 && overwrites.succeeded == 0 && subdirectory.succeeded == 0);
+	assert(readFile("batch_self.dat") == "x");
+	std::remove("batch_self.dat");
+}
+
+void mixing() {
+	assert(!mk::mix(std::vector<MixInput>(), "synthesis/mix.aiff"));
+
+	// a stereo input, and a shorter mono one into the right channel
+	const size_t frames = 5000;
+	const size_t monoFrames = 3001;
+	std::vector<float> stereo(frames * 2);
+	std::vector<float> mono(monoFrames);
+	for (size_t i = 0; i < stereo.size(); ++i) {
+		stereo[i] = static_cast<float>(0.5 * ::sin(0.01 * i));
+	}
+	for (size_t i = 0; i < mono.size(); ++i) {
+		mono[i] = static_cast<float>(0.5 * ::cos(0.003 * i));
+	}
+	const int format = SF_FORMAT_AIFF | SF_FORMAT_FLOAT;
+	writeSoundFile("synthesis/mix_stereo.aiff", stereo.data(), frames, 2, 48000, format);
+	writeSoundFile("synthesis/mix_mono.aiff", mono.data(), monoFrames, 1, 48000, format);
+
+	// a map needs an output channel per channel of its file
+	std::vector<MixInput> inputs { MixInput("synthesis/mix_stereo.aiff", -6.0), MixInput("synthesis/mix_mono.aiff", 6.0) };
+	inputs[1].channelMap = { 1, 0 };
+	assert(!mk::mix(inputs, "synthesis/mix.aiff"));
+	inputs[1].channelMap = { 1 };
+
+	const MixPrecision precisions[] { MixPrecision::Float, MixPrecision::Double };
+	for (auto precision : precisions) {
+		assert(mk::mix(inputs, "synthesis/mix.aiff", precision));
+		SF_INFO info;
+		const std::vector<float> mixed = readSoundFile("synthesis/mix.aiff", info);
+		assert(info.channels == 2 && info.frames == frames && info.samplerate == 48000);
+		for (size_t i = 0; i < frames; ++i) {
+			const double left = loudnessToAmplitude(-6.0) * stereo[i * 2];
+			const double right = loudnessToAmplitude(-6.0) * stereo[i * 2 + 1] + (i < monoFrames ? loudnessToAmplitude(6.0) * mono[i] : 0.0);
+			assert(std::abs(mixed[i * 2] - mk::clamp(left, -1.0, 1.0)) < 1.0e-6);
+			assert(std::abs(mixed[i * 2 + 1] - mk::clamp(right, -1.0, 1.0)) < 1.0e-6);
+		}
+	}
+
+	// channels swapped into a third output channel
+	std::vector<MixInput> swapped { MixInput("synthesis/mix_stereo.aiff") };
+	swapped[0].channelMap = { 2, 0 };
+	assert(mk::mix(swapped, "synthesis/mix_swapped.aiff"));
+	SF_INFO info;
+	const std::vector<float> mixed = readSoundFile("synthesis/mix_swapped.aiff", info);
+	assert(info.channels == 3 && info.frames == frames);
+	for (size_t i = 0; i < frames; ++i) {
+		assert(mixed[i * 3] == stereo[i * 2 + 1] && mixed[i * 3 + 1] == 0.0f && mixed[i * 3 + 2] == stereo[i * 2]);
+	}
+}
+
+// write non-seekable streams and compare them to files written the usual way
+void writeStreams() {
+	const uint16_t channels = 2;
+	const size_t frames = 50001;
+
+	std::vector<float> samples(frames * channels);
+	for (size_t i = 0; i < samples.size(); ++i) {
+		samples[i] = ::sin(0.001 * i);
+	}
+
+	const BitDepth depths[] { BitDepth::BitDepth16, BitDepth::BitDepth24, BitDepth::Float32 };
+	for (auto depth : depths) {
+		{
+			mk::AIFF aiff("synthesis/file.aiff", depth, channels, SAMPLE_RATE_48K);
+			aiff.write(samples.data(), frames);
+
+			mk::WAV wav("synthesis/file.wav", depth, channels, SAMPLE_RATE_48K);
+			wav.write(samples.data(), frames);
+		}
+
+		PipeBuffer aiffPipe;
+		PipeBuffer wavPipe;
+		{
+			std::ostream aiffOut(&aiffPipe);
+			mk::AIFF aiff(aiffOut, depth, channels, SAMPLE_RATE_48K, frames);
+			aiff.write(samples.data(), frames);
+
+			std::ostream wavOut(&wavPipe);
+			mk::WAV wav(wavOut, depth, channels, SAMPLE_RATE_48K, frames);
+			wav.enableAsync();
+			wav.write(samples.data(), frames);
+		}
+		assert(aiffPipe.bytes == readFile("synthesis/file.aiff"));
+		assert(wavPipe.bytes == readFile("synthesis/file.wav"));
+	}
+
+	// missing frames are filled with silence, extra frames are dropped
+	std::vector<float> padded(samples.begin(), samples.begin() + 1000 * channels);
+	padded.resize(samples.size());
+	{
+		mk::AIFF aiff("synthesis/file.aiff", BitDepth::BitDepth16, channels, SAMPLE_RATE_48K);
+		aiff.write(padded.data(), frames);
+	}
+
+	PipeBuffer shortPipe;
+	PipeBuffer longPipe;
+	{
+		std::ostream shortOut(&shortPipe);
+		mk::AIFF aiff(shortOut, BitDepth::BitDepth16, channels, SAMPLE_RATE_48K, frames);
+		aiff.write(samples.data(), 1000);
+
+		std::ostream longOut(&longPipe);
+		mk::AIFF longAiff(longOut, BitDepth::BitDepth16, channels, SAMPLE_RATE_48K, 1000);
+		longAiff.write(samples.data(), frames);
+	}
+	assert(shortPipe.bytes == readFile("synthesis/file.aiff"));
+
+	{
+		mk::AIFF aiff("synthesis/file.aiff", BitDepth::BitDepth16, channels, SAMPLE_RATE_48K);
+		aiff.write(samples.data(), 1000);
+	}
+	assert(longPipe.bytes == readFile("synthesis/file.aiff"));
+}
+
 void printMaxSample() {
 	SampleInfo max;
 	mk::scanMax("reference/wu-tang.aiff", max);
@@ -231,7 +1693,30 @@ int main(int argc, char* argv[]) {
 	exponentialEnvelopes();
 	writeSineWaveToFile();
 	writeSineWaveToAIFF();
+	writeSineWaveBlocksToAIFF();
 	writeSawWaveToAIFF();
+	writeAIFFBlocks();
+	encodePCMKernels();
+	readAIFF();
+	readAIFFFormats();
+	writeWAV();
+	writeAIFFAsync();
+	writeStreams();
+	renderOscillators();
+	envelopes();
+	combinatorModules();
+	patchGraph();
+	renderEngine();
+	wavetableOscillators();
+	resampling();
+	pipelines();
+	automations();
+	peakKernel();
+	peakIndexes();
+	batches();
+	mixing();
+	sinCosKernels();
+	voiceEngine();
 	printMaxSample();
 	normalizeAudio();
 	amplifyAudio();